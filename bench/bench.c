@@ -0,0 +1,147 @@
+#include "bench.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// glibc's own entry points, the wrappers below count and forward
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void  __libc_free(void *ptr);
+
+static thread_local uint64_t allocations;
+
+// One JSON object per line instead of the table, set by --json
+static bool json_output;
+
+void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    allocations++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+uint64_t bench_allocations(void) {
+    return allocations;
+}
+
+uint64_t bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void bench_init(int argc, char **argv, const char **filter) {
+    *filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            *filter = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json_output = true;
+        } else {
+            fprintf(stderr, "usage: %s [--filter <substring>] [--json]\n", argv[0]);
+            exit(strcmp(argv[i], "--help") == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
+    if (!json_output)
+        printf("%-40s %12s %8s %12s %10s\n", "case", "ns/op", "spread", "MB/s", "allocs/op");
+}
+
+static int bench_compareDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Finds how many iterations make a round last BENCH_ROUND_NS
+ */
+static size_t bench_calibrate(bench_fn fn, void *ctx) {
+    size_t iterations = 1;
+    while (true) {
+        uint64_t start = bench_now();
+        fn(ctx, iterations);
+        uint64_t elapsed = bench_now() - start;
+        if (elapsed >= BENCH_ROUND_NS / 4 || iterations >= (SIZE_MAX >> 4))
+            return elapsed >= BENCH_ROUND_NS ? iterations
+                                             : iterations * BENCH_ROUND_NS / (elapsed + 1) + 1;
+        iterations *= 2;
+    }
+}
+
+bench_stats bench_measure(bench_fn fn, void *ctx, size_t bytes) {
+    size_t iterations = bench_calibrate(fn, ctx);
+    for (int i = 0; i < BENCH_WARMUP_ROUNDS; i++)
+        fn(ctx, iterations);
+
+    double per_op[BENCH_ROUNDS];
+    uint64_t allocs_before = bench_allocations();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        uint64_t start = bench_now();
+        fn(ctx, iterations);
+        per_op[i] = (double)(bench_now() - start) / iterations;
+    }
+    uint64_t allocs = bench_allocations() - allocs_before;
+
+    double mean = 0;
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+        mean += per_op[i];
+    mean /= BENCH_ROUNDS;
+    double variance = 0;
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+        variance += (per_op[i] - mean) * (per_op[i] - mean);
+    variance /= BENCH_ROUNDS - 1;
+
+    qsort(per_op, BENCH_ROUNDS, sizeof(double), bench_compareDouble);
+    bench_stats stats = {
+        .iterations = iterations,
+        .median_ns = per_op[BENCH_ROUNDS / 2],
+        .min_ns = per_op[0],
+        .spread = mean > 0 ? 100 * sqrt(variance) / mean : 0,
+        .allocs = (double)allocs / ((double)iterations * BENCH_ROUNDS),
+    };
+    if (bytes > 0 && stats.median_ns > 0)
+        stats.bytes_per_s = bytes * 1e9 / stats.median_ns;
+    return stats;
+}
+
+bool bench_selected(const char *suite, const char *name, const char *filter) {
+    char label[128];
+    snprintf(label, sizeof(label), "%s/%s", suite, name);
+    return !filter || strstr(label, filter);
+}
+
+void bench_case(const char *suite, const char *name, const char *filter, bench_fn fn,
+                void *ctx, size_t bytes) {
+    if (!bench_selected(suite, name, filter))
+        return;
+
+    char label[128];
+    snprintf(label, sizeof(label), "%s/%s", suite, name);
+
+    bench_stats stats = bench_measure(fn, ctx, bytes);
+    if (json_output)
+        printf("{\"case\":\"%s\",\"iterations\":%zu,\"median_ns\":%.2f,\"min_ns\":%.2f,"
+               "\"spread_pct\":%.2f,\"bytes_per_s\":%.0f,\"allocs_per_op\":%.3f}\n",
+               label, stats.iterations, stats.median_ns, stats.min_ns, stats.spread,
+               stats.bytes_per_s, stats.allocs);
+    else
+        printf("%-40s %12.1f %7.1f%% %12.1f %10.2f\n", label, stats.median_ns, stats.spread,
+               stats.bytes_per_s / 1e6, stats.allocs);
+    fflush(stdout);
+}
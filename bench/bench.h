@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Untimed rounds run first, then measured rounds. Each round repeats
+// the case until it takes at least BENCH_ROUND_NS.
+#define BENCH_WARMUP_ROUNDS 3
+#define BENCH_ROUNDS        15
+#define BENCH_ROUND_NS      (10 * 1000 * 1000)
+
+/**
+ * Body of a benchmark case, runs the measured operation iterations
+ * times
+ */
+typedef void (*bench_fn)(void *ctx, size_t iterations);
+
+/**
+ * Per operation results over the measured rounds
+ */
+typedef struct bench_stats {
+    size_t              iterations;
+    double              median_ns;
+    double              min_ns;
+    // Relative standard deviation across rounds, in percent
+    double              spread;
+    double              allocs;
+    double              bytes_per_s;
+} bench_stats;
+
+/**
+ * Parses the options common to every benchmark binary: --filter and
+ * --json, which prints one JSON object per case instead of a table.
+ * Exits on --help or unknown options.
+ *
+ * @param filter    Set to the --filter substring, NULL to run all
+ */
+void            bench_init(int argc, char **argv, const char **filter);
+
+/**
+ * Monotonic clock
+ *
+ * @returns Nanoseconds
+ */
+uint64_t        bench_now(void);
+
+/**
+ * Heap allocations made by this thread so far, malloc, calloc and
+ * realloc calls included
+ */
+uint64_t        bench_allocations(void);
+
+/**
+ * Measures fn after warming it up
+ *
+ * @param fn    Case body
+ * @param ctx   Passed to fn
+ * @param bytes Payload handled per operation, 0 if throughput means
+ *              nothing for the case
+ *
+ * @returns Statistics per operation
+ */
+bench_stats     bench_measure(bench_fn fn, void *ctx, size_t bytes);
+
+/**
+ * Returns whether "suite/name" passes the filter, for skipping the
+ * setup of cases that will not run
+ */
+bool            bench_selected(const char *suite, const char *name, const char *filter);
+
+/**
+ * Runs the case if it passes the filter and prints one result line
+ *
+ * @param suite     Benchmark binary, e.g. "parser"
+ * @param name      Case name
+ * @param filter    Substring "suite/name" must contain, NULL for all
+ */
+void            bench_case(const char *suite, const char *name, const char *filter,
+                           bench_fn fn, void *ctx, size_t bytes);
+
+/**
+ * Keeps the compiler from optimizing away a result
+ */
+static inline void bench_keep(const void *p) {
+    __asm__ volatile("" : : "g"(p) : "memory");
+}
@@ -0,0 +1,248 @@
+#include "bench.h"
+
+#include "map/map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t map_sizes[] = { 4, 16, 64, 1000, 10000, 100000 };
+static const size_t key_lengths[] = { 4, 16, 64, 256 };
+static const size_t hash_lengths[] = { 4, 16, 64, 256, 4096 };
+
+// Keys end in their index in base 36, enough for every hit and miss key
+#define MAP_INDEX_DIGITS 4
+
+/**
+ * Keys of one size and length. The map holds keys, none of misses.
+ * Lookups follow order, a shuffle of the key indices, so consecutive
+ * operations do not touch neighbouring entries.
+ */
+typedef struct map_case {
+    size_t              count;
+    size_t              key_length;
+    char**              keys;
+    char**              misses;
+    size_t*             order;
+    size_t              cursor;
+    map*                map;
+} map_case;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15u;
+
+static uint64_t map_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static char *map_makeKey(size_t index, size_t len) {
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char *key = malloc(len + 1);
+    if (!key) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < len - MAP_INDEX_DIGITS; i++)
+        key[i] = 'a' + map_random() % 26;
+    for (size_t i = len; i > len - MAP_INDEX_DIGITS; i--) {
+        key[i - 1] = digits[index % 36];
+        index /= 36;
+    }
+    key[len] = '\0';
+    return key;
+}
+
+static void map_caseInit(map_case *this, size_t count, size_t key_length) {
+    this->count = count;
+    this->key_length = key_length;
+    this->keys = malloc(count * sizeof(char *));
+    this->misses = malloc(count * sizeof(char *));
+    this->order = malloc(count * sizeof(size_t));
+    if (!this->keys || !this->misses || !this->order) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    this->map = map_new();
+    for (size_t i = 0; i < count; i++) {
+        this->keys[i] = map_makeKey(i, key_length);
+        this->misses[i] = map_makeKey(count + i, key_length);
+        this->map = map_set(this->map, this->keys[i], "value");
+        this->order[i] = i;
+    }
+    for (size_t i = count - 1; i > 0; i--) {
+        size_t j = map_random() % (i + 1);
+        size_t tmp = this->order[i];
+        this->order[i] = this->order[j];
+        this->order[j] = tmp;
+    }
+    this->cursor = 0;
+}
+
+static void map_caseDeinit(map_case *this) {
+    for (size_t i = 0; i < this->count; i++) {
+        free(this->keys[i]);
+        free(this->misses[i]);
+    }
+    free(this->keys);
+    free(this->misses);
+    free(this->order);
+    map_delete(this->map);
+}
+
+static inline size_t map_caseNext(map_case *this) {
+    size_t index = this->order[this->cursor];
+    if (++this->cursor == this->count)
+        this->cursor = 0;
+    return index;
+}
+
+/**
+ * Fills fresh maps with every key, freeing each one once full, so the
+ * cost per insert includes growing the table and the teardown
+ */
+static void map_runInsert(void *ctx, size_t iterations) {
+    map_case *this = ctx;
+    for (size_t done = 0; done < iterations;) {
+        map *m = map_new();
+        for (size_t i = 0; i < this->count && done < iterations; i++, done++)
+            m = map_set(m, this->keys[i], "value");
+        bench_keep(m);
+        map_delete(m);
+    }
+}
+
+static void map_runHit(void *ctx, size_t iterations) {
+    map_case *this = ctx;
+    for (size_t i = 0; i < iterations; i++)
+        bench_keep(map_get(this->map, this->keys[map_caseNext(this)]));
+}
+
+static void map_runMiss(void *ctx, size_t iterations) {
+    map_case *this = ctx;
+    for (size_t i = 0; i < iterations; i++)
+        bench_keep(map_get(this->map, this->misses[map_caseNext(this)]));
+}
+
+static void map_runUpdate(void *ctx, size_t iterations) {
+    map_case *this = ctx;
+    for (size_t i = 0; i < iterations; i++)
+        this->map = map_set(this->map, this->keys[map_caseNext(this)],
+                            i & 1 ? "value" : "other");
+}
+
+/**
+ * Removes a key and adds it back, keeping the size steady. The removed
+ * entry stays as a tombstone until the next rehash, which re-adding
+ * eventually triggers.
+ */
+static void map_runRemove(void *ctx, size_t iterations) {
+    map_case *this = ctx;
+    for (size_t i = 0; i < iterations; i++) {
+        const char *key = this->keys[map_caseNext(this)];
+        free(map_remove_value(this->map, key));
+        this->map = map_set(this->map, key, "value");
+    }
+}
+
+/**
+ * One step of map_next per iteration, wrapping around at the end
+ */
+static void map_runIterate(void *ctx, size_t iterations) {
+    map_case *this = ctx;
+    map_pair *pair = NULL;
+    for (size_t i = 0; i < iterations; i++) {
+        pair = map_next(this->map, pair);
+        bench_keep(pair);
+    }
+}
+
+static void map_runKeys(void *ctx, size_t iterations) {
+    map_case *this = ctx;
+    for (size_t i = 0; i < iterations; i++) {
+        size_t len;
+        const char **keys = map_keys(this->map, &len);
+        bench_keep(keys);
+        free(keys);
+    }
+}
+
+/**
+ * map_hash is wyhash over strlen(s) bytes, map_hash_fold the case
+ * folding variant keys are actually filed under
+ */
+typedef struct hash_case {
+    char*               data;
+    size_t              length;
+} hash_case;
+
+static void hash_runMapHash(void *ctx, size_t iterations) {
+    hash_case *this = ctx;
+    for (size_t i = 0; i < iterations; i++) {
+        bench_keep(this->data);
+        bench_keep((void *)map_hash(this->data));
+    }
+}
+
+static void hash_runFold(void *ctx, size_t iterations) {
+    hash_case *this = ctx;
+    for (size_t i = 0; i < iterations; i++) {
+        bench_keep(this->data);
+        bench_keep((void *)map_hash_fold(this->data, this->length));
+    }
+}
+
+static const struct {
+    const char*         name;
+    bench_fn            fn;
+} map_ops[] = {
+    { "insert", map_runInsert },
+    { "lookup_hit", map_runHit },
+    { "lookup_miss", map_runMiss },
+    { "update", map_runUpdate },
+    { "remove_readd", map_runRemove },
+    { "iterate", map_runIterate },
+    { "keys", map_runKeys },
+};
+
+int main(int argc, char **argv) {
+    const char *filter;
+    bench_init(argc, argv, &filter);
+
+    char name[64];
+    for (size_t s = 0; s < sizeof(map_sizes) / sizeof(map_sizes[0]); s++) {
+        for (size_t l = 0; l < sizeof(key_lengths) / sizeof(key_lengths[0]); l++) {
+            // Building the keys of a large case takes a while, skip unused ones
+            bool selected = false;
+            for (size_t o = 0; o < sizeof(map_ops) / sizeof(map_ops[0]); o++) {
+                snprintf(name, sizeof(name), "%s/n=%zu/len=%zu", map_ops[o].name,
+                         map_sizes[s], key_lengths[l]);
+                selected |= bench_selected("map", name, filter);
+            }
+            if (!selected)
+                continue;
+
+            map_case c;
+            map_caseInit(&c, map_sizes[s], key_lengths[l]);
+            for (size_t o = 0; o < sizeof(map_ops) / sizeof(map_ops[0]); o++) {
+                snprintf(name, sizeof(name), "%s/n=%zu/len=%zu", map_ops[o].name,
+                         map_sizes[s], key_lengths[l]);
+                bench_case("map", name, filter, map_ops[o].fn, &c, 0);
+            }
+            map_caseDeinit(&c);
+        }
+    }
+
+    for (size_t l = 0; l < sizeof(hash_lengths) / sizeof(hash_lengths[0]); l++) {
+        hash_case c = { .data = map_makeKey(l, hash_lengths[l]), .length = hash_lengths[l] };
+        snprintf(name, sizeof(name), "hash/map_hash/len=%zu", c.length);
+        bench_case("map", name, filter, hash_runMapHash, &c, c.length);
+        snprintf(name, sizeof(name), "hash/map_hash_fold/len=%zu", c.length);
+        bench_case("map", name, filter, hash_runFold, &c, c.length);
+        free(c.data);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+#include "loadgen.h"
+
+#include "http/server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SERVER_BODY_SIZE (16 * 1024)
+
+typedef struct bench_server_case {
+    const char*         name;
+    const char*         path;
+    bool                keep_alive;
+    // Run open loop at the rate given with --rate, or half of what the
+    // first case reached
+    bool                fixed_rate;
+} bench_server_case;
+
+static const bench_server_case cases[] = {
+    { "keepalive/plaintext", "/plaintext", true, false },
+    { "keepalive/param", "/users/42", true, false },
+    { "keepalive/16k", "/16k", true, false },
+    { "close/plaintext", "/plaintext", false, false },
+    { "rate/plaintext", "/plaintext", true, true },
+};
+
+typedef struct bench_server_listener {
+    http_server*        server;
+    uint16_t            port;
+    ErrorMessage        err;
+} bench_server_listener;
+
+static char body_16k[BENCH_SERVER_BODY_SIZE];
+
+static void handle_plaintext(http_request *req, http_response *res, void *ctx) {
+    http_response_HeaderSetValue(res, "Content-Type", "text/plain");
+    http_response_SetBody(res, "Hello, World!", 13);
+}
+
+static void handle_param(http_request *req, http_response *res, void *ctx) {
+    size_t len = 0;
+    const char *id = http_request_Param(req, "id", &len).Value;
+    char body[128];
+    int n = snprintf(body, sizeof(body), "{\"id\":\"%.*s\",\"name\":\"user\"}", (int)len,
+                     id ? id : "");
+    http_response_HeaderSetValue(res, "Content-Type", "application/json");
+    http_response_SetBody(res, body, n);
+}
+
+static void handle_16k(http_request *req, http_response *res, void *ctx) {
+    http_response_SetBody(res, body_16k, sizeof(body_16k));
+}
+
+static void *bench_server_listen(void *arg) {
+    bench_server_listener *this = arg;
+    this->err = http_server_listen(this->server, this->port);
+    return NULL;
+}
+
+/**
+ * Asks the kernel for a free loopback port. Another process could take
+ * it before the server binds, which only makes the run fail.
+ */
+static uint16_t bench_server_freePort(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = { .sin_family = AF_INET,
+                                   .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(address);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&address, len) < 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &len) < 0) {
+        perror("free port");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return ntohs(address.sin_port);
+}
+
+static bool bench_server_waitReady(uint16_t port) {
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons(port),
+                                   .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    for (int attempt = 0; attempt < 500; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        bool ok = fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+        if (fd >= 0)
+            close(fd);
+        if (ok)
+            return true;
+        nanosleep(&(struct timespec){ .tv_nsec = 10 * 1000 * 1000 }, NULL);
+    }
+    return false;
+}
+
+static void usage(const char *name, int status) {
+    fprintf(status ? stderr : stdout,
+            "usage: %s [options]\n"
+            "  --duration <seconds>   measured time per case (5)\n"
+            "  --warmup <seconds>     load before measuring each case (1)\n"
+            "  --threads <n>          load generator threads (2)\n"
+            "  --connections <n>      concurrent connections (64)\n"
+            "  --workers <n>          server workers, default online CPUs\n"
+            "  --backend <name>       epoll or io_uring (epoll)\n"
+            "  --rate <requests/s>    rate of the fixed rate case\n"
+            "  --filter <substring>   only run cases whose name contains it\n"
+            "  --metrics              record server metrics, to see what they cost\n"
+            "  --json                 one JSON object per case\n",
+            name);
+    exit(status);
+}
+
+int main(int argc, char **argv) {
+    loadgen_options options = {
+        .host = "127.0.0.1",
+        .threads = 2,
+        .connections = 64,
+        .duration_ns = 5 * 1000000000ull,
+        .warmup_ns = 1000000000ull,
+    };
+    size_t workers = 0;
+    http_backend backend = HTTP_BACKEND_EPOLL;
+    double rate = 0;
+    const char *filter = NULL;
+    bool json = false;
+    bool metrics = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--json") == 0) {
+            json = true;
+            continue;
+        }
+        if (strcmp(arg, "--metrics") == 0) {
+            metrics = true;
+            continue;
+        }
+        if (strcmp(arg, "--help") == 0)
+            usage(argv[0], EXIT_SUCCESS);
+        if (!value)
+            usage(argv[0], EXIT_FAILURE);
+        i++;
+
+        if (strcmp(arg, "--duration") == 0) {
+            options.duration_ns = strtod(value, NULL) * 1e9;
+        } else if (strcmp(arg, "--warmup") == 0) {
+            options.warmup_ns = strtod(value, NULL) * 1e9;
+        } else if (strcmp(arg, "--threads") == 0) {
+            options.threads = strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--connections") == 0) {
+            options.connections = strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--workers") == 0) {
+            workers = strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--backend") == 0) {
+            if (strcmp(value, "io_uring") == 0)
+                backend = HTTP_BACKEND_IO_URING;
+            else if (strcmp(value, "epoll") != 0)
+                usage(argv[0], EXIT_FAILURE);
+        } else if (strcmp(arg, "--rate") == 0) {
+            rate = strtod(value, NULL);
+        } else if (strcmp(arg, "--filter") == 0) {
+            filter = value;
+        } else {
+            usage(argv[0], EXIT_FAILURE);
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(body_16k); i++)
+        body_16k[i] = 'a' + i % 26;
+
+    HTTPServerResult res = http_server_new();
+    if (!res.Ok) {
+        fprintf(stderr, "%s\n", res.Err);
+        return EXIT_FAILURE;
+    }
+    http_server *server = res.Value;
+    ErrorMessage err = http_server_SetWorkers(server, workers);
+    if (!err)
+        err = http_server_SetBackend(server, backend);
+    if (!err)
+        err = http_server_AddRoute(server, "GET", "/plaintext", handle_plaintext, NULL);
+    if (!err)
+        err = http_server_AddRoute(server, "GET", "/users/:id", handle_param, NULL);
+    if (!err)
+        err = http_server_AddRoute(server, "GET", "/16k", handle_16k, NULL);
+    if (!err && metrics)
+        err = http_server_EnableMetrics(server, NULL);
+    if (err) {
+        fprintf(stderr, "%s\n", err);
+        http_server_delete(server);
+        return EXIT_FAILURE;
+    }
+
+    bench_server_listener listener = { .server = server, .port = bench_server_freePort() };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, bench_server_listen, &listener) != 0) {
+        fprintf(stderr, "Failed to start server thread\n");
+        http_server_delete(server);
+        return EXIT_FAILURE;
+    }
+    if (!bench_server_waitReady(listener.port)) {
+        fprintf(stderr, "Server did not start listening\n");
+        http_server_stop(server);
+        pthread_join(thread, NULL);
+        http_server_delete(server);
+        return EXIT_FAILURE;
+    }
+    options.port = listener.port;
+
+    loadgen_printHeader(json);
+    double reached = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]) && !err; i++) {
+        const bench_server_case *c = &cases[i];
+        if (filter && !strstr(c->name, filter))
+            continue;
+
+        options.path = c->path;
+        options.keep_alive = c->keep_alive;
+        options.rate = 0;
+        if (c->fixed_rate)
+            options.rate = rate > 0 ? rate : reached > 0 ? reached / 2 : 10000;
+
+        loadgen_result result;
+        err = loadgen_run(&options, &result);
+        if (err)
+            break;
+        if (reached == 0)
+            reached = result.requests / (result.elapsed_ns / 1e9);
+
+        char name[64];
+        if (c->fixed_rate)
+            snprintf(name, sizeof(name), "server/%s@%.0f", c->name, options.rate);
+        else
+            snprintf(name, sizeof(name), "server/%s", c->name);
+        loadgen_report(name, &result, json);
+    }
+
+    http_server_stop(server);
+    pthread_join(thread, NULL);
+    if (!err)
+        err = listener.err;
+    http_server_delete(server);
+
+    if (err) {
+        fprintf(stderr, "%s\n", err);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,662 @@
+#include "loadgen.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOADGEN_MAX_EVENTS      256
+#define LOADGEN_READ_SIZE       (64 * 1024)
+// Pause before a closed loop connection retries after an error
+#define LOADGEN_RETRY_NS        (1000 * 1000)
+
+typedef enum loadgen_state {
+    // Waiting for next_ns
+    LOADGEN_IDLE,
+    LOADGEN_CONNECTING,
+    LOADGEN_SENDING,
+    LOADGEN_RECEIVING,
+} loadgen_state;
+
+typedef enum loadgen_body {
+    LOADGEN_BODY_HEAD,
+    LOADGEN_BODY_LENGTH,
+    LOADGEN_BODY_CHUNK_SIZE,
+    LOADGEN_BODY_CHUNK_DATA,
+    LOADGEN_BODY_TRAILER,
+    LOADGEN_BODY_UNTIL_CLOSE,
+} loadgen_body;
+
+typedef struct loadgen_connection {
+    int                 fd;
+    loadgen_state       state;
+    size_t              sent;
+    // Latency is measured from here, when the request was due
+    uint64_t            start_ns;
+    // When the next request is due, or may retry after an error
+    uint64_t            next_ns;
+
+    loadgen_body        body;
+    int                 status;
+    bool                close_after;
+    uint64_t            remaining;
+    // Chunk size being read, or length of the trailer line
+    uint64_t            chunk_size;
+    bool                chunk_ext;
+    size_t              head_length;
+    char                head[LOADGEN_MAX_HEAD];
+} loadgen_connection;
+
+typedef struct loadgen_thread {
+    const loadgen_options* options;
+    struct sockaddr_in  address;
+    const char*         request;
+    size_t              request_length;
+    // Interval between two requests of one connection, open loop only
+    uint64_t            interval_ns;
+    uint64_t            measure_ns;
+    uint64_t            end_ns;
+
+    loadgen_connection* connections;
+    size_t              connection_count;
+    // Index of the first connection among all threads, for staggering
+    size_t              first;
+    int                 epoll_fd;
+    int                 timer_fd;
+    pthread_t           thread;
+    ErrorMessage        err;
+    loadgen_result      result;
+} loadgen_thread;
+
+static uint64_t loadgen_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static size_t loadgen_bucketOf(uint64_t value) {
+    if (value < LOADGEN_SUB_BUCKETS)
+        return value;
+    unsigned top = 63 - __builtin_clzll(value);
+    size_t sub = (value >> (top - LOADGEN_SUB_BITS)) & (LOADGEN_SUB_BUCKETS - 1);
+    return (top - LOADGEN_SUB_BITS + 1) * LOADGEN_SUB_BUCKETS + sub;
+}
+
+// Middle of the values the bucket holds
+static uint64_t loadgen_bucketValue(size_t bucket) {
+    if (bucket < LOADGEN_SUB_BUCKETS)
+        return bucket;
+    unsigned shift = bucket / LOADGEN_SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(LOADGEN_SUB_BUCKETS + bucket % LOADGEN_SUB_BUCKETS) << shift;
+    return low + ((1ull << shift) >> 1);
+}
+
+void loadgen_histogram_record(loadgen_histogram *this, uint64_t value) {
+    this->buckets[loadgen_bucketOf(value)]++;
+    this->count++;
+    if (value > this->max)
+        this->max = value;
+}
+
+void loadgen_histogram_merge(loadgen_histogram *this, const loadgen_histogram *other) {
+    for (size_t i = 0; i < LOADGEN_BUCKETS; i++)
+        this->buckets[i] += other->buckets[i];
+    this->count += other->count;
+    if (other->max > this->max)
+        this->max = other->max;
+}
+
+uint64_t loadgen_histogram_percentile(const loadgen_histogram *this, double percentile) {
+    if (this->count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100 * this->count + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LOADGEN_BUCKETS; i++) {
+        seen += this->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = loadgen_bucketValue(i);
+            return value < this->max ? value : this->max;
+        }
+    }
+    return this->max;
+}
+
+static bool loadgen_inWindow(const loadgen_thread *this, uint64_t now) {
+    return now >= this->measure_ns && now < this->end_ns;
+}
+
+static void loadgen_close(loadgen_thread *this, loadgen_connection *conn) {
+    if (conn->fd < 0)
+        return;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+}
+
+static bool loadgen_connect(loadgen_thread *this, loadgen_connection *conn) {
+    conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn->fd < 0)
+        return false;
+
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLOUT | EPOLLET,
+        .data.ptr = conn,
+    };
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, conn->fd, &event) < 0) {
+        close(conn->fd);
+        conn->fd = -1;
+        return false;
+    }
+
+    if (connect(conn->fd, (struct sockaddr *)&this->address, sizeof(this->address)) < 0 &&
+        errno != EINPROGRESS) {
+        loadgen_close(this, conn);
+        return false;
+    }
+    conn->state = LOADGEN_CONNECTING;
+    return true;
+}
+
+static void loadgen_fail(loadgen_thread *this, loadgen_connection *conn, uint64_t now);
+
+/**
+ * Starts the request due at start, connecting first if needed
+ */
+static void loadgen_begin(loadgen_thread *this, loadgen_connection *conn, uint64_t start) {
+    conn->start_ns = start;
+    conn->sent = 0;
+    conn->body = LOADGEN_BODY_HEAD;
+    conn->head_length = 0;
+    conn->close_after = !this->options->keep_alive;
+
+    if (conn->fd >= 0) {
+        conn->state = LOADGEN_SENDING;
+    } else if (!loadgen_connect(this, conn)) {
+        loadgen_fail(this, conn, loadgen_now());
+    }
+}
+
+/**
+ * Moves on to the next request once one finished. Closed loop sends it
+ * right away, open loop when it is due.
+ */
+static void loadgen_next(loadgen_thread *this, loadgen_connection *conn, uint64_t now) {
+    if (conn->close_after)
+        loadgen_close(this, conn);
+    conn->state = LOADGEN_IDLE;
+    if (now >= this->end_ns)
+        return;
+
+    if (!this->interval_ns) {
+        loadgen_begin(this, conn, now);
+        return;
+    }
+
+    conn->next_ns += this->interval_ns;
+    if (conn->next_ns <= now)
+        loadgen_begin(this, conn, conn->next_ns);
+}
+
+/**
+ * Drops the connection. The next request waits for the timer rather
+ * than starting here, so a server refusing connections cannot make
+ * begin and fail recurse.
+ */
+static void loadgen_fail(loadgen_thread *this, loadgen_connection *conn, uint64_t now) {
+    if (loadgen_inWindow(this, now))
+        this->result.errors++;
+    loadgen_close(this, conn);
+    conn->state = LOADGEN_IDLE;
+    conn->next_ns = this->interval_ns ? conn->next_ns + this->interval_ns
+                                      : now + LOADGEN_RETRY_NS;
+}
+
+static void loadgen_complete(loadgen_thread *this, loadgen_connection *conn, uint64_t now) {
+    if (loadgen_inWindow(this, now)) {
+        this->result.requests++;
+        if (conn->status < 200 || conn->status > 299)
+            this->result.non_2xx++;
+        loadgen_histogram_record(&this->result.latency, now - conn->start_ns);
+    }
+    loadgen_next(this, conn, now);
+}
+
+/**
+ * Reads status, framing and Connection: close out of the response head
+ *
+ * @returns false if the head is malformed
+ */
+static bool loadgen_parseHead(loadgen_connection *conn, size_t length) {
+    const char *head = conn->head;
+    if (length < 12 || strncmp(head, "HTTP/1.", 7) != 0)
+        return false;
+    conn->status = atoi(head + 9);
+
+    bool chunked = false, has_length = false;
+    const char *line = memchr(head, '\n', length) + 1;
+    const char *end = head + length;
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        if (!eol)
+            break;
+        const char *value = memchr(line, ':', eol - line);
+        if (value) {
+            size_t key_length = value - line;
+            do
+                value++;
+            while (*value == ' ' || *value == '\t');
+
+            if (key_length == 14 && strncasecmp(line, "content-length", 14) == 0) {
+                conn->remaining = strtoull(value, NULL, 10);
+                has_length = true;
+            } else if (key_length == 17 && strncasecmp(line, "transfer-encoding", 17) == 0) {
+                chunked = strncasecmp(value, "chunked", 7) == 0;
+            } else if (key_length == 10 && strncasecmp(line, "connection", 10) == 0) {
+                if (strncasecmp(value, "close", 5) == 0)
+                    conn->close_after = true;
+            }
+        }
+        line = eol + 1;
+    }
+
+    if (conn->status == 204 || conn->status == 304 || conn->status / 100 == 1) {
+        conn->remaining = 0;
+        conn->body = LOADGEN_BODY_LENGTH;
+    } else if (chunked) {
+        conn->chunk_size = 0;
+        conn->chunk_ext = false;
+        conn->body = LOADGEN_BODY_CHUNK_SIZE;
+    } else if (has_length) {
+        conn->body = LOADGEN_BODY_LENGTH;
+    } else {
+        conn->close_after = true;
+        conn->body = LOADGEN_BODY_UNTIL_CLOSE;
+    }
+    return true;
+}
+
+static int loadgen_hex(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Walks len bytes of response, skipping the body without keeping it
+ *
+ * @returns 1 once the response is complete, 0 if more is needed and -1
+ *          if it is malformed
+ */
+static int loadgen_consume(loadgen_connection *conn, const char *data, size_t len) {
+    if (conn->body == LOADGEN_BODY_HEAD) {
+        size_t old = conn->head_length;
+        size_t take = LOADGEN_MAX_HEAD - old < len ? LOADGEN_MAX_HEAD - old : len;
+        memcpy(conn->head + old, data, take);
+        conn->head_length += take;
+
+        size_t from = old > 3 ? old - 3 : 0;
+        const char *end = memmem(conn->head + from, conn->head_length - from, "\r\n\r\n", 4);
+        if (!end)
+            return conn->head_length == LOADGEN_MAX_HEAD ? -1 : 0;
+
+        size_t head_length = end + 4 - conn->head;
+        if (!loadgen_parseHead(conn, head_length))
+            return -1;
+        data += head_length - old;
+        len -= head_length - old;
+    }
+
+    while (true) {
+        switch (conn->body) {
+        case LOADGEN_BODY_HEAD:
+            return -1;
+        case LOADGEN_BODY_UNTIL_CLOSE:
+            return 0;
+        case LOADGEN_BODY_LENGTH: {
+            size_t take = conn->remaining < len ? conn->remaining : len;
+            conn->remaining -= take;
+            return conn->remaining == 0 ? 1 : 0;
+        }
+        case LOADGEN_BODY_CHUNK_DATA: {
+            // Data and its CRLF
+            size_t take = conn->remaining < len ? conn->remaining : len;
+            conn->remaining -= take;
+            data += take;
+            len -= take;
+            if (conn->remaining > 0)
+                return 0;
+            conn->chunk_size = 0;
+            conn->chunk_ext = false;
+            conn->body = LOADGEN_BODY_CHUNK_SIZE;
+            break;
+        }
+        case LOADGEN_BODY_CHUNK_SIZE:
+            for (; len > 0; data++, len--) {
+                if (*data == '\n')
+                    break;
+                if (*data == ';')
+                    conn->chunk_ext = true;
+                int digit = loadgen_hex(*data);
+                if (!conn->chunk_ext && digit >= 0)
+                    conn->chunk_size = conn->chunk_size * 16 + digit;
+            }
+            if (len == 0)
+                return 0;
+            data++;
+            len--;
+            if (conn->chunk_size == 0) {
+                conn->body = LOADGEN_BODY_TRAILER;
+            } else {
+                conn->remaining = conn->chunk_size + 2;
+                conn->body = LOADGEN_BODY_CHUNK_DATA;
+            }
+            break;
+        case LOADGEN_BODY_TRAILER:
+            // chunk_size counts the bytes of the current trailer line
+            for (; len > 0; data++, len--) {
+                if (*data == '\n') {
+                    if (conn->chunk_size == 0)
+                        return 1;
+                    conn->chunk_size = 0;
+                } else if (*data != '\r') {
+                    conn->chunk_size++;
+                }
+            }
+            return 0;
+        }
+    }
+}
+
+/**
+ * Advances conn as far as its socket allows
+ */
+static void loadgen_drive(loadgen_thread *this, loadgen_connection *conn, uint32_t events) {
+    static thread_local char buffer[LOADGEN_READ_SIZE];
+
+    while (true) {
+        switch (conn->state) {
+        case LOADGEN_IDLE:
+            return;
+
+        case LOADGEN_CONNECTING: {
+            if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+                return;
+            int err = 0;
+            socklen_t err_len = sizeof(err);
+            getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+            if (err) {
+                loadgen_fail(this, conn, loadgen_now());
+                return;
+            }
+            conn->state = LOADGEN_SENDING;
+            break;
+        }
+
+        case LOADGEN_SENDING: {
+            ssize_t n = send(conn->fd, this->request + conn->sent,
+                             this->request_length - conn->sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN)
+                    return;
+                loadgen_fail(this, conn, loadgen_now());
+                return;
+            }
+            conn->sent += n;
+            if (conn->sent == this->request_length)
+                conn->state = LOADGEN_RECEIVING;
+            break;
+        }
+
+        case LOADGEN_RECEIVING: {
+            ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+            uint64_t now = loadgen_now();
+            if (n < 0 && errno == EAGAIN)
+                return;
+            if (n == 0 && conn->body == LOADGEN_BODY_UNTIL_CLOSE) {
+                loadgen_complete(this, conn, now);
+                events = 0;
+                break;
+            }
+            if (n <= 0) {
+                loadgen_fail(this, conn, now);
+                return;
+            }
+
+            if (loadgen_inWindow(this, now))
+                this->result.bytes_read += n;
+            int done = loadgen_consume(conn, buffer, n);
+            if (done < 0) {
+                loadgen_fail(this, conn, now);
+                return;
+            }
+            if (done > 0) {
+                // A new connection waits for its own writable event
+                loadgen_complete(this, conn, now);
+                events = 0;
+            }
+            break;
+        }
+        }
+    }
+}
+
+/**
+ * Arms the timer for the earliest scheduled request or the end of the
+ * run, whichever comes first
+ */
+static void loadgen_armTimer(loadgen_thread *this, uint64_t now) {
+    uint64_t due = this->end_ns;
+    for (size_t i = 0; i < this->connection_count; i++) {
+        loadgen_connection *conn = &this->connections[i];
+        if (conn->state == LOADGEN_IDLE && conn->next_ns < due)
+            due = conn->next_ns;
+    }
+    if (due <= now)
+        due = now + 1;
+
+    struct itimerspec spec = {
+        .it_value = { .tv_sec = due / 1000000000u, .tv_nsec = due % 1000000000u },
+    };
+    timerfd_settime(this->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+static void loadgen_startDue(loadgen_thread *this, uint64_t now) {
+    for (size_t i = 0; i < this->connection_count; i++) {
+        loadgen_connection *conn = &this->connections[i];
+        if (conn->state == LOADGEN_IDLE && conn->next_ns <= now) {
+            loadgen_begin(this, conn, this->interval_ns ? conn->next_ns : now);
+            loadgen_drive(this, conn, 0);
+        }
+    }
+}
+
+static void *loadgen_thread_main(void *arg) {
+    loadgen_thread *this = arg;
+    struct epoll_event events[LOADGEN_MAX_EVENTS];
+
+    uint64_t start = loadgen_now();
+    this->measure_ns = start + this->options->warmup_ns;
+    this->end_ns = this->measure_ns + this->options->duration_ns;
+
+    size_t total = this->options->connections;
+    for (size_t i = 0; i < this->connection_count; i++) {
+        loadgen_connection *conn = &this->connections[i];
+        conn->fd = -1;
+        conn->state = LOADGEN_IDLE;
+        // Spread the connections' schedules evenly over one interval
+        conn->next_ns = start + this->interval_ns * (this->first + i) / total;
+    }
+
+    struct epoll_event timer = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->timer_fd, &timer);
+
+    uint64_t now = loadgen_now();
+    while (now < this->end_ns) {
+        loadgen_startDue(this, now);
+        loadgen_armTimer(this, now);
+
+        int n = epoll_wait(this->epoll_fd, events, LOADGEN_MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) {
+            this->err = "epoll_wait failed";
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (!events[i].data.ptr) {
+                uint64_t expirations;
+                ssize_t r = read(this->timer_fd, &expirations, sizeof(expirations));
+                (void)r;
+                continue;
+            }
+            loadgen_drive(this, events[i].data.ptr, events[i].events);
+        }
+        now = loadgen_now();
+    }
+
+    for (size_t i = 0; i < this->connection_count; i++)
+        loadgen_close(this, &this->connections[i]);
+    return NULL;
+}
+
+static char *loadgen_buildRequest(const loadgen_options *options, size_t *len) {
+    const char *format = "GET %s HTTP/1.1\r\nHost: %s:%u\r\n%s\r\n";
+    const char *connection = options->keep_alive ? "" : "Connection: close\r\n";
+    int length = snprintf(NULL, 0, format, options->path, options->host, options->port,
+                          connection);
+    char *request = malloc(length + 1);
+    if (request)
+        snprintf(request, length + 1, format, options->path, options->host, options->port,
+                 connection);
+    *len = length;
+    return request;
+}
+
+ErrorMessage loadgen_run(const loadgen_options *options, loadgen_result *result) {
+    if (!options || !result)
+        return "Options or result is null";
+    if (options->threads == 0 || options->connections < options->threads)
+        return "Need at least one thread and one connection per thread";
+
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons(options->port) };
+    if (inet_pton(AF_INET, options->host, &address.sin_addr) != 1)
+        return "Host must be an IPv4 address";
+
+    size_t request_length;
+    char *request = loadgen_buildRequest(options, &request_length);
+    loadgen_thread *threads = calloc(options->threads, sizeof(loadgen_thread));
+    loadgen_connection *connections = calloc(options->connections, sizeof(loadgen_connection));
+    if (!request || !threads || !connections) {
+        free(request);
+        free(threads);
+        free(connections);
+        return "Failed to allocate memory";
+    }
+
+    uint64_t interval = options->rate > 0
+                            ? (uint64_t)(1e9 * options->connections / options->rate)
+                            : 0;
+    ErrorMessage err = NULL;
+    size_t started = 0, first = 0;
+    for (; started < options->threads; started++) {
+        loadgen_thread *thread = &threads[started];
+        size_t count = options->connections / options->threads +
+                       (started < options->connections % options->threads);
+        *thread = (loadgen_thread){
+            .options = options,
+            .address = address,
+            .request = request,
+            .request_length = request_length,
+            .interval_ns = interval,
+            .connections = connections + first,
+            .connection_count = count,
+            .first = first,
+            .epoll_fd = epoll_create1(EPOLL_CLOEXEC),
+            .timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC),
+        };
+        first += count;
+
+        if (thread->epoll_fd < 0 || thread->timer_fd < 0 ||
+            pthread_create(&thread->thread, NULL, loadgen_thread_main, thread) != 0) {
+            err = "Failed to start load thread";
+            break;
+        }
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->elapsed_ns = options->duration_ns;
+    for (size_t i = 0; i < options->threads; i++) {
+        loadgen_thread *thread = &threads[i];
+        if (i < started) {
+            pthread_join(thread->thread, NULL);
+            if (!err)
+                err = thread->err;
+            result->requests += thread->result.requests;
+            result->non_2xx += thread->result.non_2xx;
+            result->errors += thread->result.errors;
+            result->bytes_read += thread->result.bytes_read;
+            loadgen_histogram_merge(&result->latency, &thread->result.latency);
+        }
+        if (thread->epoll_fd > 0)
+            close(thread->epoll_fd);
+        if (thread->timer_fd > 0)
+            close(thread->timer_fd);
+    }
+
+    free(request);
+    free(threads);
+    free(connections);
+    return err;
+}
+
+void loadgen_printHeader(bool json) {
+    if (!json)
+        printf("%-32s %10s %9s %9s %9s %9s %9s %9s %8s\n", "case", "req/s", "MB/s",
+               "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "errors");
+}
+
+void loadgen_report(const char *name, const loadgen_result *result, bool json) {
+    double seconds = result->elapsed_ns / 1e9;
+    double rate = seconds > 0 ? result->requests / seconds : 0;
+    double bytes = seconds > 0 ? result->bytes_read / seconds : 0;
+    const loadgen_histogram *latency = &result->latency;
+
+    if (json) {
+        printf("{\"case\":\"%s\",\"requests\":%" PRIu64 ",\"requests_per_s\":%.1f,"
+               "\"bytes_per_s\":%.0f,\"errors\":%" PRIu64 ",\"non_2xx\":%" PRIu64 ","
+               "\"latency_ns\":{\"p50\":%" PRIu64 ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64
+               ",\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "}}\n",
+               name, result->requests, rate, bytes, result->errors, result->non_2xx,
+               loadgen_histogram_percentile(latency, 50),
+               loadgen_histogram_percentile(latency, 90),
+               loadgen_histogram_percentile(latency, 99),
+               loadgen_histogram_percentile(latency, 99.9), latency->max);
+    } else {
+        printf("%-32s %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %8" PRIu64 "\n", name, rate,
+               bytes / 1e6, loadgen_histogram_percentile(latency, 50) / 1e3,
+               loadgen_histogram_percentile(latency, 90) / 1e3,
+               loadgen_histogram_percentile(latency, 99) / 1e3,
+               loadgen_histogram_percentile(latency, 99.9) / 1e3, latency->max / 1e3,
+               result->errors + result->non_2xx);
+    }
+    fflush(stdout);
+}
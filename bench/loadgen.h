@@ -0,0 +1,107 @@
+#pragma once
+
+#include "http/results.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Log-linear buckets, 2^LOADGEN_SUB_BITS per power of two, so each
+// recorded latency is within about 3% of its bucket
+#define LOADGEN_SUB_BITS        5
+#define LOADGEN_SUB_BUCKETS     (1u << LOADGEN_SUB_BITS)
+#define LOADGEN_BUCKETS         ((64 - LOADGEN_SUB_BITS + 1) * LOADGEN_SUB_BUCKETS)
+
+// Largest response head the generator parses
+#define LOADGEN_MAX_HEAD        (16 * 1024)
+
+typedef struct loadgen_options {
+    // IPv4 address, e.g. "127.0.0.1"
+    const char*         host;
+    uint16_t            port;
+    const char*         path;
+    size_t              threads;
+    // Concurrent connections over all threads
+    size_t              connections;
+    // Measured time, after warmup
+    uint64_t            duration_ns;
+    // Time spent loading the server before anything is recorded
+    uint64_t            warmup_ns;
+    // Requests per second over all connections, 0 for closed loop
+    double              rate;
+    // New connection per request when false
+    bool                keep_alive;
+} loadgen_options;
+
+typedef struct loadgen_histogram {
+    uint64_t            count;
+    uint64_t            max;
+    uint64_t            buckets[LOADGEN_BUCKETS];
+} loadgen_histogram;
+
+typedef struct loadgen_result {
+    // Responses completed in the measured window
+    uint64_t            requests;
+    uint64_t            non_2xx;
+    // Failed connects, resets and malformed responses
+    uint64_t            errors;
+    uint64_t            bytes_read;
+    uint64_t            elapsed_ns;
+    loadgen_histogram   latency;
+} loadgen_result;
+
+/**
+ * Records value, in nanoseconds
+ */
+void            loadgen_histogram_record(loadgen_histogram *this, uint64_t value);
+
+/**
+ * Adds every value recorded in other to this
+ */
+void            loadgen_histogram_merge(loadgen_histogram *this, const loadgen_histogram *other);
+
+/**
+ * Value below which percentile percent of the recorded values fall
+ *
+ * @param this          Histogram
+ * @param percentile    0 to 100
+ *
+ * @returns Nanoseconds, 0 if nothing was recorded
+ */
+uint64_t        loadgen_histogram_percentile(const loadgen_histogram *this, double percentile);
+
+/**
+ * Loads the server at host:port with GET requests for path, then
+ * returns once warmup and duration have passed.
+ *
+ * Without a rate every connection sends its next request as soon as the
+ * previous response is in (closed loop). With one, connection i of n
+ * sends on a fixed schedule of rate / n requests per second, and
+ * latency is counted from when a request was due rather than when it
+ * could be sent, so a stalled server is not hidden by the generator
+ * waiting on it (coordinated omission).
+ *
+ * Without keep-alive every request opens a new connection, which is
+ * counted in its latency.
+ *
+ * @param options   What to run
+ * @param result    Filled with the totals of every thread
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage    loadgen_run(const loadgen_options *options, loadgen_result *result);
+
+/**
+ * Prints the header of the table loadgen_report prints rows of, nothing
+ * for JSON
+ */
+void            loadgen_printHeader(bool json);
+
+/**
+ * Prints requests per second, throughput and latency percentiles of a
+ * run, as one table row or one JSON object
+ *
+ * @param name      Case name
+ * @param result    Result of loadgen_run
+ * @param json      Print JSON instead of a table row
+ */
+void            loadgen_report(const char *name, const loadgen_result *result, bool json);
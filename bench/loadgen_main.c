@@ -0,0 +1,86 @@
+#include "loadgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage(const char *name, int status) {
+    fprintf(status ? stderr : stdout,
+            "usage: %s [options] <host>:<port>[/path]\n"
+            "  -t <threads>      load threads (2)\n"
+            "  -c <connections>  concurrent connections (64)\n"
+            "  -d <seconds>      measured duration (10)\n"
+            "  -w <seconds>      warmup before measuring (1)\n"
+            "  -R <requests/s>   fixed request rate, closed loop when omitted\n"
+            "  --close           new connection per request\n"
+            "  --json            print one JSON object\n",
+            name);
+    exit(status);
+}
+
+int main(int argc, char **argv) {
+    loadgen_options options = {
+        .path = "/",
+        .threads = 2,
+        .connections = 64,
+        .duration_ns = 10 * 1000000000ull,
+        .warmup_ns = 1000000000ull,
+        .keep_alive = true,
+    };
+    bool json = false;
+    char *target = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(arg, "-t") == 0 && has_value) {
+            options.threads = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "-c") == 0 && has_value) {
+            options.connections = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "-d") == 0 && has_value) {
+            options.duration_ns = strtod(argv[++i], NULL) * 1e9;
+        } else if (strcmp(arg, "-w") == 0 && has_value) {
+            options.warmup_ns = strtod(argv[++i], NULL) * 1e9;
+        } else if (strcmp(arg, "-R") == 0 && has_value) {
+            options.rate = strtod(argv[++i], NULL);
+        } else if (strcmp(arg, "--close") == 0) {
+            options.keep_alive = false;
+        } else if (strcmp(arg, "--json") == 0) {
+            json = true;
+        } else if (strcmp(arg, "--help") == 0) {
+            usage(argv[0], EXIT_SUCCESS);
+        } else if (arg[0] != '-' && !target) {
+            target = argv[i];
+        } else {
+            usage(argv[0], EXIT_FAILURE);
+        }
+    }
+    if (!target)
+        usage(argv[0], EXIT_FAILURE);
+
+    if (strncmp(target, "http://", 7) == 0)
+        target += 7;
+    char *path = strchr(target, '/');
+    char *port = strchr(target, ':');
+    if (!port || (path && port > path))
+        usage(argv[0], EXIT_FAILURE);
+    options.port = strtoul(port + 1, NULL, 10);
+    // Copy the path out before cutting the host off in place
+    char *path_copy = strdup(path ? path : "/");
+    *port = '\0';
+    options.host = target;
+    options.path = path_copy;
+
+    loadgen_result result;
+    ErrorMessage err = loadgen_run(&options, &result);
+    if (err) {
+        fprintf(stderr, "%s\n", err);
+        free(path_copy);
+        return EXIT_FAILURE;
+    }
+
+    loadgen_printHeader(json);
+    loadgen_report(options.path, &result, json);
+    free(path_copy);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "results.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Where the library gets its memory from. Defaults to the C library.
+ * sds strings are built by the sds dependency and always use it.
+ */
+typedef struct http_allocator {
+    // size bytes aligned to alignment, a power of two, NULL when out
+    // of memory
+    void*       (*alloc)(size_t size, size_t alignment, void *ctx);
+    // Like realloc(3), only for memory from alloc with the default
+    // alignment
+    void*       (*realloc)(void *ptr, size_t size, void *ctx);
+    void        (*free)(void *ptr, void *ctx);
+    // Usable size of ptr, may be NULL, bytes are not counted then
+    size_t      (*size)(const void *ptr, void *ctx);
+    void*       ctx;
+} http_allocator;
+
+/**
+ * Allocations made through the library by one thread while counting
+ */
+typedef struct http_alloc_stats {
+    uint64_t    allocs;
+    uint64_t    frees;
+    // Usable bytes, as told by http_allocator.size
+    uint64_t    bytes_allocated;
+    uint64_t    bytes_freed;
+    // Highest bytes_allocated - bytes_freed reached
+    uint64_t    peak;
+} http_alloc_stats;
+
+/**
+ * Replaces the allocator of the library. Memory is freed by the
+ * allocator that returned it, so this must be called before anything
+ * is created or after everything is deleted.
+ *
+ * @param allocator Copied, NULL restores the C library
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_allocator_Set(const http_allocator *allocator);
+
+/**
+ * Turns counting of allocations on or off for every thread. Off by
+ * default, it costs a thread-local update per call when on.
+ *
+ * @param enabled   Whether to count
+ */
+void                http_allocator_SetCounting(bool enabled);
+
+/**
+ * Counts of the calling thread since it started or last reset. Memory
+ * freed by another thread than the one that got it counts as a free of
+ * the freeing thread.
+ *
+ * @returns Counts
+ */
+http_alloc_stats    http_allocator_Stats(void);
+
+/**
+ * Zeroes the counts of the calling thread
+ */
+void                http_allocator_ResetStats(void);
+
+/**
+ * Allocates size bytes with the library's allocator
+ *
+ * @returns Pointer or NULL when out of memory
+ */
+void*               http_malloc(size_t size);
+
+/**
+ * Allocates count zeroed elements of size bytes
+ *
+ * @returns Pointer or NULL when out of memory or on overflow
+ */
+void*               http_calloc(size_t count, size_t size);
+
+/**
+ * Allocates size bytes aligned to alignment, a power of two. Such
+ * memory can't be passed to http_realloc.
+ *
+ * @returns Pointer or NULL when out of memory
+ */
+void*               http_alignedAlloc(size_t alignment, size_t size);
+
+/**
+ * Resizes memory from http_malloc or http_calloc, see realloc(3)
+ *
+ * @returns Pointer or NULL when out of memory, ptr is left alone then
+ */
+void*               http_realloc(void *ptr, size_t size);
+
+/**
+ * Frees memory from the library, including arrays it hands out such as
+ * the one of http_request_HeaderKeys. NULL is ignored.
+ */
+void                http_free(void *ptr);
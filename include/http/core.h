@@ -1,6 +1,7 @@
 #pragma once
 
 // Core HTTP components
+#include "alloc.h"
 #include "server.h"
 #include "request.h"
 #include "response.h"
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Standard header names recognized while parsing. The first
+ * HTTP_HEADER_HOT_COUNT ids are the ones the server itself reads,
+ * every request keeps a dedicated slot for each of them.
+ */
+typedef enum http_header_id {
+    HTTP_HEADER_UNKNOWN = 0,
+    HTTP_HEADER_HOST,
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_CONTENT_TYPE,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_ACCEPT_ENCODING,
+    HTTP_HEADER_EXPECT,
+    HTTP_HEADER_UPGRADE,
+
+    HTTP_HEADER_ACCEPT,
+    HTTP_HEADER_ACCEPT_CHARSET,
+    HTTP_HEADER_ACCEPT_LANGUAGE,
+    HTTP_HEADER_ACCEPT_RANGES,
+    HTTP_HEADER_ACCESS_CONTROL_ALLOW_CREDENTIALS,
+    HTTP_HEADER_ACCESS_CONTROL_ALLOW_HEADERS,
+    HTTP_HEADER_ACCESS_CONTROL_ALLOW_METHODS,
+    HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+    HTTP_HEADER_ACCESS_CONTROL_EXPOSE_HEADERS,
+    HTTP_HEADER_ACCESS_CONTROL_MAX_AGE,
+    HTTP_HEADER_ACCESS_CONTROL_REQUEST_HEADERS,
+    HTTP_HEADER_ACCESS_CONTROL_REQUEST_METHOD,
+    HTTP_HEADER_AGE,
+    HTTP_HEADER_ALLOW,
+    HTTP_HEADER_AUTHORIZATION,
+    HTTP_HEADER_CACHE_CONTROL,
+    HTTP_HEADER_CONTENT_DISPOSITION,
+    HTTP_HEADER_CONTENT_ENCODING,
+    HTTP_HEADER_CONTENT_LANGUAGE,
+    HTTP_HEADER_CONTENT_LOCATION,
+    HTTP_HEADER_CONTENT_RANGE,
+    HTTP_HEADER_COOKIE,
+    HTTP_HEADER_DATE,
+    HTTP_HEADER_DNT,
+    HTTP_HEADER_ETAG,
+    HTTP_HEADER_EXPIRES,
+    HTTP_HEADER_FORWARDED,
+    HTTP_HEADER_FROM,
+    HTTP_HEADER_IF_MATCH,
+    HTTP_HEADER_IF_MODIFIED_SINCE,
+    HTTP_HEADER_IF_NONE_MATCH,
+    HTTP_HEADER_IF_RANGE,
+    HTTP_HEADER_IF_UNMODIFIED_SINCE,
+    HTTP_HEADER_KEEP_ALIVE,
+    HTTP_HEADER_LAST_MODIFIED,
+    HTTP_HEADER_LINK,
+    HTTP_HEADER_LOCATION,
+    HTTP_HEADER_MAX_FORWARDS,
+    HTTP_HEADER_ORIGIN,
+    HTTP_HEADER_PRAGMA,
+    HTTP_HEADER_PROXY_AUTHENTICATE,
+    HTTP_HEADER_PROXY_AUTHORIZATION,
+    HTTP_HEADER_RANGE,
+    HTTP_HEADER_REFERER,
+    HTTP_HEADER_REFRESH,
+    HTTP_HEADER_RETRY_AFTER,
+    HTTP_HEADER_SEC_FETCH_DEST,
+    HTTP_HEADER_SEC_FETCH_MODE,
+    HTTP_HEADER_SEC_FETCH_SITE,
+    HTTP_HEADER_SEC_FETCH_USER,
+    HTTP_HEADER_SERVER,
+    HTTP_HEADER_SET_COOKIE,
+    HTTP_HEADER_STRICT_TRANSPORT_SECURITY,
+    HTTP_HEADER_TE,
+    HTTP_HEADER_TRAILER,
+    HTTP_HEADER_UPGRADE_INSECURE_REQUESTS,
+    HTTP_HEADER_USER_AGENT,
+    HTTP_HEADER_VARY,
+    HTTP_HEADER_VIA,
+    HTTP_HEADER_WWW_AUTHENTICATE,
+    HTTP_HEADER_X_FORWARDED_FOR,
+    HTTP_HEADER_X_FORWARDED_HOST,
+    HTTP_HEADER_X_FORWARDED_PROTO,
+    HTTP_HEADER_X_REQUESTED_WITH,
+
+    HTTP_HEADER_COUNT,
+} http_header_id;
+
+#define HTTP_HEADER_HOT_COUNT 8
+
+/**
+ * Identifies a header name with a perfect hash over the standard names,
+ * one multiply and one string compare regardless of how many there are
+ *
+ * @param name  Header name, any case, need not be NUL terminated
+ * @param len   Length of name
+ *
+ * @returns Header id or HTTP_HEADER_UNKNOWN
+ */
+http_header_id  http_header_lookup(const char *name, size_t len);
+
+/**
+ * @param id    Header id
+ *
+ * @returns Lowercase name of id or NULL for HTTP_HEADER_UNKNOWN
+ */
+const char     *http_header_name(http_header_id id);
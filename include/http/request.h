@@ -1,6 +1,7 @@
 #pragma once
 
 #include "body.h"
+#include "header.h"
 #include "version.h"
 #include "results.h"
 
@@ -14,10 +15,24 @@ DECLARE_RESULT_TYPE(http_request *, HTTPRequestResult);
 
 HTTPRequestResult http_request_new(void);
 
+/**
+ * Switches the request to zero-copy mode. Method, uri, headers and body
+ * are then views into the buffer handed to the parser instead of
+ * copies, and are NUL terminated in place, so the buffer must be
+ * writable and outlive the request. Must be set before parsing.
+ *
+ * @param this      Request
+ * @param zero_copy Whether to borrow the parsed buffer
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage http_request_SetZeroCopy(http_request *this, bool zero_copy);
+
 /**
  * Creates a new http_request from an array of bytes
  * validates basic request format but does not enforce
- * multiple RFC validations
+ * multiple RFC validations. In zero-copy mode data is borrowed,
+ * see http_request_SetZeroCopy
  *
  * @param data  Byte array
  * @param len   Length of byte array
@@ -69,6 +84,17 @@ HTTPVersionResult http_request_Version(http_request *this);
  */
 HTTPBodyResult http_request_Body(http_request *this);
 
+/**
+ * Descriptor of the file holding a body too large to keep in memory,
+ * see http_server_SetBodySpillThreshold. http_request_Body maps the
+ * same bytes. Valid until the handler returns, don't close it.
+ *
+ * @param this Request
+ *
+ * @returns IntResult. Errors if the body is not in a file
+ */
+IntResult http_request_BodyFd(http_request *this);
+
 /**
  * Adds a kv pair to http_request.header
  *
@@ -93,14 +119,24 @@ const char *http_request_HeaderSetValue(http_request *this,
 ConstStringResult http_request_HeaderGetValue(http_request *this,
                                          const char *headerKey);
 
+/**
+ * Retrieves a standard header by id, without hashing its name
+ *
+ * @param this  Request
+ * @param id    Header id
+ *
+ * @returns StringResult. Must unwrap to get value string, NULL if absent
+ */
+ConstStringResult http_request_HeaderGetKnown(http_request *this, http_header_id id);
+
 /**
  * Get an array with all the header keys in the http_request
  *
  * @param this          Request
  * @param keys_length   size_t address to store length of keys array
  *
- * @returns StringArrResult. Must unwrap to get key array. Must free arr after
- * use
+ * @returns StringArrResult. Must unwrap to get key array. Must free arr with
+ * http_free after use
  */
 ConstStringArrResult http_request_HeaderKeys(http_request *this, size_t *keys_length);
 
@@ -114,6 +150,30 @@ ConstStringArrResult http_request_HeaderKeys(http_request *this, size_t *keys_le
  */
 BoolResult http_request_HeaderContains(http_request *this, const char *headerKey);
 
+/**
+ * Whether the client wants the connection kept open after this request.
+ * HTTP/1.1 defaults to persistent unless "Connection: close" is sent,
+ * HTTP/1.0 only persists with "Connection: keep-alive".
+ *
+ * @param this  Request
+ *
+ * @returns BoolResult. Must unwrap to get keep-alive flag
+ */
+BoolResult http_request_KeepAlive(http_request *this);
+
+/**
+ * Retrieves a path parameter captured by the router. The value points
+ * into the request uri and is not NUL terminated.
+ *
+ * @param this      Request
+ * @param name      Parameter name without ':' or '*'
+ * @param length    size_t address to store length of the value
+ *
+ * @returns ConstStringResult. Must unwrap to get value, NULL if absent
+ */
+ConstStringResult http_request_Param(http_request *this, const char *name,
+                                     size_t *length);
+
 
 static inline void cleanup_http_request(http_request** p) {
     http_request_delete(*p);
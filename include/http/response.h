@@ -6,11 +6,26 @@
 #include "utils.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 struct response;
 typedef struct http_response http_response;
 
 DECLARE_RESULT_TYPE(http_response*, HTTPResponseResult);
 
+/**
+ * Body producer of a streamed response. Called on the worker whenever
+ * the connection can take more output, until it returns 0, so the body
+ * never has to be held in memory at once.
+ *
+ * @param buf   Where to write the next piece of body
+ * @param cap   Room in buf
+ * @param ctx   Pointer given to http_response_SetBodyProducer
+ *
+ * @returns Bytes written to buf, 0 once the body is complete or -1 to
+ *          abort the response and close the connection
+ */
+typedef ssize_t (*http_body_producer)(void* buf, size_t cap, void* ctx);
+
 HTTPResponseResult      http_response_new(void);
 
 StringResult            http_response_bytes(http_response* this);
@@ -33,8 +48,19 @@ ConstStringArrResult    http_response_HeaderKeys(http_response* this, size_t* ke
 BoolResult              http_response_HeaderContains(http_response* this, const char* headerKey);
 
 ErrorMessage            http_response_SetBody(http_response* this, void* data, size_t length);
+ErrorMessage            http_response_SetBodyFile(http_response* this, const char* path);
 HTTPBodyResult          http_response_GetBody(http_response* this);
 
+/**
+ * Streams the body from producer instead of a buffer. Unless the handler
+ * sets Content-Length the server sends it chunked to HTTP/1.1 clients
+ * and closes the connection after it for HTTP/1.0 ones.
+ * release, if not NULL, is called with ctx once the body is done or the
+ * response is dropped.
+ */
+ErrorMessage            http_response_SetBodyProducer(http_response* this, http_body_producer producer,
+                                                      void* ctx, void (*release)(void* ctx));
+
 static inline void cleanup_http_response(http_response** p) {
     http_response_delete(*p);
 }
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "request.h"
+#include "response.h"
+#include "results.h"
+
+#include <stddef.h>
+
+#define HTTP_ROUTER_MAX_PARAMS 8
+
+typedef struct http_router http_router;
+
+/**
+ * Request handler. Fills res, status defaults to 200 OK and
+ * Content-Length is set from the body if the handler does not set it,
+ * except for 1xx, 204 and 304 responses which must be left without a
+ * body.
+ *
+ * @param req   Request, path parameters available via http_request_Param
+ * @param res   Response to fill
+ * @param ctx   Pointer given when the route was added
+ */
+typedef void (*http_handler)(http_request *req, http_response *res, void *ctx);
+
+/**
+ * Streaming body callback. Receives the request body in order while it
+ * is still arriving, already decoded from chunked transfer coding, and
+ * before the handler runs. The body is not kept, so http_request_Body
+ * is empty in the handler.
+ *
+ * @param req   Request, headers and path parameters are available
+ * @param data  Next piece of body, only valid during the call
+ * @param len   Length of data
+ * @param ctx   Pointer given when the route was added
+ *
+ * @returns false to refuse the rest of the body, the request is then
+ *          answered with 413 and the connection closed
+ */
+typedef bool (*http_body_handler)(http_request *req, const void *data, size_t len,
+                                  void *ctx);
+
+/**
+ * Captured path parameter. Points back into the matched path instead of
+ * owning a copy, name is owned by the router.
+ */
+typedef struct http_route_param {
+    const char*         name;
+    size_t              offset;
+    size_t              length;
+} http_route_param;
+
+typedef enum http_route_status {
+    HTTP_ROUTE_FOUND,
+    HTTP_ROUTE_NOT_FOUND,
+    HTTP_ROUTE_METHOD_NOT_ALLOWED,
+} http_route_status;
+
+typedef struct http_route_match {
+    http_route_status   status;
+    http_handler        handler;
+    // Set for streaming routes
+    http_body_handler   on_body;
+    void*               ctx;
+    // Comma separated methods of the path, set on METHOD_NOT_ALLOWED
+    const char*         allow;
+    size_t              param_count;
+    http_route_param    params[HTTP_ROUTER_MAX_PARAMS];
+} http_route_match;
+
+DECLARE_RESULT_TYPE(http_router *, HTTPRouterResult);
+
+/**
+ * Allocates new empty http_router
+ *
+ * @returns HTTPRouterResult. Must unwrap to get http_router
+ */
+HTTPRouterResult    http_router_new(void);
+
+/**
+ * Registers handler for method and pattern. Patterns start with '/',
+ * a segment starting with ':' captures one path segment and a last
+ * segment starting with '*' captures the rest of the path.
+ * Static segments win over parameters, parameters over wildcards.
+ *
+ * @code
+ * http_router_add(router, "GET", "/users/:id/posts/:post", handler, NULL);
+ * @endcode
+ *
+ * @param this      Router
+ * @param method    Request method, compared exactly
+ * @param pattern   Route pattern
+ * @param handler   Callback for matching requests
+ * @param ctx       Passed to handler untouched
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_router_add(http_router *this, const char *method,
+                                    const char *pattern, http_handler handler,
+                                    void *ctx);
+
+/**
+ * Registers a route whose request body is streamed to on_body as it
+ * arrives instead of being collected, for uploads too large to hold in
+ * memory. Otherwise like http_router_add.
+ *
+ * @param this      Router
+ * @param method    Request method, compared exactly
+ * @param pattern   Route pattern
+ * @param on_body   Called with each piece of body, may be NULL
+ * @param handler   Called once the whole body went to on_body
+ * @param ctx       Passed to both callbacks untouched
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_router_addStreaming(http_router *this, const char *method,
+                                             const char *pattern, http_body_handler on_body,
+                                             http_handler handler, void *ctx);
+
+/**
+ * Looks up the route for method and path in O(path length). Does not
+ * allocate, parameters are returned as offsets into path.
+ *
+ * @param this      Router
+ * @param method    Request method
+ * @param path      Request path, without query string
+ * @param path_len  Length of path
+ * @param match     Filled with the result
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_router_match(const http_router *this, const char *method,
+                                      const char *path, size_t path_len,
+                                      http_route_match *match);
+
+/**
+ * Deletes http_router and every route
+ *
+ * @param this  Router
+ */
+void                http_router_delete(http_router *this);
+
+static inline void cleanup_http_router(http_router **p) {
+    http_router_delete(*p);
+}
@@ -1,6 +1,162 @@
 #pragma once
 
+#include "results.h"
+#include "router.h"
+#include <stddef.h>
+#include <stdint.h>
+
 typedef struct http_server http_server;
 
-http_server* http_server_new();
-void start_and_listen();
+typedef enum http_backend {
+    HTTP_BACKEND_EPOLL,
+    HTTP_BACKEND_IO_URING,
+} http_backend;
+
+DECLARE_RESULT_TYPE(http_server *, HTTPServerResult);
+
+/**
+ * Allocates new http_server
+ * Worker count defaults to the number of online CPUs
+ *
+ * @returns HTTPServerResult. Must unwrap to get http_server
+ */
+HTTPServerResult    http_server_new(void);
+
+/**
+ * Sets how many worker threads to run. Each worker owns its own
+ * SO_REUSEPORT listener and event loop, nothing is shared on the
+ * accept path.
+ *
+ * @param this      Server
+ * @param workers   Number of workers, 0 means number of online CPUs
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_server_SetWorkers(http_server *this, size_t workers);
+
+/**
+ * Selects the I/O backend. HTTP_BACKEND_IO_URING falls back to
+ * HTTP_BACKEND_EPOLL at listen time when the kernel lacks support.
+ *
+ * @param this      Server
+ * @param backend   Backend to use
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_server_SetBackend(http_server *this, http_backend backend);
+
+/**
+ * Sets the request body size past which bodies are kept in an anonymous
+ * file instead of memory. Handlers still see the whole body through
+ * http_request_Body, mapped from the file, and can get the file itself
+ * with http_request_BodyFd. Chunked bodies are collected outside the
+ * read buffer and moved to a file once they pass threshold.
+ * Defaults to 1 MiB.
+ *
+ * @param this      Server
+ * @param threshold Bytes, 0 keeps every body in memory
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_server_SetBodySpillThreshold(http_server *this, size_t threshold);
+
+/**
+ * Routes method and pattern to handler, see http_router_add for the
+ * pattern syntax. Unmatched paths are answered with 404 and paths
+ * without a route for the method with 405.
+ *
+ * @param this      Server
+ * @param method    Request method
+ * @param pattern   Route pattern
+ * @param handler   Callback run on the worker thread
+ * @param ctx       Passed to handler untouched
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_server_AddRoute(http_server *this, const char *method,
+                                         const char *pattern, http_handler handler,
+                                         void *ctx);
+
+/**
+ * Like http_server_AddRoute, but the request body is passed to on_body
+ * piece by piece as it is received and decoded instead of being held
+ * in memory. Reading from the client pauses while on_body runs, so a
+ * slow consumer slows the upload down rather than buffering it.
+ *
+ * @param this      Server
+ * @param method    Request method
+ * @param pattern   Route pattern
+ * @param on_body   Called with each piece of body
+ * @param handler   Called once the body is complete
+ * @param ctx       Passed to both callbacks untouched
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_server_AddStreamingRoute(http_server *this, const char *method,
+                                                  const char *pattern,
+                                                  http_body_handler on_body,
+                                                  http_handler handler, void *ctx);
+
+/**
+ * Turns on metrics: connection, request and byte counters, parse errors
+ * by reason and latency histograms of accepting, reading, parsing,
+ * handling, writing and whole requests. Each worker records its own
+ * without locking and they are added up when read. Off by default,
+ * nothing is timed then.
+ *
+ * @param this  Server
+ * @param path  Route answering GET with http_server_Metrics, NULL for none
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_server_EnableMetrics(http_server *this, const char *path);
+
+/**
+ * Renders metrics in the Prometheus text exposition format. Counters
+ * carry over between listens unless the worker count changes. Call it
+ * from a handler while listening, or from any thread otherwise.
+ *
+ * @param this  Server
+ *
+ * @returns SDSResult. Must free with sdsfree
+ */
+SDSResult           http_server_Metrics(http_server *this);
+
+/**
+ * Port the server is bound to. Useful after listening on port 0.
+ *
+ * @param this  Server
+ *
+ * @returns UInt16Result. Must unwrap to get port
+ */
+UInt16Result        http_server_Port(http_server *this);
+
+/**
+ * Binds every worker to port and runs them until http_server_stop
+ * is called. Blocks the calling thread.
+ *
+ * @param this  Server
+ * @param port  TCP port, 0 picks an ephemeral port
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_server_listen(http_server *this, uint16_t port);
+
+/**
+ * Asks every worker to leave its loop. Safe to call from any thread
+ * or from a signal handler.
+ *
+ * @param this  Server
+ */
+void                http_server_stop(http_server *this);
+
+/**
+ * Deletes http_server. Must not be listening.
+ *
+ * @param this  Server
+ */
+void                http_server_delete(http_server *this);
+
+static inline void cleanup_http_server(http_server **p) {
+    http_server_delete(*p);
+}
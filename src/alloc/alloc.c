@@ -0,0 +1,128 @@
+#include "http/alloc.h"
+
+#include <malloc.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HTTP_ALLOC_DEFAULT_ALIGNMENT alignof(max_align_t)
+
+static void *http_allocator_libcAlloc(size_t size, size_t alignment, void *ctx) {
+    if (alignment <= HTTP_ALLOC_DEFAULT_ALIGNMENT)
+        return malloc(size);
+    // aligned_alloc wants a multiple of alignment
+    return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+}
+
+static void *http_allocator_libcRealloc(void *ptr, size_t size, void *ctx) {
+    return realloc(ptr, size);
+}
+
+static void http_allocator_libcFree(void *ptr, void *ctx) {
+    free(ptr);
+}
+
+static size_t http_allocator_libcSize(const void *ptr, void *ctx) {
+    return malloc_usable_size((void *)ptr);
+}
+
+static const http_allocator http_allocator_libc = {
+    .alloc = http_allocator_libcAlloc,
+    .realloc = http_allocator_libcRealloc,
+    .free = http_allocator_libcFree,
+    .size = http_allocator_libcSize,
+};
+
+// Only changed while nothing is allocated, so read without locking
+static http_allocator allocator = http_allocator_libc;
+static atomic_bool counting;
+static thread_local http_alloc_stats stats;
+
+ErrorMessage http_allocator_Set(const http_allocator *new_allocator) {
+    if (!new_allocator) {
+        allocator = http_allocator_libc;
+        return NULL;
+    }
+    if (!new_allocator->alloc || !new_allocator->realloc || !new_allocator->free)
+        return "Allocator is missing alloc, realloc or free";
+
+    allocator = *new_allocator;
+    return NULL;
+}
+
+void http_allocator_SetCounting(bool enabled) {
+    atomic_store_explicit(&counting, enabled, memory_order_relaxed);
+}
+
+http_alloc_stats http_allocator_Stats(void) {
+    return stats;
+}
+
+void http_allocator_ResetStats(void) {
+    stats = (http_alloc_stats){ 0 };
+}
+
+static bool http_allocator_counting(void) {
+    return atomic_load_explicit(&counting, memory_order_relaxed);
+}
+
+static size_t http_allocator_sizeOf(const void *ptr) {
+    return allocator.size ? allocator.size(ptr, allocator.ctx) : 0;
+}
+
+static void http_allocator_countAlloc(void *ptr) {
+    stats.allocs++;
+    stats.bytes_allocated += http_allocator_sizeOf(ptr);
+    // Frees of memory other threads got can put this below zero
+    if (stats.bytes_allocated > stats.bytes_freed &&
+        stats.bytes_allocated - stats.bytes_freed > stats.peak)
+        stats.peak = stats.bytes_allocated - stats.bytes_freed;
+}
+
+static void http_allocator_countFree(size_t bytes) {
+    stats.frees++;
+    stats.bytes_freed += bytes;
+}
+
+void *http_alignedAlloc(size_t alignment, size_t size) {
+    void *ptr = allocator.alloc(size, alignment, allocator.ctx);
+    if (ptr && http_allocator_counting())
+        http_allocator_countAlloc(ptr);
+    return ptr;
+}
+
+void *http_malloc(size_t size) {
+    return http_alignedAlloc(HTTP_ALLOC_DEFAULT_ALIGNMENT, size);
+}
+
+void *http_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size)
+        return NULL;
+    void *ptr = http_malloc(count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void *http_realloc(void *ptr, size_t size) {
+    if (!ptr)
+        return http_malloc(size);
+
+    bool count = http_allocator_counting();
+    size_t old_size = count ? http_allocator_sizeOf(ptr) : 0;
+    void *new_ptr = allocator.realloc(ptr, size, allocator.ctx);
+    if (new_ptr && count) {
+        http_allocator_countFree(old_size);
+        http_allocator_countAlloc(new_ptr);
+    }
+    return new_ptr;
+}
+
+void http_free(void *ptr) {
+    if (!ptr)
+        return;
+    if (http_allocator_counting())
+        http_allocator_countFree(http_allocator_sizeOf(ptr));
+    allocator.free(ptr, allocator.ctx);
+}
@@ -0,0 +1,103 @@
+#include "arena.h"
+
+#include "http/alloc.h"
+
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HTTP_ARENA_ALIGN alignof(max_align_t)
+
+struct http_arena_block {
+    http_arena_block*       next;
+    size_t                  size;
+    size_t                  used;
+    alignas(max_align_t) char data[];
+};
+
+static size_t http_arena_alignUp(size_t n) {
+    return (n + HTTP_ARENA_ALIGN - 1) & ~(HTTP_ARENA_ALIGN - 1);
+}
+
+static http_arena_block *http_arena_block_new(size_t size) {
+    http_arena_block *block = http_malloc(sizeof(http_arena_block) + size);
+    if (!block)
+        return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void http_arena_init(http_arena *this, size_t block_size) {
+    this->blocks = NULL;
+    this->block_size = block_size ? block_size : HTTP_ARENA_BLOCK_SIZE;
+}
+
+void *http_arena_alloc(http_arena *this, size_t size) {
+    size = http_arena_alignUp(size ? size : 1);
+
+    http_arena_block *block = this->blocks;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = size > this->block_size ? size : this->block_size;
+        block = http_arena_block_new(block_size);
+        if (!block)
+            return NULL;
+        block->next = this->blocks;
+        this->blocks = block;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+char *http_arena_strndup(http_arena *this, const char *s, size_t len) {
+    char *copy = http_arena_alloc(this, len + 1);
+    if (!copy)
+        return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void http_arena_reset(http_arena *this) {
+    http_arena_block *block = this->blocks;
+    if (!block)
+        return;
+
+    if (!block->next) {
+        block->used = 0;
+        return;
+    }
+
+    // Spilled into several blocks, replace them with one that fits
+    // unless it was a one-off peak not worth holding on to
+    size_t total = 0;
+    while (block) {
+        http_arena_block *next = block->next;
+        total += block->size;
+        http_free(block);
+        block = next;
+    }
+    this->blocks = http_arena_block_new(total > HTTP_ARENA_MAX_KEPT ? this->block_size : total);
+}
+
+size_t http_arena_capacity(const http_arena *this) {
+    size_t total = 0;
+    for (http_arena_block *block = this->blocks; block; block = block->next)
+        total += sizeof(http_arena_block) + block->size;
+    return total;
+}
+
+void http_arena_deinit(http_arena *this) {
+    http_arena_block *block = this->blocks;
+    while (block) {
+        http_arena_block *next = block->next;
+        http_free(block);
+        block = next;
+    }
+    this->blocks = NULL;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+
+#define HTTP_ARENA_BLOCK_SIZE 4096
+// Most a reset keeps, a larger peak goes back to a single block
+#define HTTP_ARENA_MAX_KEPT   (16 * 1024)
+
+typedef struct http_arena_block http_arena_block;
+
+/**
+ * Bump allocator. Allocations are never freed one by one, the whole
+ * arena is reset at once. The first block survives resets so an arena
+ * reused for request after request stops calling malloc once warm.
+ */
+typedef struct http_arena {
+    http_arena_block*   blocks;
+    size_t              block_size;
+} http_arena;
+
+/**
+ * Initializes an empty arena, no memory is allocated until first use
+ *
+ * @param this          Arena
+ * @param block_size    Minimum size of each block, 0 for the default
+ */
+void    http_arena_init(http_arena *this, size_t block_size);
+
+/**
+ * Allocates size bytes aligned for any type
+ *
+ * @param this  Arena
+ * @param size  Bytes to allocate
+ *
+ * @returns Pointer valid until the next reset, or NULL if out of memory
+ */
+void   *http_arena_alloc(http_arena *this, size_t size);
+
+/**
+ * Copies len bytes of s into the arena and NUL terminates them
+ *
+ * @returns Copy or NULL if out of memory
+ */
+char   *http_arena_strndup(http_arena *this, const char *s, size_t len);
+
+/**
+ * Releases every allocation. Keeps one block, sized to what was used
+ * since the last reset up to HTTP_ARENA_MAX_KEPT, for the next round.
+ *
+ * @param this  Arena
+ */
+void    http_arena_reset(http_arena *this);
+
+/**
+ * Bytes held by the arena's blocks, used or not
+ *
+ * @param this  Arena
+ */
+size_t  http_arena_capacity(const http_arena *this);
+
+/**
+ * Frees every block
+ *
+ * @param this  Arena
+ */
+void    http_arena_deinit(http_arena *this);
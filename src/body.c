@@ -1,4 +1,5 @@
 #include "http/body.h"
+#include "http/alloc.h"
 #include "http/results.h"
 
 #include <stdlib.h>
@@ -6,7 +7,7 @@
 
 __attribute__((malloc))
 http_body *http_body_new(void) {
-    http_body* new_body = malloc(sizeof(http_body));
+    http_body* new_body = http_malloc(sizeof(http_body));
     new_body->data = NULL;
     new_body->length = 0;
     return new_body;
@@ -14,8 +15,8 @@ http_body *http_body_new(void) {
 
 __attribute__((malloc))
 http_body *http_body_newWithBody(void *data, size_t length) {
-    http_body* new_body = malloc(sizeof(http_body));
-    new_body->data = malloc(length);
+    http_body* new_body = http_malloc(sizeof(http_body));
+    new_body->data = http_malloc(length);
     memcpy(new_body->data, data, length);
     new_body->length = length;
 
@@ -28,8 +29,8 @@ void http_body_init(http_body* this) {
 }
 
 ErrorMessage http_body_initWithBody(http_body* this, void *data, size_t length) {
-    this->data = malloc(length);
-    if (!data)
+    this->data = http_malloc(length);
+    if (!this->data)
         return "No more memory.";
     memcpy(this->data, data, length);
     this->length = length;
@@ -40,14 +41,14 @@ ErrorMessage http_body_initWithBody(http_body* this, void *data, size_t length)
 void http_body_deinit(http_body *this) {
     if (this) {
         if (this->length > 0 || this->data)
-            free(this->data);
+            http_free(this->data);
     }
 }
 
 void http_body_delete(http_body *this) {
     if (this) {
         if (this->length > 0 || this->data)
-            free(this->data);
-        free(this);
+            http_free(this->data);
+        http_free(this);
     }
 }
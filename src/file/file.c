@@ -0,0 +1,147 @@
+#include "file.h"
+
+#include "http/alloc.h"
+#include "http/results.h"
+#include "logger/logger.h"
+#include "map/map.h"
+#include "sds.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+DEFINE_RESULT_TYPE(http_file *, HTTPFileResult);
+
+// Each worker has its own cache, so lookups take no locks
+static thread_local http_file *cache[HTTP_FILE_CACHE_SIZE];
+static thread_local uint64_t cache_clock;
+
+static void http_file_delete(http_file *this) {
+    if (this->fd >= 0)
+        close(this->fd);
+    sdsfree(this->path);
+    http_free(this);
+}
+
+void http_file_retain(http_file *this) {
+    this->refs++;
+}
+
+void http_file_release(http_file *this) {
+    if (this && --this->refs == 0)
+        http_file_delete(this);
+}
+
+/**
+ * Drops the cache's reference to the entry in slot
+ */
+static void http_file_evict(size_t slot) {
+    http_file *file = cache[slot];
+    cache[slot] = NULL;
+    http_file_release(file);
+}
+
+static bool http_file_isStale(http_file *this, time_t now) {
+    if (now - this->checked_at < HTTP_FILE_CACHE_REVALIDATE)
+        return false;
+
+    struct stat st;
+    if (stat(this->path, &st) < 0 || st.st_ino != this->st.st_ino ||
+        st.st_dev != this->st.st_dev || st.st_size != this->st.st_size ||
+        st.st_mtim.tv_sec != this->st.st_mtim.tv_sec ||
+        st.st_mtim.tv_nsec != this->st.st_mtim.tv_nsec)
+        return true;
+
+    this->checked_at = now;
+    return false;
+}
+
+/**
+ * Opens path without the cache
+ */
+static HTTPFileResult http_file_openUncached(const char *path, uint64_t hash, time_t now) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return HTTPFileResult_Error(errno == ENOENT || errno == ENOTDIR
+                                        ? "File not found"
+                                        : "File could not be opened");
+
+    http_file *file = http_malloc(sizeof(http_file));
+    if (!file) {
+        close(fd);
+        return HTTPFileResult_Error("Failed to allocate memory");
+    }
+    file->fd = fd;
+    file->path = sdsnew(path);
+    file->hash = hash;
+    file->refs = 1;
+    file->checked_at = now;
+    file->used_at = 0;
+
+    if (!file->path || fstat(fd, &file->st) < 0) {
+        http_file_delete(file);
+        return HTTPFileResult_Error("File could not be opened");
+    }
+    if (!S_ISREG(file->st.st_mode)) {
+        http_file_delete(file);
+        return HTTPFileResult_Error("Not a regular file");
+    }
+
+    return HTTPFileResult_Ok(file);
+}
+
+HTTPFileResult http_file_open(const char *path) {
+    if (!path)
+        return HTTPFileResult_Error("Path is null");
+
+    uint64_t hash = map_hash(path);
+    time_t now = time(NULL);
+
+    size_t victim = 0;
+    for (size_t i = 0; i < HTTP_FILE_CACHE_SIZE; i++) {
+        http_file *file = cache[i];
+        if (!file) {
+            victim = i;
+            continue;
+        }
+
+        if (file->hash == hash && strcmp(file->path, path) == 0) {
+            if (http_file_isStale(file, now)) {
+                http_file_evict(i);
+                victim = i;
+                break;
+            }
+            file->used_at = ++cache_clock;
+            http_file_retain(file);
+            return HTTPFileResult_Ok(file);
+        }
+
+        if (cache[victim] && file->used_at < cache[victim]->used_at)
+            victim = i;
+    }
+
+    HTTPFileResult res = http_file_openUncached(path, hash, now);
+    if (!res.Ok)
+        return res;
+
+    // Least recently used entry makes room
+    if (cache[victim])
+        http_file_evict(victim);
+    http_file *file = res.Value;
+    file->used_at = ++cache_clock;
+    http_file_retain(file);
+    cache[victim] = file;
+
+    return res;
+}
+
+void http_file_cacheClear(void) {
+    for (size_t i = 0; i < HTTP_FILE_CACHE_SIZE; i++) {
+        if (cache[i])
+            http_file_evict(i);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "http/results.h"
+#include "sds.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define HTTP_FILE_CACHE_SIZE        64
+// Seconds a cached stat is trusted before the path is checked again
+#define HTTP_FILE_CACHE_REVALIDATE  1
+
+/**
+ * Open regular file shared by every response that serves it. Reference
+ * counted, the descriptor is closed when the last holder releases it
+ * and the cache no longer tracks it.
+ */
+typedef struct http_file {
+    sds                 path;
+    uint64_t            hash;
+    int                 fd;
+    struct stat         st;
+    unsigned            refs;
+    time_t              checked_at;
+    uint64_t            used_at;
+} http_file;
+
+DECLARE_RESULT_TYPE(http_file *, HTTPFileResult);
+
+/**
+ * Opens path through the calling thread's descriptor cache. Hot files
+ * cost a lookup instead of open and fstat, and are re-checked at most
+ * once per HTTP_FILE_CACHE_REVALIDATE seconds. Files are never shared
+ * between threads, release them on the thread that opened them.
+ *
+ * @param path  File path
+ *
+ * @returns HTTPFileResult holding a reference. Must unwrap to get http_file
+ */
+HTTPFileResult  http_file_open(const char *path);
+
+/**
+ * Takes another reference to this
+ *
+ * @param this  File
+ */
+void            http_file_retain(http_file *this);
+
+/**
+ * Drops a reference to this, closing it once unused and uncached
+ *
+ * @param this  File
+ */
+void            http_file_release(http_file *this);
+
+/**
+ * Closes every descriptor cached by the calling thread that is not
+ * in use. Called when a worker exits.
+ */
+void            http_file_cacheClear(void);
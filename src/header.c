@@ -0,0 +1,155 @@
+#include "http/header.h"
+#include "logger/logger.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *const http_header_names[HTTP_HEADER_COUNT] = {
+    [HTTP_HEADER_HOST] = "host",
+    [HTTP_HEADER_CONTENT_LENGTH] = "content-length",
+    [HTTP_HEADER_CONTENT_TYPE] = "content-type",
+    [HTTP_HEADER_CONNECTION] = "connection",
+    [HTTP_HEADER_TRANSFER_ENCODING] = "transfer-encoding",
+    [HTTP_HEADER_ACCEPT_ENCODING] = "accept-encoding",
+    [HTTP_HEADER_EXPECT] = "expect",
+    [HTTP_HEADER_UPGRADE] = "upgrade",
+    [HTTP_HEADER_ACCEPT] = "accept",
+    [HTTP_HEADER_ACCEPT_CHARSET] = "accept-charset",
+    [HTTP_HEADER_ACCEPT_LANGUAGE] = "accept-language",
+    [HTTP_HEADER_ACCEPT_RANGES] = "accept-ranges",
+    [HTTP_HEADER_ACCESS_CONTROL_ALLOW_CREDENTIALS] = "access-control-allow-credentials",
+    [HTTP_HEADER_ACCESS_CONTROL_ALLOW_HEADERS] = "access-control-allow-headers",
+    [HTTP_HEADER_ACCESS_CONTROL_ALLOW_METHODS] = "access-control-allow-methods",
+    [HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN] = "access-control-allow-origin",
+    [HTTP_HEADER_ACCESS_CONTROL_EXPOSE_HEADERS] = "access-control-expose-headers",
+    [HTTP_HEADER_ACCESS_CONTROL_MAX_AGE] = "access-control-max-age",
+    [HTTP_HEADER_ACCESS_CONTROL_REQUEST_HEADERS] = "access-control-request-headers",
+    [HTTP_HEADER_ACCESS_CONTROL_REQUEST_METHOD] = "access-control-request-method",
+    [HTTP_HEADER_AGE] = "age",
+    [HTTP_HEADER_ALLOW] = "allow",
+    [HTTP_HEADER_AUTHORIZATION] = "authorization",
+    [HTTP_HEADER_CACHE_CONTROL] = "cache-control",
+    [HTTP_HEADER_CONTENT_DISPOSITION] = "content-disposition",
+    [HTTP_HEADER_CONTENT_ENCODING] = "content-encoding",
+    [HTTP_HEADER_CONTENT_LANGUAGE] = "content-language",
+    [HTTP_HEADER_CONTENT_LOCATION] = "content-location",
+    [HTTP_HEADER_CONTENT_RANGE] = "content-range",
+    [HTTP_HEADER_COOKIE] = "cookie",
+    [HTTP_HEADER_DATE] = "date",
+    [HTTP_HEADER_DNT] = "dnt",
+    [HTTP_HEADER_ETAG] = "etag",
+    [HTTP_HEADER_EXPIRES] = "expires",
+    [HTTP_HEADER_FORWARDED] = "forwarded",
+    [HTTP_HEADER_FROM] = "from",
+    [HTTP_HEADER_IF_MATCH] = "if-match",
+    [HTTP_HEADER_IF_MODIFIED_SINCE] = "if-modified-since",
+    [HTTP_HEADER_IF_NONE_MATCH] = "if-none-match",
+    [HTTP_HEADER_IF_RANGE] = "if-range",
+    [HTTP_HEADER_IF_UNMODIFIED_SINCE] = "if-unmodified-since",
+    [HTTP_HEADER_KEEP_ALIVE] = "keep-alive",
+    [HTTP_HEADER_LAST_MODIFIED] = "last-modified",
+    [HTTP_HEADER_LINK] = "link",
+    [HTTP_HEADER_LOCATION] = "location",
+    [HTTP_HEADER_MAX_FORWARDS] = "max-forwards",
+    [HTTP_HEADER_ORIGIN] = "origin",
+    [HTTP_HEADER_PRAGMA] = "pragma",
+    [HTTP_HEADER_PROXY_AUTHENTICATE] = "proxy-authenticate",
+    [HTTP_HEADER_PROXY_AUTHORIZATION] = "proxy-authorization",
+    [HTTP_HEADER_RANGE] = "range",
+    [HTTP_HEADER_REFERER] = "referer",
+    [HTTP_HEADER_REFRESH] = "refresh",
+    [HTTP_HEADER_RETRY_AFTER] = "retry-after",
+    [HTTP_HEADER_SEC_FETCH_DEST] = "sec-fetch-dest",
+    [HTTP_HEADER_SEC_FETCH_MODE] = "sec-fetch-mode",
+    [HTTP_HEADER_SEC_FETCH_SITE] = "sec-fetch-site",
+    [HTTP_HEADER_SEC_FETCH_USER] = "sec-fetch-user",
+    [HTTP_HEADER_SERVER] = "server",
+    [HTTP_HEADER_SET_COOKIE] = "set-cookie",
+    [HTTP_HEADER_STRICT_TRANSPORT_SECURITY] = "strict-transport-security",
+    [HTTP_HEADER_TE] = "te",
+    [HTTP_HEADER_TRAILER] = "trailer",
+    [HTTP_HEADER_UPGRADE_INSECURE_REQUESTS] = "upgrade-insecure-requests",
+    [HTTP_HEADER_USER_AGENT] = "user-agent",
+    [HTTP_HEADER_VARY] = "vary",
+    [HTTP_HEADER_VIA] = "via",
+    [HTTP_HEADER_WWW_AUTHENTICATE] = "www-authenticate",
+    [HTTP_HEADER_X_FORWARDED_FOR] = "x-forwarded-for",
+    [HTTP_HEADER_X_FORWARDED_HOST] = "x-forwarded-host",
+    [HTTP_HEADER_X_FORWARDED_PROTO] = "x-forwarded-proto",
+    [HTTP_HEADER_X_REQUESTED_WITH] = "x-requested-with",
+};
+
+// Multipliers tried when building the table before giving up
+#define HTTP_HEADER_HASH_ATTEMPTS (1u << 20)
+
+/**
+ * Hashes the first two and last two bytes and the length. ORing in 0x20
+ * folds letters to lowercase and leaves '-' and digits alone.
+ */
+static inline uint8_t http_header_hash(const char *name, size_t len, uint32_t seed) {
+    uint32_t key = (uint32_t)(name[0] | 0x20) | (uint32_t)(name[1] | 0x20) << 8 |
+                   (uint32_t)(name[len - 2] | 0x20) << 16 |
+                   (uint32_t)(name[len - 1] | 0x20) << 24;
+    key ^= (uint32_t)len * 0x9e3779b1u;
+    return (uint8_t)((key * seed) >> 24);
+}
+
+static_assert(HTTP_HEADER_COUNT <= 256, "header ids must fit a slot");
+
+static uint32_t http_header_seed;
+static uint8_t http_header_slots[256];
+static pthread_once_t http_header_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Fills http_header_slots from http_header_names, walking a fixed
+ * sequence of multipliers until one spreads every name over its own
+ * slot. Takes a few milliseconds, once per process.
+ */
+static void http_header_buildSlots(void) {
+    uint32_t seed = 1;
+    for (uint32_t attempt = 0; attempt < HTTP_HEADER_HASH_ATTEMPTS; attempt++) {
+        seed = (seed * 0x9e3779b1u + 0x7f4a7c15u) | 1;
+        memset(http_header_slots, HTTP_HEADER_UNKNOWN, sizeof(http_header_slots));
+
+        http_header_id id = HTTP_HEADER_UNKNOWN + 1;
+        for (; id < HTTP_HEADER_COUNT; id++) {
+            const char *name = http_header_names[id];
+            uint8_t slot = http_header_hash(name, strlen(name), seed);
+            if (http_header_slots[slot] != HTTP_HEADER_UNKNOWN)
+                break;
+            http_header_slots[slot] = id;
+        }
+        if (id == HTTP_HEADER_COUNT) {
+            http_header_seed = seed;
+            return;
+        }
+    }
+
+    // Lookups would silently miss known headers
+    LOG_ERROR("Header table error: no collision-free hash for %d names in 256 slots",
+              HTTP_HEADER_COUNT - 1);
+    abort();
+}
+
+http_header_id http_header_lookup(const char *name, size_t len) {
+    if (len < 2)
+        return HTTP_HEADER_UNKNOWN;
+
+    pthread_once(&http_header_once, http_header_buildSlots);
+    http_header_id id = http_header_slots[http_header_hash(name, len, http_header_seed)];
+    if (id == HTTP_HEADER_UNKNOWN || strlen(http_header_names[id]) != len ||
+        strncasecmp(http_header_names[id], name, len) != 0)
+        return HTTP_HEADER_UNKNOWN;
+
+    return id;
+}
+
+const char *http_header_name(http_header_id id) {
+    if (id <= HTTP_HEADER_UNKNOWN || id >= HTTP_HEADER_COUNT)
+        return NULL;
+    return http_header_names[id];
+}
@@ -1,94 +1,326 @@
 #include "map.h"
+#include "http/alloc.h"
 #include "logger/logger.h"
 #include "sds.h"
 #include "wyhash.h"
 #include <errno.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAP_DEFAULT_CAPACITY 11
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MAP_GROUP_SIZE 16
+
+// Control bytes: EMPTY and DELETED have the top bit set, a full slot
+// holds the low 7 bits of its key's hash
+#define MAP_EMPTY   ((uint8_t)0x80)
+#define MAP_DELETED ((uint8_t)0xfe)
 
 void map_pair_delete(map_pair* this) {
     sdsfree(this->key);
     sdsfree(this->value);
 
-    free(this);
+    http_free(this);
 }
 
-map* map_new() {
-    size_t capacity = MAP_DEFAULT_CAPACITY;
-    size_t data_size = sizeof(map_pair) * capacity;
-    size_t total_size = sizeof(map) + data_size;
+/**
+ * Entries a table of capacity slots holds before it must grow,
+ * a 7/8 load factor
+ */
+static inline size_t map_max_entries(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+static inline uint8_t map_h2(size_t hash) {
+    return hash & 0x7f;
+}
+
+static inline size_t map_h1(size_t hash) {
+    return hash >> 7;
+}
+
+/**
+ * Lowercases the ASCII letters in every byte of v
+ */
+static inline uint64_t map_fold8(uint64_t v) {
+    const uint64_t ones = 0x0101010101010101ull;
+    uint64_t low = v & (0x7f * ones);
+    // Top bit of each byte: at least 'A', above 'Z', not ASCII
+    uint64_t upper = (low + (0x80 - 'A') * ones) & ~(low + (0x80 - 'Z' - 1) * ones) & ~v;
+    return v | ((upper & (0x80 * ones)) >> 2);
+}
+
+static inline uint8_t map_fold(uint8_t c) {
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+#ifdef __SSE2__
+static inline __m128i map_fold16(__m128i v) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+static inline uint64_t map_load8(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t map_load4(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/**
+ * Compares len bytes of a and b ignoring ASCII case. Loads are fixed
+ * size and overlap at the end instead of looping over a tail.
+ */
+static bool map_equal_fold(const char* a, const char* b, size_t len) {
+#ifdef __SSE2__
+    if (len >= 16) {
+        for (size_t i = 0;; i += 16) {
+            // Last block overlaps the previous one
+            if (i + 16 > len)
+                i = len - 16;
+            __m128i x = map_fold16(_mm_loadu_si128((const __m128i*)(a + i)));
+            __m128i y = map_fold16(_mm_loadu_si128((const __m128i*)(b + i)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff)
+                return false;
+            if (i + 16 == len)
+                return true;
+        }
+    }
+#else
+    for (; len > 16; a += 8, b += 8, len -= 8) {
+        if (map_fold8(map_load8(a)) != map_fold8(map_load8(b)))
+            return false;
+    }
+#endif
+    if (len >= 8)
+        return map_fold8(map_load8(a)) == map_fold8(map_load8(b)) &&
+               map_fold8(map_load8(a + len - 8)) == map_fold8(map_load8(b + len - 8));
+    if (len >= 4)
+        return map_fold8(map_load4(a)) == map_fold8(map_load4(b)) &&
+               map_fold8(map_load4(a + len - 4)) == map_fold8(map_load4(b + len - 4));
+    for (size_t i = 0; i < len; i++) {
+        if (map_fold(a[i]) != map_fold(b[i]))
+            return false;
+    }
+    return true;
+}
+
+static inline bool map_key_equal(const map_pair* pair, const char* key, size_t len) {
+    return sdslen(pair->key) == len && map_equal_fold(pair->key, key, len);
+}
+
+/**
+ * Bit i is set if byte i of the group equals byte
+ */
+static inline uint32_t map_group_match(const uint8_t* group, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_load_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < MAP_GROUP_SIZE; i++)
+        mask |= (uint32_t)(group[i] == byte) << i;
+    return mask;
+#endif
+}
+
+/**
+ * Bit i is set if the key of inline entry i starts with byte, which
+ * must be folded
+ */
+static inline uint32_t map_small_match(const map* this, uint8_t byte) {
+    static_assert(MAP_SMALL_SIZE == MAP_GROUP_SIZE, "tags are compared as one group");
+    uint32_t mask = map_group_match(this->small_tags, byte);
+    return mask & (((uint32_t)1 << this->entry_count) - 1);
+}
 
-    map* new_map = malloc(total_size);
+/**
+ * Bit i is set if slot i of the group is empty or deleted
+ */
+static inline uint32_t map_group_free(const uint8_t* group) {
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_load_si128((const __m128i*)group));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < MAP_GROUP_SIZE; i++)
+        mask |= (uint32_t)(group[i] >> 7) << i;
+    return mask;
+#endif
+}
+
+/**
+ * Returns the slot holding key or SIZE_MAX. Groups are visited in
+ * triangular order, which reaches every group once when the group
+ * count is a power of two.
+ */
+static inline size_t map_find(map* this, const char* key, size_t len, size_t hash) {
+    uint8_t h2 = map_h2(hash);
+    size_t mask = this->capacity / MAP_GROUP_SIZE - 1;
+    size_t group = map_h1(hash) & mask;
+
+    for (size_t step = 1;; step++) {
+        const uint8_t* ctrl = this->ctrl + group * MAP_GROUP_SIZE;
+        for (uint32_t match = map_group_match(ctrl, h2); match; match &= match - 1) {
+            size_t slot = group * MAP_GROUP_SIZE + __builtin_ctz(match);
+            if (map_key_equal(&this->entries[this->slots[slot]], key, len))
+                return slot;
+        }
+        // A key is never placed past a group with room left
+        if (map_group_match(ctrl, MAP_EMPTY))
+            return SIZE_MAX;
+        group = (group + step) & mask;
+    }
+}
+
+/**
+ * Points the first free slot on hash's probe path at entry
+ */
+static void map_place(map* this, size_t hash, uint32_t entry) {
+    size_t mask = this->capacity / MAP_GROUP_SIZE - 1;
+    size_t group = map_h1(hash) & mask;
+
+    for (size_t step = 1;; step++) {
+        uint32_t free_slots = map_group_free(this->ctrl + group * MAP_GROUP_SIZE);
+        if (free_slots) {
+            size_t slot = group * MAP_GROUP_SIZE + __builtin_ctz(free_slots);
+            this->ctrl[slot] = map_h2(hash);
+            this->slots[slot] = entry;
+            return;
+        }
+        group = (group + step) & mask;
+    }
+}
+
+/**
+ * Allocates ctrl, slots and entries for capacity slots as one block
+ *
+ * @returns false if out of memory, this is left untouched
+ */
+static bool map_alloc(map* this, size_t capacity) {
+    size_t ctrl_size = capacity;
+    size_t slots_size = capacity * sizeof(uint32_t);
+    size_t entries_size = map_max_entries(capacity) * sizeof(map_pair);
+    size_t total_size = ctrl_size + slots_size + entries_size;
+
+    // Groups are loaded with aligned vector loads
+    uint8_t* block = http_alignedAlloc(MAP_GROUP_SIZE,
+                                       (total_size + MAP_GROUP_SIZE - 1) & ~(size_t)(MAP_GROUP_SIZE - 1));
+    if (block == NULL) {
+        LOG_ERROR("Failed to allocate memory for map: %s", strerror(errno));
+        return false;
+    }
+
+    memset(block, MAP_EMPTY, ctrl_size);
+    this->ctrl = block;
+    this->slots = (uint32_t*)(block + ctrl_size);
+    this->entries = (map_pair*)(block + ctrl_size + slots_size);
+    this->capacity = capacity;
+    this->entry_count = 0;
+    this->size = 0;
+    return true;
+}
+
+void map_init(map* this) {
+    this->size = 0;
+    this->capacity = MAP_SMALL_SIZE;
+    this->ctrl = NULL;
+    this->slots = NULL;
+    this->entries = this->small;
+    this->entry_count = 0;
+}
+
+void map_deinit(map* this) {
+    for (size_t i = 0; i < this->entry_count; i++) {
+        sdsfree(this->entries[i].key);
+        sdsfree(this->entries[i].value);
+    }
+
+    http_free(this->ctrl);
+    map_init(this);
+}
+
+map* map_new() {
+    map* new_map = http_malloc(sizeof(map));
     if (new_map == NULL) {
         LOG_ERROR("Failed to allocate memory for new map: %s", strerror(errno));
         return NULL;
     }
 
-    new_map->size = 0;
-    new_map->capacity = capacity;
-    new_map->entries = NULL;
+    map_init(new_map);
+    return new_map;
+}
 
-    //** set array to null pointers
-    memset(new_map->data, 0, data_size);
+/**
+ * Returns the entry holding key or SIZE_MAX, hashing only once the map
+ * has outgrown its inline entries
+ */
+static size_t map_find_entry(map* this, const char* key, size_t len) {
+    if (this->ctrl == NULL) {
+        uint8_t tag = map_fold(key[0]);
+        for (uint32_t match = map_small_match(this, tag); match; match &= match - 1) {
+            size_t entry = __builtin_ctz(match);
+            if (map_key_equal(&this->small[entry], key, len))
+                return entry;
+        }
+        return SIZE_MAX;
+    }
 
-    return new_map;
+    size_t slot = map_find(this, key, len, map_hash_fold(key, len));
+    return slot == SIZE_MAX ? SIZE_MAX : this->slots[slot];
 }
 
-// No resizing just yet
 map* map_set(map* this, const char* key, const char* value) {
     if (this == NULL) {
         LOG_WARNING("this map is NULL");
         return NULL;
     }
-    size_t idx = map_hash(key) % this->capacity;
-
-    // Determine if key already exists
-    size_t keys_len;
-    const char** keys = map_keys(this, &keys_len);
-    if (str_arr_contains(keys, key, keys_len)) {
-        map_pair* cur = this->data[idx];
-        while (cur != NULL) {
-            if (strcmp(cur->key, key) == 0) {
-                sdscpy(cur->value, value);
-                return this;
-            }
-            cur = cur->p_next;
-        }
-        if (cur == NULL) {
-            LOG_ERROR("Unexpected error while setting kv pair: <%s, %s>", key, value);
-            return this;
-        }
-    } else { // new key
-        // grow if needed
-        this = map_grow(this);
-        map_pair* new_pair = malloc(sizeof(map_pair));
-        if (new_pair == NULL) {
-            LOG_ERROR("Failed to allocate memory for new pair: %s", strerror(errno));
+
+    size_t len = strlen(key);
+    size_t entry = map_find_entry(this, key, len);
+    if (entry != SIZE_MAX) {
+        map_pair* pair = &this->entries[entry];
+        sds new_value = sdscpy(pair->value, value);
+        if (new_value == NULL) {
+            LOG_ERROR("Failed to allocate memory for value of <%s>", key);
             return this;
         }
-        new_pair->key = sdsnew(key);
-        new_pair->value = sdsnew(value);
-
-        // Handle bucket insertion
-        new_pair->p_next = this->data[idx];
-        new_pair->p_prev = NULL;
-        if (this->data[idx] != NULL)
-            this->data[idx]->p_prev = new_pair;
-        this->data[idx] = new_pair;
-
-        // Handle entries insertion
-        new_pair->next_entry = this->entries;
-        new_pair->prev_entry = NULL;
-        if (this->entries != NULL)
-            this->entries->prev_entry = new_pair;
-        this->entries = new_pair;
-
-        this->size++;
+        pair->value = new_value;
+        return this;
+    }
+
+    this = map_grow(this);
+    // Growing failed, inline or not there is no room left
+    size_t max_entries = this->ctrl ? map_max_entries(this->capacity) : MAP_SMALL_SIZE;
+    if (this->entry_count >= max_entries)
+        return this;
+
+    sds new_key = sdsnewlen(key, len);
+    sds new_value = sdsnew(value);
+    if (new_key == NULL || new_value == NULL) {
+        LOG_ERROR("Failed to allocate memory for new pair: %s", strerror(errno));
+        sdsfree(new_key);
+        sdsfree(new_value);
+        return this;
     }
 
+    if (this->ctrl == NULL)
+        this->small_tags[this->entry_count] = map_fold(new_key[0]);
+    else
+        map_place(this, map_hash_fold(key, len), this->entry_count);
+    this->entries[this->entry_count++] = (map_pair){ .key = new_key, .value = new_value };
+    this->size++;
+
     return this;
 }
 
@@ -100,15 +332,59 @@ const char* map_get(map* this, const char* key) {
     if (this->size < 1)
         return NULL;
 
-    size_t idx = map_hash(key) % this->capacity;
-    map_pair* cur = this->data[idx];
-    while (cur != NULL) {
-        if (strcmp(cur->key, key) == 0)
-            return cur->value;
-        cur = cur->p_next;
+    size_t entry = map_find_entry(this, key, strlen(key));
+    if (entry == SIZE_MAX)
+        return NULL;
+
+    return this->entries[entry].value;
+}
+
+/**
+ * Unlinks key from the table and hands back its contents
+ *
+ * @returns false if key is not in the map
+ */
+static bool map_take(map* this, const char* key, map_pair* out) {
+    if (this->size < 1)
+        return false;
+
+    size_t len = strlen(key);
+    if (this->ctrl == NULL) {
+        size_t entry = map_find_entry(this, key, len);
+        if (entry == SIZE_MAX)
+            return false;
+
+        // Inline entries stay packed so the tag mask stays a prefix
+        *out = this->small[entry];
+        size_t tail = this->entry_count - entry - 1;
+        memmove(&this->small[entry], &this->small[entry + 1], tail * sizeof(map_pair));
+        memmove(&this->small_tags[entry], &this->small_tags[entry + 1], tail);
+        this->entry_count--;
+        this->size--;
+        return true;
     }
 
-    return NULL;
+    size_t slot = map_find(this, key, len, map_hash_fold(key, len));
+    if (slot == SIZE_MAX)
+        return false;
+
+    uint32_t entry = this->slots[slot];
+    *out = this->entries[entry];
+    this->entries[entry].key = NULL;
+    this->entries[entry].value = NULL;
+
+    // Probes stop at a group with an empty slot anyway, so the slot can
+    // become empty again instead of a tombstone
+    const uint8_t* group = this->ctrl + (slot & ~(size_t)(MAP_GROUP_SIZE - 1));
+    this->ctrl[slot] = map_group_match(group, MAP_EMPTY) ? MAP_EMPTY : MAP_DELETED;
+
+    // The newest entry can be reused right away unless it left a
+    // tombstone, every tombstone must keep its entry to bound the load
+    if (entry == this->entry_count - 1 && this->ctrl[slot] == MAP_EMPTY)
+        this->entry_count--;
+
+    this->size--;
+    return true;
 }
 
 map_pair* map_remove_pair(map* this, const char* key) {
@@ -116,41 +392,21 @@ map_pair* map_remove_pair(map* this, const char* key) {
         LOG_WARNING("this map is NULL");
         return NULL;
     }
-    if (this->size < 1)
+
+    map_pair pair;
+    if (!map_take(this, key, &pair))
         return NULL;
 
-    size_t idx = map_hash(key) % this->capacity;
-    map_pair* cur = this->data[idx];
-    while (cur != NULL) {
-        if (strcmp(cur->key, key) == 0) {
-            // FOUND
-            map_pair* n = cur->p_next;
-            map_pair* p = cur->p_prev;
-
-            if (p != NULL)
-                p->p_next = n;
-            else
-                this->data[idx] = NULL;
-            if (n != NULL)
-                n->p_prev = p;
-
-            map_pair* ne = cur->next_entry;
-            map_pair* pe = cur->prev_entry;
-
-            if (pe != NULL)
-                pe->next_entry = ne;
-            else
-                this->entries = NULL;
-            if (ne != NULL)
-                ne->prev_entry = pe;
-
-            this->size--;
-            return cur;
-        }
-        cur = cur->p_next;
+    map_pair* removed = http_malloc(sizeof(map_pair));
+    if (removed == NULL) {
+        LOG_ERROR("Failed to allocate memory for removed pair: %s", strerror(errno));
+        sdsfree(pair.key);
+        sdsfree(pair.value);
+        return NULL;
     }
+    *removed = pair;
 
-    return NULL;
+    return removed;
 }
 
 char* map_remove_value(map* this, const char* key) {
@@ -158,52 +414,20 @@ char* map_remove_value(map* this, const char* key) {
         LOG_WARNING("this map is NULL");
         return NULL;
     }
-    if (this->size < 1)
-        return NULL;
 
-    size_t idx = map_hash(key) % this->capacity;
-    map_pair* cur = this->data[idx];
+    map_pair pair;
+    if (!map_take(this, key, &pair))
+        return NULL;
 
-    char* value = malloc(sizeof(char) * sdslen(cur->value)+1);
-    if (value == NULL) {
+    char* value = http_malloc(sizeof(char) * sdslen(pair.value) + 1);
+    if (value == NULL)
         LOG_ERROR("Failed to allocate memory for new string: %s", strerror(errno));
-        return NULL;
-    }
-    while (cur != NULL) {
-        if (strcmp(cur->key, key) == 0) {
-            // FOUND
-            map_pair* n = cur->p_next;
-            map_pair* p = cur->p_prev;
-
-            if (p != NULL)
-                p->p_next = n;
-            else
-                this->data[idx] = NULL;
-            if (n != NULL)
-                n->p_prev = p;
-
-            map_pair* ne = cur->next_entry;
-            map_pair* pe = cur->prev_entry;
-
-            if (pe != NULL)
-                pe->next_entry = ne;
-            else
-                this->entries = NULL;
-            if (ne != NULL)
-                ne->prev_entry = pe;
-
-            strcpy(value, cur->value);
-
-            map_pair_delete(cur);
-
-            this->size--;
-            return value;
-        }
-        cur = cur->p_next;
-    }
+    else
+        memcpy(value, pair.value, sdslen(pair.value) + 1);
 
-    free(value);
-    return NULL;
+    sdsfree(pair.key);
+    sdsfree(pair.value);
+    return value;
 }
 
 void map_delete(map* this) {
@@ -212,13 +436,17 @@ void map_delete(map* this) {
         return;
     }
 
-    while (this->entries != NULL) {
-        map_pair* temp = this->entries;
-        this->entries = temp->next_entry;
-        map_pair_delete(temp);
-    }
+    map_deinit(this);
+    http_free(this);
+}
 
-    free(this);
+map_pair* map_next(map* this, map_pair* pair) {
+    size_t i = pair ? (size_t)(pair - this->entries) : this->entry_count;
+    while (i-- > 0) {
+        if (this->entries[i].key != NULL)
+            return &this->entries[i];
+    }
+    return NULL;
 }
 
 const char** map_keys(map* this, size_t *keys_len) {
@@ -226,21 +454,15 @@ const char** map_keys(map* this, size_t *keys_len) {
         LOG_ERROR("this map is null");
         return NULL;
     }
-    const char** keys = malloc(this->size * sizeof(char*));
+    const char** keys = http_malloc(this->size * sizeof(char*));
     if (keys == NULL) {
         LOG_ERROR("Failed to allocate memmory for keys array: %s", strerror(errno));
         return NULL;
     }
 
     size_t i = 0;
-    // Get keys from entries list, not buckets
-    map_pair* cur = this->entries;
-    while (cur != NULL) {
-        // add keys to output array
-        keys[i] = cur->key;
-        i++;
-        cur = cur->next_entry;
-    }
+    for (map_pair* pair = map_next(this, NULL); pair; pair = map_next(this, pair))
+        keys[i++] = pair->key;
 
     // true length of keys array should equal this->size
     *keys_len = i;
@@ -248,60 +470,99 @@ const char** map_keys(map* this, size_t *keys_len) {
 }
 
 map* map_resize(map* this, size_t capacity) {
-    size_t data_size = sizeof(map_pair) * capacity;
-    size_t total_size = sizeof(map) + data_size;
+    size_t new_capacity = MAP_GROUP_SIZE;
+    while (new_capacity < capacity || map_max_entries(new_capacity) <= this->size)
+        new_capacity *= 2;
 
-    map* new_map = malloc(total_size);
-    if (new_map == NULL) {
-        LOG_ERROR("Failed to allocate memory for new map: %s", strerror(errno));
+    map old = *this;
+    if (!map_alloc(this, new_capacity))
         return this;
-    }
 
-    new_map->size = 0;
-    new_map->capacity = capacity;
-    new_map->entries = NULL;
-
-    //** set array to null pointers
-    memset(new_map->data, 0, data_size);
-
-    map_pair* cur = this->entries;
-    while (cur != NULL) {
-        // Set ownership to new map without deleting data
-        map_pair* next = cur->next_entry;
-        size_t idx = map_hash(cur->key) % new_map->capacity;
-
-        cur->p_next = new_map->data[idx];
-        cur->p_prev = NULL;
-        if (new_map->data[idx] != NULL)
-            new_map->data[idx]->p_prev = cur;
-        new_map->data[idx] = cur;
-
-        cur->next_entry = new_map->entries;
-        cur->prev_entry = NULL;
-        if (new_map->entries != NULL)
-            new_map->entries->prev_entry = cur;
-        new_map->entries = cur;
-
-        cur = next;
-        new_map->size++;
+    // Live entries keep their order, removed ones are dropped
+    for (size_t i = 0; i < old.entry_count; i++) {
+        if (old.entries[i].key == NULL)
+            continue;
+        map_place(this, map_hash_fold(old.entries[i].key, sdslen(old.entries[i].key)),
+                  this->entry_count);
+        this->entries[this->entry_count++] = old.entries[i];
     }
+    this->size = old.size;
 
-    free(this);
-
-    return new_map;
+    http_free(old.ctrl);
+    return this;
 }
 
 map* map_grow(map* this) {
-    if (this->size*100 > this->capacity*75) {
-        this = map_resize(this, next_prime((this->capacity * 17) / 10));
+    if (this->ctrl == NULL) {
+        if (this->entry_count < MAP_SMALL_SIZE)
+            return this;
+        return map_resize(this, 2 * MAP_SMALL_SIZE);
     }
-    return this;
+    if (this->entry_count < map_max_entries(this->capacity))
+        return this;
+
+    // Mostly removed entries only need compacting
+    size_t capacity = this->size + 1 > map_max_entries(this->capacity) / 2
+                          ? this->capacity * 2
+                          : this->capacity;
+    return map_resize(this, capacity);
 }
 
 size_t map_hash(const char *s) {
     return (size_t) wyhash(s, strlen(s), 0, _wyp);
 }
 
+static inline uint64_t map_wyr8_fold(const uint8_t* p) {
+    return map_fold8(_wyr8(p));
+}
+
+static inline uint64_t map_wyr4_fold(const uint8_t* p) {
+    return map_fold8(_wyr4(p));
+}
+
+size_t map_hash_fold(const char* s, size_t len) {
+    // wyhash with every read folded, equals wyhash of the lowercased key
+    const uint8_t* p = (const uint8_t*)s;
+    const uint64_t* secret = _wyp;
+    uint64_t seed = _wymix(secret[0], secret[1]);
+    uint64_t a, b;
+    if (_likely_(len <= 16)) {
+        if (_likely_(len >= 4)) {
+            a = (map_wyr4_fold(p) << 32) | map_wyr4_fold(p + ((len >> 3) << 2));
+            b = (map_wyr4_fold(p + len - 4) << 32) | map_wyr4_fold(p + len - 4 - ((len >> 3) << 2));
+        } else if (_likely_(len > 0)) {
+            a = map_fold8(_wyr3(p, len));
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (_unlikely_(i >= 48)) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = _wymix(map_wyr8_fold(p) ^ secret[1], map_wyr8_fold(p + 8) ^ seed);
+                see1 = _wymix(map_wyr8_fold(p + 16) ^ secret[2], map_wyr8_fold(p + 24) ^ see1);
+                see2 = _wymix(map_wyr8_fold(p + 32) ^ secret[3], map_wyr8_fold(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (_likely_(i >= 48));
+            seed ^= see1 ^ see2;
+        }
+        while (_unlikely_(i > 16)) {
+            seed = _wymix(map_wyr8_fold(p) ^ secret[1], map_wyr8_fold(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = map_wyr8_fold(p + i - 16);
+        b = map_wyr8_fold(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    _wymum(&a, &b);
+    return (size_t)_wymix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
 bool str_arr_contains(const char** arr, const char* s, size_t arr_len) {
     for (size_t i = 0; i < arr_len; i++) {
         if (strcmp(arr[i], s) == 0)
@@ -310,11 +571,3 @@ bool str_arr_contains(const char** arr, const char* s, size_t arr_len) {
 
     return false;
 }
-
-size_t next_prime(size_t n) {
-    if ( n <= 2) return 2;
-    if (!(n & 1)) n++;
-    while (!is_prime(n))
-        n+=2;
-    return n;
-}
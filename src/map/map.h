@@ -1,19 +1,18 @@
 #pragma once
 
 #include <sds.h>
+#include <stdalign.h>
 #include <stddef.h>
+#include <stdint.h>
+
+// Entries kept inline before a map switches to the hashed table
+#define MAP_SMALL_SIZE 16
 
 typedef struct map_pair map_pair;
 
 struct map_pair {
     sds key;
     sds value;
-
-    map_pair* p_next;
-    map_pair* p_prev;
-
-    map_pair* next_entry;
-    map_pair* prev_entry;
 };
 
 /**
@@ -21,11 +20,34 @@ struct map_pair {
  */
 void map_pair_delete(map_pair* this);
 
+/**
+ * Open-addressing hash table. Slots are grouped by 16, each with one
+ * control byte holding 7 bits of the key's hash, so a probe compares a
+ * whole group at once and only touches keys whose bits match. Slots
+ * point into entries, which is dense and in insertion order; removed
+ * entries keep their place with a NULL key until the next rehash.
+ * Keys are stored as given and compared ignoring ASCII case.
+ *
+ * Up to MAP_SMALL_SIZE entries live inline in small instead, found by
+ * comparing the first byte of every key at once and without hashing,
+ * so a small map allocates nothing but its strings. ctrl is NULL until
+ * the map outgrows it. entries may point into the map itself, a map
+ * must not be moved once used.
+ */
 typedef struct map {
     size_t      size;
+    // Slots, a power of two and a multiple of the group size, or
+    // MAP_SMALL_SIZE while inline
     size_t      capacity;
+    uint8_t*    ctrl;
+    uint32_t*   slots;
+
     map_pair*   entries;
-    map_pair*   data[];
+    // Entries used, removed ones included
+    size_t      entry_count;
+
+    alignas(16) uint8_t small_tags[MAP_SMALL_SIZE];
+    map_pair    small[MAP_SMALL_SIZE];
 } map;
 
 /**
@@ -35,6 +57,17 @@ typedef struct map {
 */
 map*            map_new();
 
+/**
+ * Initialize map in place, e.g. embedded in another struct.
+ * Allocates nothing until it outgrows MAP_SMALL_SIZE entries
+ */
+void            map_init(map* this);
+
+/**
+ * Free contents of a map set up with map_init
+ */
+void            map_deinit(map* this);
+
 /**
  * Insert key value pair into map
  *
@@ -55,13 +88,13 @@ const char*     map_get(map* this, const char* key);
 
 /**
  * Remove entry and return malloced map_pair
- * Must free pair after use
+ * Must free pair with map_pair_delete after use
  */
 map_pair*       map_remove_pair(map* this, const char* key);
 
 /**
  * Remove entry and return malloced string value
- * Must free string after use
+ * Must free string with http_free after use
  */
 char*           map_remove_value(map* this, const char* key);
 
@@ -71,23 +104,37 @@ char*           map_remove_value(map* this, const char* key);
 void            map_delete(map* this);
 
 /**
- * Returns a malloced array of all the map's used keys
+ * Returns a malloced array of all the map's used keys, newest first.
+ * Must free it with http_free
  */
 const char**    map_keys(map* this, size_t *keys_len);
 
+/**
+ * Returns the entry before pair in newest first order, starting from
+ * the newest when pair is NULL, skipping removed entries
+ *
+ * @code
+ * for (map_pair* pair = map_next(m, NULL); pair; pair = map_next(m, pair))
+ * @endcode
+ */
+map_pair*       map_next(map* this, map_pair* pair);
+
+/**
+ * Rehashes into at least capacity slots, dropping removed entries
+ */
 map*            map_resize(map* this, size_t capacity);
 map*            map_grow(map* this);
 
 size_t          map_hash(const char* s);
 
 /**
- * Returns whether the arr contains a string equal to s
- * All strings must be safe C strings \0 terminate
+ * Hash of the first len bytes of s ignoring ASCII case, the hash the
+ * map files keys under
  */
-bool str_arr_contains(const char** arr, const char* s, size_t arr_len);
+size_t          map_hash_fold(const char* s, size_t len);
 
 /**
- * Returns first prime number greater than n
+ * Returns whether the arr contains a string equal to s
+ * All strings must be safe C strings \0 terminate
  */
-size_t next_prime(size_t n);
-
+bool str_arr_contains(const char** arr, const char* s, size_t arr_len);
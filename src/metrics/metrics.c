@@ -0,0 +1,200 @@
+#include "metrics.h"
+
+#include "http/alloc.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Histogram bounds rendered, in nanoseconds. Counts are taken at the
+// bucket boundary at or below each, so they may lag by up to 12.5%.
+static const uint64_t http_metrics_bounds[] = {
+    1000,      2500,      5000,      10000,      25000,      50000,      100000,
+    250000,    500000,    1000000,   2500000,    5000000,    10000000,   25000000,
+    50000000,  100000000, 250000000, 500000000,  1000000000, 2500000000, 5000000000,
+    10000000000,
+};
+
+static const char *const http_metrics_stageNames[HTTP_STAGE_COUNT] = {
+    [HTTP_STAGE_ACCEPT] = "accept", [HTTP_STAGE_READ] = "read",
+    [HTTP_STAGE_PARSE] = "parse",   [HTTP_STAGE_HANDLE] = "handle",
+    [HTTP_STAGE_WRITE] = "write",   [HTTP_STAGE_REQUEST] = "request",
+};
+
+static const char *const http_metrics_reasonNames[HTTP_PARSE_ERROR_COUNT] = {
+    [HTTP_PARSE_ERROR_NONE] = NULL,
+    [HTTP_PARSE_ERROR_REQUEST_LINE] = "request_line",
+    [HTTP_PARSE_ERROR_HEADER] = "header",
+    [HTTP_PARSE_ERROR_HEAD_TOO_LARGE] = "head_too_large",
+    [HTTP_PARSE_ERROR_FRAMING] = "framing",
+    [HTTP_PARSE_ERROR_CHUNK] = "chunk",
+    [HTTP_PARSE_ERROR_MEMORY] = "memory",
+};
+
+size_t http_histogram_bucket(uint64_t value) {
+    if (value < HTTP_HISTOGRAM_SUB_BUCKETS)
+        return value;
+    unsigned top = 63 - __builtin_clzll(value);
+    if (top >= HTTP_HISTOGRAM_MAX_BITS)
+        return HTTP_HISTOGRAM_BUCKETS - 1;
+    unsigned shift = top - HTTP_HISTOGRAM_SUB_BITS;
+    return (size_t)(shift + 1) * HTTP_HISTOGRAM_SUB_BUCKETS +
+           ((value >> shift) & (HTTP_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+uint64_t http_histogram_bucketEnd(size_t bucket) {
+    if (bucket < HTTP_HISTOGRAM_SUB_BUCKETS)
+        return bucket + 1;
+    size_t shift = bucket / HTTP_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t sub = bucket % HTTP_HISTOGRAM_SUB_BUCKETS;
+    return (HTTP_HISTOGRAM_SUB_BUCKETS + sub + 1) << shift;
+}
+
+void http_histogram_record(http_histogram *this, uint64_t value) {
+    http_metrics_bump(&this->buckets[http_histogram_bucket(value)], 1);
+    http_metrics_bump(&this->count, 1);
+    http_metrics_bump(&this->sum, value);
+}
+
+uint64_t http_histogram_percentile(const http_histogram *this, double percentile) {
+    uint64_t count = atomic_load_explicit(&this->count, memory_order_relaxed);
+    if (count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * count + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HTTP_HISTOGRAM_BUCKETS; i++) {
+        seen += atomic_load_explicit(&this->buckets[i], memory_order_relaxed);
+        if (seen >= rank)
+            return http_histogram_bucketEnd(i);
+    }
+    return http_histogram_bucketEnd(HTTP_HISTOGRAM_BUCKETS - 1);
+}
+
+/**
+ * Adds value read from a running worker to a total nobody else sees
+ */
+static void http_metrics_sum(_Atomic uint64_t *total, const _Atomic uint64_t *value) {
+    http_metrics_bump(total, atomic_load_explicit(value, memory_order_relaxed));
+}
+
+void http_metrics_merge(http_metrics *total, const http_metrics *metrics, size_t count) {
+    memset(total, 0, sizeof(*total));
+    for (size_t w = 0; w < count; w++) {
+        const http_metrics *worker = &metrics[w];
+        for (size_t i = 0; i < HTTP_COUNTER_COUNT; i++)
+            http_metrics_sum(&total->counters[i], &worker->counters[i]);
+        for (size_t i = 0; i < HTTP_PARSE_ERROR_COUNT; i++)
+            http_metrics_sum(&total->parse_errors[i], &worker->parse_errors[i]);
+        for (size_t s = 0; s < HTTP_STAGE_COUNT; s++) {
+            http_histogram *into = &total->stages[s];
+            const http_histogram *from = &worker->stages[s];
+            http_metrics_sum(&into->count, &from->count);
+            http_metrics_sum(&into->sum, &from->sum);
+            for (size_t i = 0; i < HTTP_HISTOGRAM_BUCKETS; i++)
+                http_metrics_sum(&into->buckets[i], &from->buckets[i]);
+        }
+    }
+}
+
+static uint64_t http_metrics_get(const _Atomic uint64_t *value) {
+    return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+/**
+ * Appends a counter or gauge with its HELP and TYPE lines
+ */
+static sds http_metrics_renderValue(sds out, const char *name, const char *type,
+                                    const char *help, uint64_t value) {
+    return sdscatprintf(out, "# HELP %s %s\n# TYPE %s %s\n%s %" PRIu64 "\n", name, help,
+                        name, type, name, value);
+}
+
+/**
+ * Appends the buckets, sum and count of one stage. The count is taken
+ * from the buckets so it always matches the +Inf bucket.
+ */
+static sds http_metrics_renderStage(sds out, const char *stage, const http_histogram *h) {
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (size_t i = 0; out && i < sizeof(http_metrics_bounds) / sizeof(http_metrics_bounds[0]);
+         i++) {
+        uint64_t bound = http_metrics_bounds[i];
+        while (bucket < HTTP_HISTOGRAM_BUCKETS && http_histogram_bucketEnd(bucket) - 1 <= bound)
+            cumulative += http_metrics_get(&h->buckets[bucket++]);
+        out = sdscatprintf(out,
+                           "http_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %" PRIu64
+                           "\n",
+                           stage, bound / 1e9, cumulative);
+    }
+    while (bucket < HTTP_HISTOGRAM_BUCKETS)
+        cumulative += http_metrics_get(&h->buckets[bucket++]);
+
+    if (out)
+        out = sdscatprintf(out,
+                           "http_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %" PRIu64
+                           "\n"
+                           "http_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n"
+                           "http_stage_duration_seconds_count{stage=\"%s\"} %" PRIu64 "\n",
+                           stage, cumulative, stage, http_metrics_get(&h->sum) / 1e9, stage,
+                           cumulative);
+    return out;
+}
+
+sds http_metrics_render(const http_metrics *metrics, size_t count) {
+    http_metrics *total = http_malloc(sizeof(http_metrics));
+    if (!total)
+        return NULL;
+    http_metrics_merge(total, metrics, count);
+
+    uint64_t opened = http_metrics_get(&total->counters[HTTP_COUNTER_CONNECTIONS_OPENED]);
+    uint64_t closed = http_metrics_get(&total->counters[HTTP_COUNTER_CONNECTIONS_CLOSED]);
+    // Counters of different workers are read at slightly different times
+    uint64_t active = opened > closed ? opened - closed : 0;
+
+    sds out = sdsempty();
+    if (out)
+        out = http_metrics_renderValue(out, "http_connections_opened_total", "counter",
+                                       "Connections accepted.", opened);
+    if (out)
+        out = http_metrics_renderValue(out, "http_connections_closed_total", "counter",
+                                       "Connections closed.", closed);
+    if (out)
+        out = http_metrics_renderValue(out, "http_connections_active", "gauge",
+                                       "Connections currently open.", active);
+    if (out)
+        out = http_metrics_renderValue(
+            out, "http_requests_total", "counter", "Requests answered by a route.",
+            http_metrics_get(&total->counters[HTTP_COUNTER_REQUESTS]));
+    if (out)
+        out = http_metrics_renderValue(
+            out, "http_received_bytes_total", "counter", "Bytes read from clients.",
+            http_metrics_get(&total->counters[HTTP_COUNTER_BYTES_IN]));
+    if (out)
+        out = http_metrics_renderValue(
+            out, "http_sent_bytes_total", "counter", "Bytes written to clients.",
+            http_metrics_get(&total->counters[HTTP_COUNTER_BYTES_OUT]));
+
+    if (out)
+        out = sdscat(out, "# HELP http_parse_errors_total Requests rejected by the parser.\n"
+                          "# TYPE http_parse_errors_total counter\n");
+    for (size_t i = 0; out && i < HTTP_PARSE_ERROR_COUNT; i++) {
+        if (!http_metrics_reasonNames[i])
+            continue;
+        out = sdscatprintf(out, "http_parse_errors_total{reason=\"%s\"} %" PRIu64 "\n",
+                           http_metrics_reasonNames[i],
+                           http_metrics_get(&total->parse_errors[i]));
+    }
+
+    if (out)
+        out = sdscat(out, "# HELP http_stage_duration_seconds Time spent in each stage of "
+                          "serving a connection.\n"
+                          "# TYPE http_stage_duration_seconds histogram\n");
+    for (size_t s = 0; out && s < HTTP_STAGE_COUNT; s++)
+        out = http_metrics_renderStage(out, http_metrics_stageNames[s], &total->stages[s]);
+
+    http_free(total);
+    return out;
+}
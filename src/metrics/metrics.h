@@ -0,0 +1,195 @@
+#pragma once
+
+#include "request/parser.h"
+#include "sds.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Log-linear buckets of nanoseconds, 2^HTTP_HISTOGRAM_SUB_BITS per
+// power of two so a value is within 12.5% of its bucket. Durations of
+// 2^HTTP_HISTOGRAM_MAX_BITS ns (about 69 s) and up share the last one.
+#define HTTP_HISTOGRAM_SUB_BITS     3
+#define HTTP_HISTOGRAM_SUB_BUCKETS  (1u << HTTP_HISTOGRAM_SUB_BITS)
+#define HTTP_HISTOGRAM_MAX_BITS     36
+#define HTTP_HISTOGRAM_BUCKETS \
+    ((HTTP_HISTOGRAM_MAX_BITS - HTTP_HISTOGRAM_SUB_BITS + 1) * HTTP_HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Parts of serving a connection that are timed
+ */
+typedef enum http_stage {
+    // Accepting a connection and registering it with the event loop
+    HTTP_STAGE_ACCEPT,
+    // Moving received bytes into the connection buffer
+    HTTP_STAGE_READ,
+    // Parsing one request, over every read it took
+    HTTP_STAGE_PARSE,
+    // Routing, running the handler and serializing its response
+    HTTP_STAGE_HANDLE,
+    // Sending queued output
+    HTTP_STAGE_WRITE,
+    // From the read that brought a request in to its response queued
+    HTTP_STAGE_REQUEST,
+    HTTP_STAGE_COUNT,
+} http_stage;
+
+typedef enum http_counter {
+    HTTP_COUNTER_CONNECTIONS_OPENED,
+    HTTP_COUNTER_CONNECTIONS_CLOSED,
+    HTTP_COUNTER_REQUESTS,
+    HTTP_COUNTER_BYTES_IN,
+    HTTP_COUNTER_BYTES_OUT,
+    HTTP_COUNTER_COUNT,
+} http_counter;
+
+/**
+ * Latency histogram. Only its worker writes to it, scrapes from other
+ * threads read it as it goes, so every field is atomic but no update
+ * needs a locked instruction.
+ */
+typedef struct http_histogram {
+    _Atomic uint64_t    count;
+    // Nanoseconds
+    _Atomic uint64_t    sum;
+    _Atomic uint64_t    buckets[HTTP_HISTOGRAM_BUCKETS];
+} http_histogram;
+
+/**
+ * Counters and stage latencies of one worker. Scrapes add up every
+ * worker's without stopping them.
+ */
+typedef struct http_metrics {
+    _Atomic uint64_t    counters[HTTP_COUNTER_COUNT];
+    _Atomic uint64_t    parse_errors[HTTP_PARSE_ERROR_COUNT];
+    http_histogram      stages[HTTP_STAGE_COUNT];
+} http_metrics;
+
+/**
+ * Adds n to a value only the calling thread writes to. A plain load and
+ * store, readers may see it a little late but never torn.
+ */
+static inline void http_metrics_bump(_Atomic uint64_t *value, uint64_t n) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+/**
+ * Monotonic clock, in nanoseconds
+ */
+static inline uint64_t http_metrics_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Starts timing a stage
+ *
+ * @param this  Metrics, NULL when they are off
+ *
+ * @returns Start time to pass to http_metrics_stop, 0 when off
+ */
+static inline uint64_t http_metrics_start(const http_metrics *this) {
+    return this ? http_metrics_now() : 0;
+}
+
+/**
+ * Index of the bucket value falls in
+ */
+size_t          http_histogram_bucket(uint64_t value);
+
+/**
+ * Smallest value past bucket, in nanoseconds
+ */
+uint64_t        http_histogram_bucketEnd(size_t bucket);
+
+/**
+ * Records value. Must only be called by the thread owning this.
+ *
+ * @param this  Histogram
+ * @param value Nanoseconds
+ */
+void            http_histogram_record(http_histogram *this, uint64_t value);
+
+/**
+ * Upper bound of the bucket holding the value below which percentile
+ * percent of the recorded values fall
+ *
+ * @param this          Histogram
+ * @param percentile    0 to 100
+ *
+ * @returns Nanoseconds, 0 if nothing was recorded
+ */
+uint64_t        http_histogram_percentile(const http_histogram *this, double percentile);
+
+/**
+ * Records the time since start for stage
+ *
+ * @param this  Metrics, NULL when they are off
+ * @param stage Stage timed
+ * @param start Result of http_metrics_start
+ */
+static inline void http_metrics_stop(http_metrics *this, http_stage stage, uint64_t start) {
+    if (this)
+        http_histogram_record(&this->stages[stage], http_metrics_now() - start);
+}
+
+/**
+ * Records a duration measured by the caller
+ *
+ * @param this      Metrics, NULL when they are off
+ * @param stage     Stage timed
+ * @param elapsed   Nanoseconds
+ */
+static inline void http_metrics_record(http_metrics *this, http_stage stage, uint64_t elapsed) {
+    if (this)
+        http_histogram_record(&this->stages[stage], elapsed);
+}
+
+/**
+ * Adds n to counter
+ *
+ * @param this      Metrics, NULL when they are off
+ * @param counter   Counter
+ * @param n         Amount
+ */
+static inline void http_metrics_add(http_metrics *this, http_counter counter, uint64_t n) {
+    if (this)
+        http_metrics_bump(&this->counters[counter], n);
+}
+
+/**
+ * Counts a request rejected by the parser
+ *
+ * @param this      Metrics, NULL when they are off
+ * @param reason    Why, from http_parser.reason
+ */
+static inline void http_metrics_parseError(http_metrics *this, http_parse_error reason) {
+    if (this && reason < HTTP_PARSE_ERROR_COUNT)
+        http_metrics_bump(&this->parse_errors[reason], 1);
+}
+
+/**
+ * Adds up the metrics of count workers into total. Safe while the
+ * workers keep recording, each value is read once.
+ *
+ * @param total     Zeroed and filled with the sums
+ * @param metrics   Array of count metrics
+ * @param count     Number of workers
+ */
+void            http_metrics_merge(http_metrics *total, const http_metrics *metrics,
+                                   size_t count);
+
+/**
+ * Renders the sum of count workers' metrics in the Prometheus text
+ * exposition format
+ *
+ * @param metrics   Array of count metrics
+ * @param count     Number of workers
+ *
+ * @returns New sds or NULL when out of memory. Must free with sdsfree
+ */
+sds             http_metrics_render(const http_metrics *metrics, size_t count);
@@ -0,0 +1,205 @@
+#include "output.h"
+
+#include "http/alloc.h"
+#include "http/results.h"
+#include "sds.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+void http_output_init(http_output *this) {
+    this->head = NULL;
+    this->tail = NULL;
+    this->spare = NULL;
+    this->sent = 0;
+    this->pending = 0;
+}
+
+static void http_output_chunk_delete(http_output_chunk *this) {
+    sdsfree(this->data);
+    http_free(this->body);
+    http_file_release(this->file);
+    http_free(this);
+}
+
+void http_output_clear(http_output *this) {
+    while (this->head) {
+        http_output_chunk *next = this->head->next;
+        http_output_chunk_delete(this->head);
+        this->head = next;
+    }
+    this->tail = NULL;
+    this->sent = 0;
+    this->pending = 0;
+}
+
+void http_output_deinit(http_output *this) {
+    http_output_clear(this);
+    if (this->spare) {
+        http_output_chunk_delete(this->spare);
+        this->spare = NULL;
+    }
+}
+
+/**
+ * Appends an empty chunk, reusing the spare one when there is one
+ */
+static http_output_chunk *http_output_push(http_output *this) {
+    http_output_chunk *chunk = this->spare;
+    if (chunk) {
+        this->spare = NULL;
+    } else {
+        chunk = http_malloc(sizeof(http_output_chunk));
+        if (!chunk)
+            return NULL;
+        chunk->data = sdsempty();
+        if (!chunk->data) {
+            http_free(chunk);
+            return NULL;
+        }
+    }
+
+    chunk->body = NULL;
+    chunk->file = NULL;
+    chunk->file_offset = 0;
+    chunk->body_length = 0;
+    chunk->next = NULL;
+    if (this->tail)
+        this->tail->next = chunk;
+    else
+        this->head = chunk;
+    this->tail = chunk;
+
+    return chunk;
+}
+
+char *http_output_reserve(http_output *this, size_t len) {
+    // Bytes after a body would be sent before it, start a new chunk
+    http_output_chunk *chunk = this->tail;
+    if (!chunk || chunk->body_length) {
+        chunk = http_output_push(this);
+        if (!chunk)
+            return NULL;
+    }
+
+    sds data = sdsMakeRoomFor(chunk->data, len);
+    if (!data)
+        return NULL;
+    chunk->data = data;
+
+    char *dst = data + sdslen(data);
+    sdsIncrLen(data, len);
+    this->pending += len;
+    return dst;
+}
+
+ErrorMessage http_output_appendBody(http_output *this, void *body, size_t len) {
+    http_output_chunk *chunk = this->tail;
+    if (!chunk || chunk->body_length) {
+        chunk = http_output_push(this);
+        if (!chunk) {
+            http_free(body);
+            return "Failed to allocate memory";
+        }
+    }
+
+    chunk->body = body;
+    chunk->body_length = len;
+    this->pending += len;
+    return NULL;
+}
+
+ErrorMessage http_output_appendFile(http_output *this, http_file *file,
+                                  off_t offset, size_t length) {
+    if (length == 0) {
+        http_file_release(file);
+        return NULL;
+    }
+
+    http_output_chunk *chunk = this->tail;
+    if (!chunk || chunk->body_length) {
+        chunk = http_output_push(this);
+        if (!chunk) {
+            http_file_release(file);
+            return "Failed to allocate memory";
+        }
+    }
+
+    chunk->file = file;
+    chunk->file_offset = offset;
+    chunk->body_length = length;
+    this->pending += length;
+    return NULL;
+}
+
+size_t http_output_iovec(const http_output *this, struct iovec *iov, size_t max) {
+    size_t count = 0;
+    size_t skip = this->sent;
+
+    for (http_output_chunk *chunk = this->head; chunk && count < max; chunk = chunk->next) {
+        size_t data_len = sdslen(chunk->data);
+        if (skip < data_len) {
+            iov[count++] = (struct iovec){chunk->data + skip, data_len - skip};
+            skip = 0;
+        } else {
+            skip -= data_len;
+        }
+
+        // Files go through sendfile, nothing past one can be gathered
+        if (chunk->file)
+            break;
+
+        if (chunk->body_length > skip && count < max) {
+            iov[count++] = (struct iovec){(char *)chunk->body + skip,
+                                          chunk->body_length - skip};
+        }
+        skip = 0;
+    }
+
+    return count;
+}
+
+bool http_output_file(const http_output *this, int *fd, off_t *offset,
+                      size_t *length) {
+    http_output_chunk *chunk = this->head;
+    if (!chunk || !chunk->file || this->sent < sdslen(chunk->data))
+        return false;
+
+    size_t skip = this->sent - sdslen(chunk->data);
+    *fd = chunk->file->fd;
+    *offset = chunk->file_offset + skip;
+    *length = chunk->body_length - skip;
+    return true;
+}
+
+void http_output_consume(http_output *this, size_t n) {
+    this->pending -= n;
+    this->sent += n;
+
+    while (this->head) {
+        http_output_chunk *chunk = this->head;
+        size_t chunk_len = sdslen(chunk->data) + chunk->body_length;
+        if (this->sent < chunk_len)
+            break;
+
+        this->sent -= chunk_len;
+        this->head = chunk->next;
+        if (!this->head)
+            this->tail = NULL;
+
+        // Keep one chunk around so steady keep-alive traffic does not
+        // allocate, unless it grew past the usual response size
+        http_free(chunk->body);
+        http_file_release(chunk->file);
+        chunk->body = NULL;
+        chunk->file = NULL;
+        if (!this->spare && sdsalloc(chunk->data) <= HTTP_OUTPUT_SPARE_MAX) {
+            sdsclear(chunk->data);
+            this->spare = chunk;
+        } else {
+            sdsfree(chunk->data);
+            http_free(chunk);
+        }
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "file/file.h"
+#include "http/results.h"
+#include "sds.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Bodies up to this size are copied next to their head, a second
+// iovec costs more than the copy
+#define HTTP_OUTPUT_INLINE_BODY 1024
+#define HTTP_OUTPUT_MAX_IOVEC   16
+// Largest chunk buffer kept for reuse once drained
+#define HTTP_OUTPUT_SPARE_MAX   (16 * 1024)
+
+/**
+ * Queued output. data holds status lines, headers and small bodies of
+ * one or more responses. After data comes either body, a large body
+ * written in place and freed once sent, or a range of file sent
+ * straight from the page cache.
+ */
+typedef struct http_output_chunk {
+    sds                         data;
+    void*                       body;
+    http_file*                  file;
+    off_t                       file_offset;
+    size_t                      body_length;
+    struct http_output_chunk*   next;
+} http_output_chunk;
+
+/**
+ * Per-connection queue of bytes waiting for the socket, written with
+ * one vectored send per batch instead of being copied into one string
+ */
+typedef struct http_output {
+    http_output_chunk*  head;
+    http_output_chunk*  tail;
+    http_output_chunk*  spare;
+    // Bytes of head already written
+    size_t              sent;
+    size_t              pending;
+} http_output;
+
+/**
+ * Initializes an empty queue
+ *
+ * @param this  Queue
+ */
+void            http_output_init(http_output *this);
+
+/**
+ * Frees every queued chunk
+ *
+ * @param this  Queue
+ */
+void            http_output_deinit(http_output *this);
+
+/**
+ * Drops everything still queued, e.g. after a write error
+ *
+ * @param this  Queue
+ */
+void            http_output_clear(http_output *this);
+
+/**
+ * Reserves len bytes at the end of the queue for the caller to fill
+ *
+ * @param this  Queue
+ * @param len   Bytes to reserve
+ *
+ * @returns Where to write the len bytes, or NULL if out of memory
+ */
+char           *http_output_reserve(http_output *this, size_t len);
+
+/**
+ * Queues body to be written in place, without copying it
+ *
+ * @param this  Queue
+ * @param body  malloced buffer, owned by the queue even on error
+ * @param len   Bytes in body
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage    http_output_appendBody(http_output *this, void *body, size_t len);
+
+/**
+ * Queues length bytes of file from offset, sent without a user space
+ * copy
+ *
+ * @param this      Queue
+ * @param file      File, the queue takes over the caller's reference
+ * @param offset    First byte to send
+ * @param length    Bytes to send
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage    http_output_appendFile(http_output *this, http_file *file,
+                                       off_t offset, size_t length);
+
+/**
+ * Describes the next unsent bytes as an iovec array. Stops in front of
+ * a file range, see http_output_file.
+ *
+ * @param this  Queue
+ * @param iov   Array to fill
+ * @param max   Capacity of iov
+ *
+ * @returns Entries filled
+ */
+size_t          http_output_iovec(const http_output *this, struct iovec *iov, size_t max);
+
+/**
+ * Whether the next unsent bytes come from a file
+ *
+ * @param this      Queue
+ * @param fd        Set to the file descriptor
+ * @param offset    Set to the file offset of the next byte
+ * @param length    Set to the bytes left in the range
+ *
+ * @returns true if the next bytes must be sent from the file
+ */
+bool            http_output_file(const http_output *this, int *fd, off_t *offset,
+                                 size_t *length);
+
+/**
+ * Marks n bytes as written and releases finished chunks
+ *
+ * @param this  Queue
+ * @param n     Bytes the socket accepted
+ */
+void            http_output_consume(http_output *this, size_t n);
@@ -0,0 +1,392 @@
+#include "parser.h"
+#include "request_internal.h"
+
+#include "http/results.h"
+#include "scan/scan.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+void http_parser_init(http_parser *this) {
+    this->state = HTTP_PARSER_REQUEST_LINE;
+    this->line_start = 0;
+    this->scan = 0;
+    this->delim = SIZE_MAX;
+    this->body_start = 0;
+    this->content_length = 0;
+    this->has_content_length = false;
+    this->chunked = false;
+    this->stream_body = false;
+    this->body_remaining = 0;
+    this->body_length = 0;
+    this->trailer_size = 0;
+    this->chunk = NULL;
+    this->chunk_length = 0;
+    this->consumed = 0;
+    this->err = NULL;
+    this->reason = HTTP_PARSE_ERROR_NONE;
+}
+
+static http_parse_status http_parser_fail(http_parser *this, http_parse_error reason,
+                                          ErrorMessage err) {
+    this->err = err;
+    this->reason = reason;
+    return HTTP_PARSE_ERROR;
+}
+
+/**
+ * Reason to give for a malformed line in the current state
+ */
+static http_parse_error http_parser_lineError(const http_parser *this) {
+    switch (this->state) {
+    case HTTP_PARSER_REQUEST_LINE:
+        return HTTP_PARSE_ERROR_REQUEST_LINE;
+    case HTTP_PARSER_HEADERS:
+        return HTTP_PARSE_ERROR_HEADER;
+    default:
+        return HTTP_PARSE_ERROR_CHUNK;
+    }
+}
+
+/**
+ * Finds the next CRLF terminated line starting at this->line_start,
+ * rejecting control characters inside it and recording the first delim
+ * in this->delim. Resumes scanning where the last call stopped.
+ *
+ * @returns Length of the line without CRLF, or SIZE_MAX if incomplete
+ */
+static size_t http_parser_nextLine(http_parser *this, const char *data,
+                                   size_t len, char delim) {
+    size_t stop = http_scan_line(data, this->scan, len, delim, &this->delim);
+    if (stop == len || (data[stop] == '\r' && stop + 1 == len)) {
+        // CR may be the last byte so far, look at it again next time
+        this->scan = stop;
+        return SIZE_MAX;
+    }
+
+    if (data[stop] == '\n' || (data[stop] == '\r' && data[stop + 1] != '\n')) {
+        http_parser_fail(this, http_parser_lineError(this),
+                         "Malformed request: line not terminated by CRLF.");
+        return SIZE_MAX;
+    }
+    if (data[stop] != '\r') {
+        http_parser_fail(this, http_parser_lineError(this),
+                         "Malformed request: invalid character.");
+        return SIZE_MAX;
+    }
+
+    this->scan = stop + 2;
+    return stop - this->line_start;
+}
+
+static ErrorMessage http_parser_readContentLength(http_parser *this,
+                                                  http_request *req) {
+    http_header *header = http_request_knownHeader(req, HTTP_HEADER_CONTENT_LENGTH);
+    if (!header)
+        return NULL;
+
+    const char *value = header->value;
+
+    size_t content_length = 0;
+    if (*value == '\0')
+        return "Malformed request: empty Content-Length.";
+    for (const char *c = value; *c; c++) {
+        if (*c < '0' || *c > '9')
+            return "Malformed request: invalid Content-Length.";
+        if (content_length > (SIZE_MAX - 9) / 10)
+            return "Malformed request: Content-Length too large.";
+        content_length = content_length * 10 + (*c - '0');
+    }
+
+    this->content_length = content_length;
+    this->has_content_length = true;
+    this->body_remaining = content_length;
+    return NULL;
+}
+
+static ErrorMessage http_parser_readFraming(http_parser *this, http_request *req) {
+    http_header *header = http_request_knownHeader(req, HTTP_HEADER_TRANSFER_ENCODING);
+    if (!header)
+        return http_parser_readContentLength(this, req);
+
+    // Other codings would have to be undone before chunked
+    if (strcasecmp(header->value, "chunked") != 0)
+        return "Malformed request: unsupported Transfer-Encoding.";
+    // Either one could be trusted by a proxy in front of us
+    if (http_request_knownHeader(req, HTTP_HEADER_CONTENT_LENGTH))
+        return "Malformed request: both Transfer-Encoding and Content-Length.";
+
+    this->chunked = true;
+    return NULL;
+}
+
+static int http_parser_hex(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/**
+ * Reads the size of a chunk-size line, extensions after delim are
+ * ignored
+ */
+static ErrorMessage http_parser_readChunkSize(http_parser *this, const char *line,
+                                              size_t len, size_t delim) {
+    size_t end = delim == SIZE_MAX ? len : delim;
+    while (end > 0 && (line[end - 1] == ' ' || line[end - 1] == '\t'))
+        end--;
+    if (end == 0)
+        return "Malformed request: missing chunk size.";
+
+    size_t size = 0;
+    for (size_t i = 0; i < end; i++) {
+        int digit = http_parser_hex(line[i]);
+        if (digit < 0)
+            return "Malformed request: invalid chunk size.";
+        if (size > (SIZE_MAX >> 4))
+            return "Malformed request: chunk size too large.";
+        size = size << 4 | (size_t)digit;
+    }
+    if (size > SIZE_MAX - this->body_length)
+        return "Malformed request: chunked body too large.";
+
+    this->body_remaining = size;
+    return NULL;
+}
+
+/**
+ * Decodes a chunked body already validated by the parser into dst,
+ * which may be raw itself as the output never overtakes the input
+ */
+static void http_parser_dechunk(const char *raw, char *dst) {
+    while (true) {
+        size_t size = 0;
+        for (int digit; (digit = http_parser_hex(*raw)) >= 0; raw++)
+            size = size << 4 | (size_t)digit;
+        while (*raw++ != '\n')
+            ;
+        if (size == 0)
+            return;
+
+        memmove(dst, raw, size);
+        dst += size;
+        raw += size + 2;
+    }
+}
+
+/**
+ * Hands out up to len bytes at this->line_start as a body piece when
+ * streaming
+ *
+ * @returns Bytes taken
+ */
+static size_t http_parser_takeBody(http_parser *this, const char *data, size_t len) {
+    size_t n = len - this->line_start;
+    if (n > this->body_remaining)
+        n = this->body_remaining;
+
+    this->chunk = data + this->line_start;
+    this->chunk_length = n;
+    this->line_start += n;
+    this->scan = this->line_start;
+    this->body_remaining -= n;
+    this->body_length += n;
+    return n;
+}
+
+static http_parse_status http_parser_finish(http_parser *this, http_request *req,
+                                            const char *data) {
+    if (this->chunked && !this->stream_body && this->body_length > 0) {
+        char *body = http_request_allocBody(req, (char *)data + this->body_start,
+                                            this->body_length);
+        if (!body)
+            return http_parser_fail(this, HTTP_PARSE_ERROR_MEMORY, "No more memory.");
+        http_parser_dechunk(data + this->body_start, body);
+    }
+
+    this->consumed = this->line_start;
+    this->state = HTTP_PARSER_DONE;
+    return HTTP_PARSE_COMPLETE;
+}
+
+/**
+ * Walks a chunked body from this->line_start
+ */
+static http_parse_status http_parser_feedChunked(http_parser *this, http_request *req,
+                                                 const char *data, size_t len) {
+    while (true) {
+        switch (this->state) {
+        case HTTP_PARSER_CHUNK_SIZE: {
+            size_t line_len = http_parser_nextLine(this, data, len, ';');
+            if (this->err)
+                return HTTP_PARSE_ERROR;
+            if (line_len == SIZE_MAX) {
+                if (len - this->line_start > HTTP_PARSER_MAX_CHUNK_LINE)
+                    return http_parser_fail(this, HTTP_PARSE_ERROR_CHUNK,
+                                            "Malformed request: chunk size line too long.");
+                return HTTP_PARSE_INCOMPLETE;
+            }
+
+            size_t delim = this->delim == SIZE_MAX ? SIZE_MAX : this->delim - this->line_start;
+            ErrorMessage err =
+                http_parser_readChunkSize(this, data + this->line_start, line_len, delim);
+            if (err)
+                return http_parser_fail(this, HTTP_PARSE_ERROR_CHUNK, err);
+            this->line_start = this->scan;
+            this->delim = SIZE_MAX;
+            this->state = this->body_remaining > 0 ? HTTP_PARSER_CHUNK_DATA
+                                                   : HTTP_PARSER_TRAILERS;
+            break;
+        }
+        case HTTP_PARSER_CHUNK_DATA:
+            if (len == this->line_start)
+                return HTTP_PARSE_INCOMPLETE;
+            http_parser_takeBody(this, data, len);
+            if (this->body_remaining == 0)
+                this->state = HTTP_PARSER_CHUNK_END;
+            if (this->stream_body)
+                return HTTP_PARSE_BODY_CHUNK;
+            break;
+        case HTTP_PARSER_CHUNK_END:
+            if (len - this->line_start < 2)
+                return HTTP_PARSE_INCOMPLETE;
+            if (data[this->line_start] != '\r' || data[this->line_start + 1] != '\n')
+                return http_parser_fail(this, HTTP_PARSE_ERROR_CHUNK,
+                                        "Malformed request: chunk not terminated by CRLF.");
+            this->line_start += 2;
+            this->scan = this->line_start;
+            this->state = HTTP_PARSER_CHUNK_SIZE;
+            break;
+        case HTTP_PARSER_TRAILERS: {
+            size_t line_len = http_parser_nextLine(this, data, len, ':');
+            if (this->err)
+                return HTTP_PARSE_ERROR;
+            if (line_len == SIZE_MAX) {
+                if (this->trailer_size + len - this->line_start > HTTP_PARSER_MAX_HEADER_SIZE)
+                    return http_parser_fail(this, HTTP_PARSE_ERROR_CHUNK,
+                                            "Malformed request: trailer section too large.");
+                return HTTP_PARSE_INCOMPLETE;
+            }
+
+            // Trailer fields are dropped, not merged into the header
+            this->trailer_size += line_len + 2;
+            this->line_start = this->scan;
+            this->delim = SIZE_MAX;
+            if (line_len == 0)
+                return http_parser_finish(this, req, data);
+            break;
+        }
+        default:
+            return HTTP_PARSE_COMPLETE;
+        }
+    }
+}
+
+http_parse_status http_parser_feed(http_parser *this, http_request *req,
+                                   const char *data, size_t len) {
+    if (this->err)
+        return HTTP_PARSE_ERROR;
+
+    // Views from earlier feeds may point into the old buffer
+    http_request_rebase(req, data);
+
+    bool headers_completed = false;
+    while (this->state == HTTP_PARSER_REQUEST_LINE ||
+           this->state == HTTP_PARSER_HEADERS) {
+        char delim = this->state == HTTP_PARSER_REQUEST_LINE ? ' ' : ':';
+        size_t line_len = http_parser_nextLine(this, data, len, delim);
+        if (this->err)
+            return HTTP_PARSE_ERROR;
+        if (line_len == SIZE_MAX) {
+            if (len > HTTP_PARSER_MAX_HEADER_SIZE)
+                return http_parser_fail(this, HTTP_PARSE_ERROR_HEAD_TOO_LARGE,
+                                        "Malformed request: header block too large.");
+            return HTTP_PARSE_INCOMPLETE;
+        }
+
+        const char *line = data + this->line_start;
+        size_t line_delim = this->delim == SIZE_MAX ? SIZE_MAX : this->delim - this->line_start;
+        this->line_start = this->scan;
+        this->delim = SIZE_MAX;
+
+        if (this->state == HTTP_PARSER_REQUEST_LINE) {
+            ErrorMessage err = parse_request_line(req, line, line_len, line_delim);
+            if (err)
+                return http_parser_fail(this, HTTP_PARSE_ERROR_REQUEST_LINE, err);
+            this->state = HTTP_PARSER_HEADERS;
+            continue;
+        }
+
+        if (line_len == 0) {
+            ErrorMessage err = http_request_finishHead(req, data, this->line_start);
+            if (err)
+                return http_parser_fail(this, HTTP_PARSE_ERROR_MEMORY, err);
+            err = http_parser_readFraming(this, req);
+            if (err)
+                return http_parser_fail(this, HTTP_PARSE_ERROR_FRAMING, err);
+            this->body_start = this->line_start;
+            this->state = this->chunked ? HTTP_PARSER_CHUNK_SIZE : HTTP_PARSER_BODY;
+            headers_completed = true;
+            break;
+        }
+
+        http_header_id id;
+        ErrorMessage err = parse_single_header(req, line, line_len, line_delim, &id);
+        if (err) {
+            bool framing = id == HTTP_HEADER_CONTENT_LENGTH || id == HTTP_HEADER_TRANSFER_ENCODING;
+            return http_parser_fail(
+                this, framing ? HTTP_PARSE_ERROR_FRAMING : HTTP_PARSE_ERROR_HEADER, err);
+        }
+    }
+
+    // Lets the caller pick streaming before any of the body is walked
+    if (this->chunked)
+        return headers_completed ? HTTP_PARSE_HEADERS_COMPLETE
+                                 : http_parser_feedChunked(this, req, data, len);
+
+    if (this->state == HTTP_PARSER_BODY && this->stream_body) {
+        if (this->body_remaining == 0)
+            return http_parser_finish(this, req, data);
+        if (len == this->line_start)
+            return HTTP_PARSE_INCOMPLETE;
+        http_parser_takeBody(this, data, len);
+        return HTTP_PARSE_BODY_CHUNK;
+    }
+
+    if (this->state == HTTP_PARSER_BODY) {
+        if (len - this->body_start < this->content_length)
+            return headers_completed ? HTTP_PARSE_HEADERS_COMPLETE
+                                     : HTTP_PARSE_INCOMPLETE;
+
+        if (this->content_length > 0) {
+            ErrorMessage err =
+                http_request_setBody(req, data + this->body_start, this->content_length);
+            if (err)
+                return http_parser_fail(this, HTTP_PARSE_ERROR_MEMORY, err);
+        }
+
+        this->consumed = this->body_start + this->content_length;
+        this->state = HTTP_PARSER_DONE;
+    }
+
+    return HTTP_PARSE_COMPLETE;
+}
+
+size_t http_parser_release(http_parser *this) {
+    if (!this->stream_body)
+        return 0;
+
+    size_t n = this->line_start - this->body_start;
+    this->line_start -= n;
+    this->scan -= n;
+    if (this->delim != SIZE_MAX)
+        this->delim -= n;
+    this->chunk = NULL;
+    this->chunk_length = 0;
+    return n;
+}
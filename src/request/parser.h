@@ -0,0 +1,123 @@
+#pragma once
+
+#include "http/request.h"
+#include "http/results.h"
+
+#include <stddef.h>
+
+#define HTTP_PARSER_MAX_HEADER_SIZE (64 * 1024)
+// Longest chunk-size line, extensions included
+#define HTTP_PARSER_MAX_CHUNK_LINE  1024
+
+typedef enum http_parse_status {
+    HTTP_PARSE_ERROR = -1,
+    HTTP_PARSE_INCOMPLETE = 0,
+    HTTP_PARSE_HEADERS_COMPLETE,
+    HTTP_PARSE_BODY_CHUNK,
+    HTTP_PARSE_COMPLETE,
+} http_parse_status;
+
+/**
+ * Why a request was rejected, set alongside err
+ */
+typedef enum http_parse_error {
+    HTTP_PARSE_ERROR_NONE,
+    HTTP_PARSE_ERROR_REQUEST_LINE,
+    HTTP_PARSE_ERROR_HEADER,
+    HTTP_PARSE_ERROR_HEAD_TOO_LARGE,
+    // Content-Length or Transfer-Encoding
+    HTTP_PARSE_ERROR_FRAMING,
+    HTTP_PARSE_ERROR_CHUNK,
+    HTTP_PARSE_ERROR_MEMORY,
+    HTTP_PARSE_ERROR_COUNT,
+} http_parse_error;
+
+typedef enum http_parser_state {
+    HTTP_PARSER_REQUEST_LINE,
+    HTTP_PARSER_HEADERS,
+    HTTP_PARSER_BODY,
+    HTTP_PARSER_CHUNK_SIZE,
+    HTTP_PARSER_CHUNK_DATA,
+    HTTP_PARSER_CHUNK_END,
+    HTTP_PARSER_TRAILERS,
+    HTTP_PARSER_DONE,
+} http_parser_state;
+
+/**
+ * Resumable HTTP/1.x request parser.
+ * Offsets are relative to the start of the request in the buffer
+ * handed to http_parser_feed, so the buffer may be reallocated
+ * between calls as long as its contents are kept.
+ *
+ * Bodies are framed by Content-Length or chunked Transfer-Encoding.
+ * By default the whole body is collected into the request. With
+ * stream_body set it is handed out piece by piece instead, see
+ * HTTP_PARSE_BODY_CHUNK and http_parser_release.
+ */
+typedef struct http_parser {
+    http_parser_state   state;
+    size_t              line_start;
+    size_t              scan;
+    // First delimiter of the line being scanned, SIZE_MAX if none yet
+    size_t              delim;
+    size_t              body_start;
+    size_t              content_length;
+    bool                has_content_length;
+    bool                chunked;
+    bool                stream_body;
+    // Body bytes left in the current chunk, or in a streamed
+    // Content-Length body
+    size_t              body_remaining;
+    // Decoded body bytes seen so far
+    size_t              body_length;
+    size_t              trailer_size;
+    // Decoded body piece of the last HTTP_PARSE_BODY_CHUNK, points into
+    // the fed buffer
+    const char*         chunk;
+    size_t              chunk_length;
+    size_t              consumed;
+    ErrorMessage        err;
+    http_parse_error    reason;
+} http_parser;
+
+/**
+ * Resets parser to expect a new request
+ *
+ * @param this  Parser
+ */
+void                http_parser_init(http_parser *this);
+
+/**
+ * Continues parsing a request. data must hold every byte fed so far
+ * followed by any newly received bytes, only the new bytes are scanned.
+ * In zero-copy mode the request keeps views into data, so data must be
+ * writable and outlive the request.
+ *
+ * @param this  Parser
+ * @param req   Request being filled, must come from http_request_new
+ * @param data  Buffer starting at the first byte of the request
+ * @param len   Bytes available in data
+ *
+ * @returns HTTP_PARSE_INCOMPLETE when more data is needed,
+ * HTTP_PARSE_HEADERS_COMPLETE once when the header block is done but
+ * the body is still missing or chunked, in which case feeding again
+ * goes on with the body, HTTP_PARSE_BODY_CHUNK when stream_body is set
+ * and this->chunk holds the next piece of body, HTTP_PARSE_COMPLETE
+ * when the whole request is parsed (this->consumed holds its size) or
+ * HTTP_PARSE_ERROR with this->err and this->reason set
+ */
+http_parse_status   http_parser_feed(http_parser *this, http_request *req,
+                                     const char *data, size_t len);
+
+/**
+ * Forgets the raw body bytes already walked while streaming, chunk
+ * framing included. May be called after any feed. The caller must cut
+ * that many bytes out of its buffer, starting at this->body_start,
+ * before feeding again, which keeps a streamed body from piling up in
+ * memory. this->chunk is invalid afterwards.
+ *
+ * @param this  Parser
+ *
+ * @returns Number of bytes to cut
+ */
+size_t              http_parser_release(http_parser *this);
@@ -1,14 +1,16 @@
 #include "request_internal.h"
+#include "parser.h"
 #include <http/request.h>
 
+#include "http/alloc.h"
 #include "http/body.h"
 #include "http/results.h"
 #include "http/version.h"
 
+#include "arena/arena.h"
 #include "logger/logger.h"
-#include "map/map.h"
-#include "sds.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <stddef.h>
@@ -16,17 +18,49 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 DEFINE_RESULT_TYPE(http_request *, HTTPRequestResult);
 
 HTTPRequestResult http_request_new(void) {
-    http_request *req = malloc(sizeof(http_request));
+    http_arena arena;
+    http_arena_init(&arena, 0);
+
+    HTTPRequestResult res = http_request_newInArena(&arena);
+    if (!res.Ok) {
+        http_arena_deinit(&arena);
+        return res;
+    }
+
+    // The request carries its own arena, living in its first block
+    http_request *req = res.Value;
+    req->own_arena = arena;
+    req->arena = &req->own_arena;
+
+    return res;
+}
+
+HTTPRequestResult http_request_newInArena(http_arena *arena) {
+    http_request *req = http_arena_alloc(arena, sizeof(http_request));
+    if (!req)
+        return HTTPRequestResult_Error("Failed to allocate memory");
+    req->arena = arena;
     http_body_init(&req->body);
+    req->body_fd = -1;
     req->header = NULL;
+    req->header_count = 0;
+    req->header_capacity = 0;
+    memset(req->hot_header, 0, sizeof(req->hot_header));
     req->method = NULL;
+    req->method_length = 0;
     req->uri = NULL;
+    req->uri_length = 0;
     req->version.major = 1;
     req->version.minor = 1;
+    req->zero_copy = false;
+    req->base = NULL;
+    req->head = NULL;
+    req->param_count = 0;
 
     return HTTPRequestResult_Ok(req);
 }
@@ -36,79 +70,227 @@ ErrorMessage http_request_parse(http_request *this, const char *data,
     if (!this)
         return "This is null";
 
-    const char *header_end = NULL;
-    const char *line_end = NULL;
-
-    size_t key_count;
-
-    header_end = strstr(data, "\r\n\r\n");
-    if (header_end == NULL)
-        return "Malformed request: Missing header-body separator.";
+    http_parser parser;
+    http_parser_init(&parser);
 
-    size_t headers_len = header_end - data;
+    http_parse_status status = http_parser_feed(&parser, this, data, len);
+    // Chunked bodies are walked by a second feed
+    if (status == HTTP_PARSE_HEADERS_COMPLETE && parser.chunked)
+        status = http_parser_feed(&parser, this, data, len);
 
-    this->method = NULL;
-    this->uri = NULL;
-    this->version.major = UINT8_MAX;
-    this->version.minor = UINT8_MAX;
-    this->header = NULL;
-    this->body.length = 0;
-    this->body.data = NULL;
-
-    line_end = strstr(data, "\r\n");
-    if (line_end == NULL || line_end > header_end) {
-        return "Malformed request: Cannot find end of request line.";
+    switch (status) {
+    case HTTP_PARSE_ERROR:
+        return parser.err;
+    case HTTP_PARSE_INCOMPLETE:
+        if (parser.state == HTTP_PARSER_REQUEST_LINE || parser.state == HTTP_PARSER_HEADERS)
+            return "Malformed request: Missing header-body separator.";
+        return "Content headers do not match body";
+    case HTTP_PARSE_HEADERS_COMPLETE:
+    case HTTP_PARSE_BODY_CHUNK:
+        return "Content headers do not match body";
+    case HTTP_PARSE_COMPLETE:
+        break;
     }
-    ErrorMessage errPRL = parse_request_line(this, data, line_end - data);
-    if (errPRL != NULL)
-        return errPRL;
-
-    ErrorMessage errPH =
-        parse_headers(this, line_end + 2, headers_len - (line_end - data) - 2);
-    if (errPH != 0)
-        return errPH;
 
-    const char *body_start = header_end + strlen("\r\n\r\n");
-    size_t body_len = len - (body_start - data);
+    // The whole request is in data, so without Content-Length
+    // everything after the header block is the body
+    if (parser.consumed < len) {
+        if (parser.has_content_length || parser.chunked)
+            return "Content headers do not match body";
 
-    if (body_len > 0) {
         ErrorMessage errBody =
-            http_body_initWithBody(&this->body, (void *)body_start, body_len);
+            http_request_setBody(this, data + parser.consumed, len - parser.consumed);
         if (errBody)
             return errBody;
-    } else {
-        this->body.data = NULL;
     }
 
-    if (!validate_content_headers(this))
-        return "Content headers do not match body";
-
     return NULL;
 }
 
 void http_request_delete(http_request *this) {
     if (this) {
-        if (this->method)
-            sdsfree(this->method);
-        if (this->uri)
-            sdsfree(this->uri);
-        if (this->header)
-            map_delete(this->header);
-        if (this->body.data)
-            free(this->body.data);
-        free(this);
+        // Everything, this included, lives in the arena
+        if (this->arena == &this->own_arena) {
+            http_arena arena = this->own_arena;
+            http_arena_deinit(&arena);
+        } else {
+            http_arena_reset(this->arena);
+        }
     }
 }
 
-ErrorMessage parse_request_line(http_request *req, const char *data,
-                                size_t len) {
-    size_t sp1 = 0, sp2 = 0;
+ErrorMessage http_request_SetZeroCopy(http_request *this, bool zero_copy) {
+    if (!this)
+        return "This is null";
+    if (this->base)
+        return "Cannot change zero-copy mode after parsing started";
+
+    this->zero_copy = zero_copy;
+    return NULL;
+}
+
+void http_request_rebase(http_request *req, const char *data) {
+    if (req->head || req->base == data)
+        return;
+    if (!req->base) {
+        req->base = data;
+        return;
+    }
+
+    // Same bytes at a new address, shift every view by the move
+    uintptr_t delta = (uintptr_t)data - (uintptr_t)req->base;
+#define HTTP_REBASE(p) ((p) = (void *)((uintptr_t)(p) + delta))
+    if (req->method)
+        HTTP_REBASE(req->method);
+    if (req->uri)
+        HTTP_REBASE(req->uri);
+    for (size_t i = 0; i < req->header_count; i++) {
+        if (!req->header[i].owned) {
+            HTTP_REBASE(req->header[i].key);
+            HTTP_REBASE(req->header[i].value);
+        }
+    }
+    if (req->body.data && req->body_fd < 0)
+        HTTP_REBASE(req->body.data);
+#undef HTTP_REBASE
+
+    req->base = data;
+}
+
+ErrorMessage http_request_finishHead(http_request *req, const char *data,
+                                     size_t len) {
+    http_request_rebase(req, data);
+
+    if (!req->zero_copy) {
+        char *head = http_arena_strndup(req->arena, data, len);
+        if (!head)
+            return "Failed to allocate memory for request head.";
+        http_request_rebase(req, head);
+        req->head = head;
+    }
+
+    // Every view ends on a separator (' ', ':' or '\r') inside the
+    // head, so terminating in place never clobbers another view
+    req->method[req->method_length] = '\0';
+    req->uri[req->uri_length] = '\0';
+    for (size_t i = 0; i < req->header_count; i++) {
+        http_header *header = &req->header[i];
+        if (header->owned)
+            continue;
+        for (size_t j = 0; j < header->key_length; j++)
+            header->key[j] = tolower((unsigned char)header->key[j]);
+        header->key[header->key_length] = '\0';
+        header->value[header->value_length] = '\0';
+    }
+
+    return NULL;
+}
+
+ErrorMessage http_request_setBody(http_request *req, const char *data,
+                                  size_t len) {
+    if (req->zero_copy) {
+        req->body.data = (void *)data;
+        req->body.length = len;
+        return NULL;
+    }
+
+    void *body = http_arena_alloc(req->arena, len);
+    if (!body)
+        return "No more memory.";
+    memcpy(body, data, len);
+    req->body.data = body;
+    req->body.length = len;
+    return NULL;
+}
+
+void http_request_setBodyFile(http_request *req, void *data, size_t len, int fd) {
+    req->body.data = data;
+    req->body.length = len;
+    req->body_fd = fd;
+}
+
+char *http_request_allocBody(http_request *req, char *in_place, size_t len) {
+    char *body = req->zero_copy ? in_place : http_arena_alloc(req->arena, len);
+    if (!body)
+        return NULL;
+
+    req->body.data = body;
+    req->body.length = len;
+    return body;
+}
+
+/**
+ * Finds the header named key of id, key is only compared for unknown
+ * names
+ */
+static http_header *http_request_lookupHeader(http_request *req, http_header_id id,
+                                              const char *key, size_t key_len) {
+    if (id != HTTP_HEADER_UNKNOWN)
+        return http_request_knownHeader(req, id);
+
+    for (size_t i = 0; i < req->header_count; i++) {
+        http_header *header = &req->header[i];
+        if (header->id == HTTP_HEADER_UNKNOWN && header->key_length == key_len &&
+            strncasecmp(header->key, key, key_len) == 0)
+            return header;
+    }
+    return NULL;
+}
+
+http_header *http_request_findHeader(http_request *req, const char *key) {
+    size_t key_len = strlen(key);
+    return http_request_lookupHeader(req, http_header_lookup(key, key_len), key, key_len);
+}
+
+http_header *http_request_knownHeader(http_request *req, http_header_id id) {
+    if (id == HTTP_HEADER_UNKNOWN)
+        return NULL;
+    if (id <= HTTP_HEADER_HOT_COUNT) {
+        uint32_t index = req->hot_header[id - 1];
+        return index ? &req->header[index - 1] : NULL;
+    }
+
+    for (size_t i = 0; i < req->header_count; i++) {
+        if (req->header[i].id == id)
+            return &req->header[i];
+    }
+    return NULL;
+}
 
-    for (size_t i = 0; i < len && (!sp1 || !sp2); i++) {
-        if (!sp1 && data[i] == ' ')
-            sp1 = i;
-        else if (sp1 && !sp2 && data[i] == ' ')
-            sp2 = i;
+/**
+ * Appends an empty header slot for id, spilling from the inline array
+ * to the arena once it is full
+ *
+ * @returns New slot or NULL if out of memory
+ */
+static http_header *http_request_addHeader(http_request *req, http_header_id id) {
+    if (!req->header) {
+        req->header = req->inline_header;
+        req->header_capacity = HTTP_REQUEST_INLINE_HEADERS;
+    }
+
+    if (req->header_count == req->header_capacity) {
+        size_t capacity = req->header_capacity * 2;
+        http_header *header = http_arena_alloc(req->arena, capacity * sizeof(http_header));
+        if (!header)
+            return NULL;
+        memcpy(header, req->header, req->header_count * sizeof(http_header));
+        req->header = header;
+        req->header_capacity = capacity;
+    }
+
+    if (id != HTTP_HEADER_UNKNOWN && id <= HTTP_HEADER_HOT_COUNT)
+        req->hot_header[id - 1] = req->header_count + 1;
+    return &req->header[req->header_count++];
+}
+
+ErrorMessage parse_request_line(http_request *req, const char *data,
+                                size_t len, size_t delim) {
+    size_t sp1 = delim == SIZE_MAX ? 0 : delim;
+    size_t sp2 = 0;
+    if (sp1) {
+        const char *sp = memchr(data + sp1 + 1, ' ', len - sp1 - 1);
+        sp2 = sp ? (size_t)(sp - data) : 0;
     }
 
     if (!sp1 || !sp2 || sp2 == sp1 + 1)
@@ -128,8 +310,11 @@ ErrorMessage parse_request_line(http_request *req, const char *data,
         return "Malformed requiest line: Missing HTTP version or junk "
                "characters at the end.";
 
-    req->method = sdsnewlen(data + method_start, method_len);
-    req->uri = sdsnewlen(data + uri_start, uri_len);
+    // Views only, terminated in place by http_request_finishHead
+    req->method = (char *)data + method_start;
+    req->method_length = method_len;
+    req->uri = (char *)data + uri_start;
+    req->uri_length = uri_len;
 
     char version_str[10];
     if (version_len >= 9)
@@ -155,77 +340,65 @@ ErrorMessage parse_request_line(http_request *req, const char *data,
         if (!http_version_isValid(&req->version))
             return "Malformed request line: invalid HTTP version.";
 
-    if (!req->method || !req->uri)
-        return "Failed to allocate memory for request line components.";
-
     return NULL;
 }
 
-ErrorMessage parse_headers(http_request *req, const char *data, size_t len) {
-    const char *cur_line = data;
-    const char *block_end = data + len;
-    const char *line_end = NULL;
-    size_t line_len = 0;
-
-    if (len == 0)
-        return 0;
-
-    while (cur_line < block_end) {
-        line_end = strstr(cur_line, "\r\n");
-        if (line_end == NULL)
-            return "Malformed header block: unterminated line.";
-
-        if (line_end > block_end)
-            return "Malformed header block: delimiter extends into body.";
-
-        line_len = line_end - cur_line;
-
-        const char *err = parse_single_header(req, cur_line, line_len);
-        if (err != NULL)
-            return err;
-
-        cur_line = line_end + 2;
-    }
-
-    return NULL;
+/** Whether c may appear in a token such as a header name (RFC 9110 §5.6.2) */
+static bool is_tchar(unsigned char c) {
+    return isalnum(c) || (c && strchr("!#$%&'*+-.^_`|~", c));
 }
 
 ErrorMessage parse_single_header(http_request *req, const char *line,
-                                 size_t len) {
-    const char *colon = (const char *)memchr(line, ':', len);
+                                 size_t len, size_t delim, http_header_id *id_out) {
+    *id_out = HTTP_HEADER_UNKNOWN;
+    const char *colon = delim == SIZE_MAX ? NULL : line + delim;
 
     if (!colon || colon == line)
         return "Malformed request: header line missing colon [:] or is empty.";
 
+    // No whitespace is allowed around the name (RFC 9112 §5.1), and a
+    // leading one is an obs-fold continuation: trimming either would let
+    // "Transfer-Encoding : chunked" frame a body a proxy ignored
+    const char *key = line;
     size_t key_len = colon - line;
-
-    sds key = sdsnewlen(line, key_len);
-    if (!key)
-        return "Failed to allocate memory for new key string";
-
-    key = sdstrim(key, " ");
-    if (sdslen(key) == 0) {
-        sdsfree(key);
-        return "Malformed request: Invalid key with only whitespace.";
+    for (size_t i = 0; i < key_len; i++)
+        if (!is_tchar(key[i]))
+            return "Malformed request: Invalid character in header key.";
+
+    const char *value = colon + 1;
+    const char *value_end = line + len;
+    while (value < value_end && (*value == ' ' || *value == '\t'))
+        value++;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+        value_end--;
+
+    // Repeated keys keep the last value, except those framing the body:
+    // a proxy in front of us could have picked the other one
+    http_header_id id = http_header_lookup(key, key_len);
+    *id_out = id;
+    http_header *header = http_request_lookupHeader(req, id, key, key_len);
+    if (header && id == HTTP_HEADER_CONTENT_LENGTH &&
+        (header->value_length != (size_t)(value_end - value) ||
+         memcmp(header->value, value, header->value_length) != 0))
+        return "Malformed request: conflicting Content-Length.";
+    if (header && id == HTTP_HEADER_TRANSFER_ENCODING)
+        return "Malformed request: repeated Transfer-Encoding.";
+    if (!header && req->header_count == HTTP_REQUEST_MAX_HEADERS)
+        return "Malformed request: too many headers.";
+    if (!header) {
+        header = http_request_addHeader(req, id);
+        if (!header)
+            return "Failed to allocate memory for new header";
     }
 
-    sdstolower(key);
-
-    const char *value_start = colon + 1;
-    size_t value_len = len - (value_start - line);
-
-    sds value = sdsnewlen(value_start, value_len);
-    if (!value)
-        return "Failed to allocate memory for new value string";
-    value = sdstrim(value, " ");
-
-    if (!req->header)
-        req->header = map_new();
-
-    req->header = map_set(req->header, key, value);
-
-    sdsfree(key);
-    sdsfree(value);
+    *header = (http_header){
+        .key = (char *)key,
+        .key_length = key_len,
+        .value = (char *)value,
+        .value_length = value_end - value,
+        .id = id,
+        .owned = false,
+    };
 
     return NULL;
 }
@@ -246,56 +419,148 @@ HTTPBodyResult http_request_Body(http_request *this) {
     return HTTPBodyResult_Ok(&this->body);
 }
 
+IntResult http_request_BodyFd(http_request *this) {
+    if (!this)
+        return IntResult_Error("This is null");
+    if (this->body_fd < 0)
+        return IntResult_Error("Body is not in a file");
+    return IntResult_Ok(this->body_fd);
+}
+
 const char *http_request_HeaderSetValue(http_request *this,
                                         const char *headerKey,
                                         const char *headerValue) {
-    this->header = map_set(this->header, headerKey, headerValue);
-    if (!this->header)
-        return "Map error: Something went wrong!";
+    if (!this)
+        return "This is null";
+
+    char *key = http_arena_strndup(this->arena, headerKey, strlen(headerKey));
+    char *value = http_arena_strndup(this->arena, headerValue, strlen(headerValue));
+    if (!key || !value)
+        return "Failed to allocate memory for new header";
+
+    size_t key_len = strlen(key);
+    http_header_id id = http_header_lookup(key, key_len);
+    http_header *header = http_request_lookupHeader(this, id, key, key_len);
+    if (!header) {
+        header = http_request_addHeader(this, id);
+        if (!header)
+            return "Failed to allocate memory for new header";
+    }
+
+    *header = (http_header){
+        .key = key,
+        .key_length = key_len,
+        .value = value,
+        .value_length = strlen(value),
+        .id = id,
+        .owned = true,
+    };
 
     return NULL;
 }
 
 ConstStringResult http_request_HeaderGetValue(http_request *this,
                                               const char *headerKey) {
-    return ConstStringResult_Ok(map_get(this->header, headerKey));
+    if (!this)
+        return ConstStringResult_Error("This is null");
+
+    http_header *header = http_request_findHeader(this, headerKey);
+    return ConstStringResult_Ok(header ? header->value : NULL);
+}
+
+ConstStringResult http_request_HeaderGetKnown(http_request *this, http_header_id id) {
+    if (!this)
+        return ConstStringResult_Error("This is null");
+    if (id >= HTTP_HEADER_COUNT)
+        return ConstStringResult_Error("Invalid header id");
+
+    http_header *header = http_request_knownHeader(this, id);
+    return ConstStringResult_Ok(header ? header->value : NULL);
 }
 
 ConstStringArrResult http_request_HeaderKeys(http_request *this,
                                              size_t *keys_length) {
-    return ConstStringArrResult_Ok(map_keys(this->header, keys_length));
+    if (!this)
+        return ConstStringArrResult_Error("This is null");
+    if (!this->header_count)
+        return ConstStringArrResult_Error("Header is null");
+
+    const char **keys = http_malloc(this->header_count * sizeof(char *));
+    if (!keys)
+        return ConstStringArrResult_Error("Failed to allocate memory for keys array.");
+
+    for (size_t i = 0; i < this->header_count; i++)
+        keys[i] = this->header[i].key;
+    *keys_length = this->header_count;
+
+    return ConstStringArrResult_Ok(keys);
 }
 
 BoolResult http_request_HeaderContains(http_request *this,
                                        const char *headerKey) {
-    const char **headerKeys = NULL;
-    size_t headerKeysLength = 0;
-
-    headerKeys = map_keys(this->header, &headerKeysLength);
-    if (!headerKeys)
-        return BoolResult_Error("Failed to get header map keys.");
+    if (!this)
+        return BoolResult_Error("This is null");
 
-    bool contains = str_arr_contains(headerKeys, headerKey, headerKeysLength);
-    free(headerKeys);
+    return BoolResult_Ok(http_request_findHeader(this, headerKey) != NULL);
+}
 
-    return BoolResult_Ok(contains);
+void http_request_setParams(http_request *req, const http_route_match *match) {
+    memcpy(req->params, match->params, match->param_count * sizeof(http_route_param));
+    req->param_count = match->param_count;
 }
 
-bool validate_content_headers(struct http_request *this) {
-    size_t key_count = 0;
-    if (this->header != NULL) {
-        const char **keys;
-        keys = map_keys(this->header, &key_count);
-        if (str_arr_contains(keys, "content-length", key_count)) {
-            char *endptr;
-            size_t expected_len =
-                strtoul(map_get(this->header, "content-length"), &endptr, 10);
-            if (expected_len != this->body.length) {
-                free(keys);
-                return false;
-            }
+ConstStringResult http_request_Param(http_request *this, const char *name,
+                                     size_t *length) {
+    if (!this)
+        return ConstStringResult_Error("This is null");
+
+    for (size_t i = 0; i < this->param_count; i++) {
+        if (strcmp(this->params[i].name, name) == 0) {
+            *length = this->params[i].length;
+            return ConstStringResult_Ok(this->uri + this->params[i].offset);
         }
-        free(keys);
     }
-    return true;
+
+    *length = 0;
+    return ConstStringResult_Ok(NULL);
+}
+
+/**
+ * Whether the comma separated header value contains token,
+ * compared case-insensitively
+ */
+static bool header_has_token(const char *value, const char *token) {
+    size_t token_len = strlen(token);
+    const char *cur = value;
+
+    while (*cur) {
+        while (*cur == ' ' || *cur == '\t' || *cur == ',')
+            cur++;
+        const char *end = cur;
+        while (*end && *end != ',')
+            end++;
+        const char *trim = end;
+        while (trim > cur && (trim[-1] == ' ' || trim[-1] == '\t'))
+            trim--;
+        if ((size_t)(trim - cur) == token_len && strncasecmp(cur, token, token_len) == 0)
+            return true;
+        cur = end;
+    }
+
+    return false;
+}
+
+BoolResult http_request_KeepAlive(http_request *this) {
+    if (!this)
+        return BoolResult_Error("This is null");
+
+    http_header *header = http_request_knownHeader(this, HTTP_HEADER_CONNECTION);
+    const char *connection = header ? header->value : NULL;
+    if (connection && header_has_token(connection, "close"))
+        return BoolResult_Ok(false);
+
+    if (this->version.major == 1 && this->version.minor == 0)
+        return BoolResult_Ok(connection && header_has_token(connection, "keep-alive"));
+
+    return BoolResult_Ok(this->version.major >= 1);
 }
@@ -1,19 +1,143 @@
 #pragma once
 
+#include "arena/arena.h"
 #include "http/body.h"
+#include "http/header.h"
+#include "http/request.h"
 #include "http/results.h"
+#include "http/router.h"
 #include "http/version.h"
-#include "map/map.h"
 
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_REQUEST_INLINE_HEADERS 16
+// Most header fields a request may have, past it the head is rejected
+#define HTTP_REQUEST_MAX_HEADERS    100
+
+/**
+ * Header view. key and value point into the request head and are NUL
+ * terminated in place once the header block is complete, unless owned
+ * is set because the header was added with http_request_HeaderSetValue
+ * and copied into the arena.
+ */
+typedef struct http_header {
+    char*               key;
+    size_t              key_length;
+    char*               value;
+    size_t              value_length;
+    http_header_id      id;
+    bool                owned;
+} http_header;
+
+/**
+ * method, uri and header views point into base. In zero-copy mode base
+ * is the caller's buffer, otherwise the head is copied once into head
+ * when the header block completes and views are moved over to it.
+ *
+ * The request itself and everything it allocates live in arena, which
+ * is either own_arena or one shared with the connection and reset when
+ * the request is deleted.
+ */
 struct http_request {
-    sds                 method;
-    sds                 uri;
+    char*               method;
+    size_t              method_length;
+    char*               uri;
+    size_t              uri_length;
     http_version        version;
-    map                *header;
+    http_header*        header;
+    size_t              header_count;
+    size_t              header_capacity;
+    // Index + 1 into header of each hot header, 0 when absent
+    uint32_t            hot_header[HTTP_HEADER_HOT_COUNT];
     http_body           body;
+    // File holding body when it was spilled, owned by whoever spilled it
+    int                 body_fd;
+
+    bool                zero_copy;
+    const char*         base;
+    char*               head;
+
+    http_arena*         arena;
+    http_arena          own_arena;
+
+    http_route_param    params[HTTP_ROUTER_MAX_PARAMS];
+    size_t              param_count;
+
+    http_header         inline_header[HTTP_REQUEST_INLINE_HEADERS];
 };
 
-ErrorMessage    parse_request_line(struct http_request* req, const char* data, size_t len);
-ErrorMessage    parse_headers(struct http_request* req, const char* data, size_t len);
-ErrorMessage    parse_single_header(struct http_request* req, const char* line, size_t len);
-bool            validate_content_headers(struct http_request* this);
+/**
+ * Allocates a request inside arena, deleting it resets the arena.
+ * Lets a connection reuse one arena for every request it serves.
+ *
+ * @param arena Arena, must outlive the request
+ *
+ * @returns HTTPRequestResult. Must unwrap to get http_request
+ */
+HTTPRequestResult http_request_newInArena(http_arena* arena);
+
+/**
+ * Parse one line of the head. delim is the offset of the first space of
+ * the request line or the first colon of a header line, as found by
+ * http_scan_line, or SIZE_MAX if the line has none. parse_single_header
+ * stores the id of the header in id, HTTP_HEADER_UNKNOWN if the line
+ * has no valid key.
+ */
+ErrorMessage    parse_request_line(struct http_request* req, const char* data, size_t len,
+                                   size_t delim);
+ErrorMessage    parse_single_header(struct http_request* req, const char* line, size_t len,
+                                    size_t delim, http_header_id* id);
+
+/**
+ * Points views recorded against an older copy of the buffer at data.
+ * Needed whenever the caller's buffer moved between parser feeds.
+ */
+void            http_request_rebase(struct http_request* req, const char* data);
+
+/**
+ * Finishes the header block of len bytes at data: copies it unless in
+ * zero-copy mode, then NUL terminates and lowercases the views in place
+ */
+ErrorMessage    http_request_finishHead(struct http_request* req, const char* data, size_t len);
+
+/**
+ * Attaches the body, pointing into data in zero-copy mode and copying
+ * it otherwise
+ */
+ErrorMessage    http_request_setBody(struct http_request* req, const char* data, size_t len);
+
+/**
+ * Sets a body of len bytes the caller fills in afterwards: in_place in
+ * zero-copy mode, a new copy otherwise
+ *
+ * @returns Body or NULL if out of memory
+ */
+char*           http_request_allocBody(struct http_request* req, char* in_place, size_t len);
+
+/**
+ * Attaches a body held in file fd, data being a view of it. Both must
+ * outlive the request.
+ */
+void            http_request_setBodyFile(struct http_request* req, void* data, size_t len, int fd);
+
+/**
+ * Looks up a header by name, standard names by id and the rest by a
+ * case-insensitive compare
+ *
+ * @returns Header or NULL
+ */
+http_header*    http_request_findHeader(struct http_request* req, const char* key);
+
+/**
+ * Looks up a standard header, in O(1) for hot ones
+ *
+ * @returns Header or NULL
+ */
+http_header*    http_request_knownHeader(struct http_request* req, http_header_id id);
+
+/**
+ * Stores the path parameters of the route matched for req so handlers
+ * can read them with http_request_Param
+ */
+void            http_request_setParams(struct http_request* req, const http_route_match* match);
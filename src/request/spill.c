@@ -0,0 +1,138 @@
+#include "spill.h"
+
+#include "http/results.h"
+#include "sds.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void http_spill_init(http_spill *this, size_t threshold) {
+    this->threshold = threshold;
+    this->memory = NULL;
+    this->fd = -1;
+    this->length = 0;
+    this->map = NULL;
+}
+
+/**
+ * Creates the anonymous file backing a large body
+ *
+ * @returns Descriptor or -1
+ */
+static int http_spill_open(void) {
+    int fd = memfd_create("http-body", MFD_CLOEXEC);
+    if (fd >= 0 || errno != ENOSYS)
+        return fd;
+
+    char path[] = "/tmp/http-body-XXXXXX";
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0)
+        unlink(path);
+    return fd;
+}
+
+static ErrorMessage http_spill_writeAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == ENOSPC ? "No space left for request body"
+                                   : "Failed to write request body";
+        }
+        data += n;
+        len -= n;
+    }
+    return NULL;
+}
+
+/**
+ * Moves what is in memory to a new file, which takes every later write
+ */
+static ErrorMessage http_spill_toFile(http_spill *this) {
+    this->fd = http_spill_open();
+    if (this->fd < 0)
+        return "Failed to create request body file";
+
+    if (this->memory) {
+        ErrorMessage err = http_spill_writeAll(this->fd, this->memory, sdslen(this->memory));
+        if (err)
+            return err;
+        sdsclear(this->memory);
+    }
+    return NULL;
+}
+
+ErrorMessage http_spill_write(http_spill *this, const void *data, size_t len) {
+    if (len == 0)
+        return NULL;
+
+    if (this->fd < 0 && this->length + len > this->threshold) {
+        ErrorMessage err = http_spill_toFile(this);
+        if (err)
+            return err;
+    }
+
+    if (this->fd >= 0) {
+        ErrorMessage err = http_spill_writeAll(this->fd, data, len);
+        if (err)
+            return err;
+    } else {
+        sds memory = this->memory ? this->memory : sdsempty();
+        memory = memory ? sdscatlen(memory, data, len) : NULL;
+        if (!memory)
+            return "Failed to allocate memory";
+        this->memory = memory;
+    }
+
+    this->length += len;
+    return NULL;
+}
+
+ErrorMessage http_spill_view(http_spill *this, void **data) {
+    *data = NULL;
+    if (this->length == 0)
+        return NULL;
+
+    if (this->fd < 0) {
+        *data = this->memory;
+        return NULL;
+    }
+
+    if (!this->map) {
+        void *map = mmap(NULL, this->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, this->fd, 0);
+        if (map == MAP_FAILED)
+            return "Failed to map request body";
+        this->map = map;
+    }
+    *data = this->map;
+    return NULL;
+}
+
+void http_spill_reset(http_spill *this) {
+    if (this->map)
+        munmap(this->map, this->length);
+    if (this->fd >= 0)
+        close(this->fd);
+    this->map = NULL;
+    this->fd = -1;
+    this->length = 0;
+
+    // A body close to threshold is not worth keeping around
+    if (this->memory && sdsalloc(this->memory) > HTTP_SPILL_KEEP) {
+        sdsfree(this->memory);
+        this->memory = NULL;
+    } else if (this->memory) {
+        sdsclear(this->memory);
+    }
+}
+
+void http_spill_deinit(http_spill *this) {
+    http_spill_reset(this);
+    sdsfree(this->memory);
+    this->memory = NULL;
+}
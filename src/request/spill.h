@@ -0,0 +1,70 @@
+#pragma once
+
+#include "http/results.h"
+#include "sds.h"
+
+#include <stddef.h>
+
+// Memory kept between requests by an idle spill
+#define HTTP_SPILL_KEEP (16 * 1024)
+
+/**
+ * Request body collected outside the connection buffer. Bytes are kept
+ * in memory up to threshold, past that everything moves to an anonymous
+ * memfd, or an unlinked temporary file where memfd_create is missing,
+ * so a large upload costs page cache instead of heap.
+ */
+typedef struct http_spill {
+    size_t              threshold;
+    sds                 memory;
+    // -1 until the body outgrew threshold
+    int                 fd;
+    size_t              length;
+    void*               map;
+} http_spill;
+
+/**
+ * Initializes an empty spill, nothing is allocated until first write
+ *
+ * @param this          Spill
+ * @param threshold     Bytes kept in memory before moving to a file
+ */
+void            http_spill_init(http_spill *this, size_t threshold);
+
+/**
+ * Appends len bytes of data
+ *
+ * @param this  Spill
+ * @param data  Bytes to append
+ * @param len   Length of data
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage    http_spill_write(http_spill *this, const void *data, size_t len);
+
+/**
+ * Gives random access to everything written so far. A file backed
+ * body is mapped copy-on-write, so writes through the view never reach
+ * the file.
+ *
+ * @param this  Spill
+ * @param data  Set to the body, valid until the next reset, NULL if
+ *              the body is empty
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage    http_spill_view(http_spill *this, void **data);
+
+/**
+ * Drops the body, closing its file if it had one
+ *
+ * @param this  Spill
+ */
+void            http_spill_reset(http_spill *this);
+
+/**
+ * Frees everything
+ *
+ * @param this  Spill
+ */
+void            http_spill_deinit(http_spill *this);
@@ -2,6 +2,7 @@
 #include "http/response.h"
 
 #include "response/response_codes.h"
+#include "http/alloc.h"
 #include "http/results.h"
 #include "http/version.h"
 
@@ -12,11 +13,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 DEFINE_RESULT_TYPE(http_response*, HTTPResponseResult);
 
 HTTPResponseResult http_response_new(void) {
-    http_response *new_response = malloc(sizeof(http_response));
+    http_response *new_response = http_malloc(sizeof(http_response));
     if (!new_response)
         return HTTPResponseResult_Error("Failed to allocate memory");
 
@@ -24,58 +26,280 @@ HTTPResponseResult http_response_new(void) {
     new_response->reason_phrase = NULL;
     new_response->version.major = 1;
     new_response->version.minor = 1;
-    new_response->header = NULL;
+    map_init(&new_response->header);
     new_response->body.length = 0;
     new_response->body.data = NULL;
+    new_response->body_file = NULL;
+    new_response->producer = NULL;
+    new_response->producer_ctx = NULL;
+    new_response->producer_release = NULL;
+    new_response->chunked = false;
 
     return HTTPResponseResult_Ok(new_response);
 }
 
-StringResult http_response_bytes(http_response *this) {
-    sds response_string = sdsnew("");
-    if (this->version.major > 1) {
-        response_string = sdscatprintf(response_string, "HTTP/%d %d %s\r\n",
-                                       this->version.major, this->status_code,
-                                       this->reason_phrase);
+static void http_response_dropProducer(http_response *this) {
+    if (this->producer_release)
+        this->producer_release(this->producer_ctx);
+    this->producer = NULL;
+    this->producer_ctx = NULL;
+    this->producer_release = NULL;
+}
+
+void http_response_dropBody(http_response *this) {
+    http_free(this->body.data);
+    this->body.data = NULL;
+    this->body.length = 0;
+    http_file_release(this->body_file);
+    this->body_file = NULL;
+    http_response_dropProducer(this);
+    this->chunked = false;
+}
+
+static size_t http_response_digits(unsigned value) {
+    size_t digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+static char *http_response_writeUInt(char *dst, unsigned value) {
+    size_t digits = http_response_digits(value);
+    for (size_t i = digits; i > 0; i--) {
+        dst[i - 1] = '0' + value % 10;
+        value /= 10;
+    }
+    return dst + digits;
+}
+
+static char *http_response_writeStr(char *dst, const char *s, size_t len) {
+    memcpy(dst, s, len);
+    return dst + len;
+}
+
+ErrorMessage http_response_validate(http_response *this) {
+    if (!this)
+        return "This is null";
+    if ((this->body.data || this->body_file) && this->body.length > 0 &&
+        !map_get(&this->header, "content-length"))
+        return "Invalid response: key 'content-length' must be set if "
+               "response has body.";
+    return NULL;
+}
+
+size_t http_response_headLength(http_response *this) {
+    size_t len = 0;
+    if (this->reason_phrase ||
+        !http_response_statusLine(this->status_code, this->version, &len)) {
+        // "HTTP/" major [ "." minor ] " " status " " reason CRLF
+        len = 5 + http_response_digits(this->version.major);
+        if (this->version.major <= 1)
+            len += 1 + http_response_digits(this->version.minor);
+        len += 1 + http_response_digits(this->status_code) + 1;
+        if (this->reason_phrase)
+            len += sdslen(this->reason_phrase);
+        len += 2;
+    }
+
+    for (map_pair *pair = map_next(&this->header, NULL); pair;
+         pair = map_next(&this->header, pair))
+        len += sdslen(pair->key) + 2 + sdslen(pair->value) + 2;
+
+    return len + 2;
+}
+
+char *http_response_writeHead(http_response *this, char *dst) {
+    size_t line_len;
+    const char *line = this->reason_phrase
+                           ? NULL
+                           : http_response_statusLine(this->status_code, this->version, &line_len);
+    if (line) {
+        dst = http_response_writeStr(dst, line, line_len);
     } else {
-        response_string = sdscatprintf(response_string, "HTTP/%d.%d %d %s\r\n",
-                                       this->version.major, this->version.minor,
-                                       this->status_code, this->reason_phrase);
-    }
-    if (this->header) {
-        size_t keys_length;
-
-        ConstStringArrResult res = http_response_HeaderKeys(this, &keys_length);
-        if (!res.Ok)
-            return StringResult_Error(res.Err);
-
-        const char **headerKeys = res.Value;
-        for (size_t i = 0; i < keys_length; i++) {
-            const char *key = headerKeys[i];
-            ConstStringResult res = http_response_HeaderGetValue(this, key);
-            if (!res.Ok)
-                return StringResult_Error(res.Err);
-            const char *value = res.Value;
-
-            response_string =
-                sdscatprintf(response_string, "%s: %s\r\n", key, value);
+        dst = http_response_writeStr(dst, "HTTP/", 5);
+        dst = http_response_writeUInt(dst, this->version.major);
+        if (this->version.major <= 1) {
+            *dst++ = '.';
+            dst = http_response_writeUInt(dst, this->version.minor);
+        }
+        *dst++ = ' ';
+        dst = http_response_writeUInt(dst, this->status_code);
+        *dst++ = ' ';
+        if (this->reason_phrase)
+            dst = http_response_writeStr(dst, this->reason_phrase, sdslen(this->reason_phrase));
+        dst = http_response_writeStr(dst, "\r\n", 2);
+    }
+
+    for (map_pair *pair = map_next(&this->header, NULL); pair;
+         pair = map_next(&this->header, pair)) {
+        dst = http_response_writeStr(dst, pair->key, sdslen(pair->key));
+        dst = http_response_writeStr(dst, ": ", 2);
+        dst = http_response_writeStr(dst, pair->value, sdslen(pair->value));
+        dst = http_response_writeStr(dst, "\r\n", 2);
+    }
+
+    return http_response_writeStr(dst, "\r\n", 2);
+}
+
+ErrorMessage http_response_writeTo(http_response *this, http_output *out) {
+    ErrorMessage err = http_response_validate(this);
+    if (err)
+        return err;
+
+    size_t head_len = http_response_headLength(this);
+    bool inline_body = !this->body_file && this->body.length <= HTTP_OUTPUT_INLINE_BODY;
+
+    char *dst = http_output_reserve(out, head_len + (inline_body ? this->body.length : 0));
+    if (!dst)
+        return "Failed to allocate memory";
+    dst = http_response_writeHead(this, dst);
+
+    // Streamed bodies follow through http_response_produce
+    if (this->producer)
+        return NULL;
+
+    if (this->body_file) {
+        http_file *file = this->body_file;
+        size_t body_len = this->body.length;
+        this->body_file = NULL;
+        this->body.length = 0;
+        return http_output_appendFile(out, file, 0, body_len);
+    }
+
+    if (inline_body) {
+        if (this->body.length > 0)
+            memcpy(dst, this->body.data, this->body.length);
+        return NULL;
+    }
+
+    // The queue takes the body over, nothing is copied
+    void *body = this->body.data;
+    size_t body_len = this->body.length;
+    this->body.data = NULL;
+    this->body.length = 0;
+    return http_output_appendBody(out, body, body_len);
+}
+
+/**
+ * Asks the producer for the next piece into piece, which has room for
+ * two more bytes to close a chunk
+ *
+ * @returns Bytes produced, 0 at the end of the body or -1 on error
+ */
+static ssize_t http_response_pull(http_response *this, char *piece) {
+    ssize_t n = this->producer(piece, HTTP_RESPONSE_STREAM_PIECE, this->producer_ctx);
+    if (n < 0 || n > HTTP_RESPONSE_STREAM_PIECE)
+        return -1;
+    return n;
+}
+
+ErrorMessage http_response_produce(http_response *this, http_output *out, bool *done) {
+    *done = false;
+    char *piece = http_malloc(HTTP_RESPONSE_STREAM_PIECE + 2);
+    if (!piece)
+        return "Failed to allocate memory";
+
+    ssize_t n = http_response_pull(this, piece);
+    if (n < 0) {
+        http_free(piece);
+        return "Body producer failed";
+    }
+
+    if (n == 0) {
+        http_free(piece);
+        *done = true;
+        http_response_dropProducer(this);
+        if (!this->chunked)
+            return NULL;
+        char *dst = http_output_reserve(out, 5);
+        if (!dst)
+            return "Failed to allocate memory";
+        memcpy(dst, "0\r\n\r\n", 5);
+        return NULL;
+    }
+
+    size_t len = n;
+    if (this->chunked) {
+        char size_line[20];
+        int line_len = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+        char *dst = http_output_reserve(out, line_len);
+        if (!dst) {
+            http_free(piece);
+            return "Failed to allocate memory";
         }
-        free(headerKeys);
+        memcpy(dst, size_line, line_len);
+        memcpy(piece + len, "\r\n", 2);
+        len += 2;
+    }
+
+    // The size line sits in the chunk's data, the piece is sent in place
+    return http_output_appendBody(out, piece, len);
+}
+
+/**
+ * Appends the whole streamed body to s, framed as http_response_produce
+ * would
+ */
+static sds http_response_drain(http_response *this, sds s, ErrorMessage *err) {
+    char *piece = http_malloc(HTTP_RESPONSE_STREAM_PIECE + 2);
+    if (!piece) {
+        *err = "Failed to allocate memory";
+        return s;
     }
 
-    response_string = sdscat(response_string, "\r\n");
+    ssize_t n;
+    while ((n = http_response_pull(this, piece)) > 0) {
+        if (this->chunked)
+            s = sdscatprintf(s, "%zx\r\n", (size_t)n);
+        s = sdscatlen(s, piece, n);
+        if (this->chunked)
+            s = sdscatlen(s, "\r\n", 2);
+    }
+    http_free(piece);
+
+    if (n < 0)
+        *err = "Body producer failed";
+    else if (this->chunked)
+        s = sdscatlen(s, "0\r\n\r\n", 5);
+    http_response_dropProducer(this);
+    return s;
+}
+
+StringResult http_response_bytes(http_response *this) {
+    ErrorMessage err = http_response_validate(this);
+    if (err)
+        return StringResult_Error(err);
+
+    size_t head_len = http_response_headLength(this);
+    size_t body_len = this->body.data || this->body_file ? this->body.length : 0;
+
+    sds response_string = sdsnewlen(NULL, head_len + body_len);
+    if (!response_string)
+        return StringResult_Error("Failed to allocate memory");
+
+    char *dst = http_response_writeHead(this, response_string);
+    if (this->body_file) {
+        for (size_t done = 0; done < body_len;) {
+            ssize_t n = pread(this->body_file->fd, dst + done, body_len - done, done);
+            if (n <= 0) {
+                sdsfree(response_string);
+                return StringResult_Error("Failed to read body file");
+            }
+            done += n;
+        }
+    } else if (body_len > 0) {
+        memcpy(dst, this->body.data, body_len);
+    }
 
-    if (this->body.data && this->body.length > 0) {
-        BoolResult res = http_response_HeaderContains(this, "content-length");
-        if (!res.Ok)
-            return StringResult_Error(res.Err);
-        if (!res.Value) {
+    if (this->producer) {
+        ErrorMessage drain_err = NULL;
+        response_string = http_response_drain(this, response_string, &drain_err);
+        if (drain_err) {
             sdsfree(response_string);
-            return StringResult_Error("Invalid response: key 'content-length' must be set if "
-                      "response has body.");
+            return StringResult_Error(drain_err);
         }
-        response_string = sdscatlen(
-            response_string, (const char *)this->body.data, this->body.length);
     }
 
     return StringResult_Ok(response_string);
@@ -85,12 +309,13 @@ void http_response_delete(http_response *this) {
     if (this) {
         if (this->reason_phrase)
             sdsfree(this->reason_phrase);
-        if (this->header)
-            map_delete(this->header);
+        map_deinit(&this->header);
         if (this->body.length > 0 || this->body.data) {
-            free(this->body.data);
+            http_free(this->body.data);
         }
-        free(this);
+        http_file_release(this->body_file);
+        http_response_dropProducer(this);
+        http_free(this);
     }
 }
 
@@ -111,6 +336,8 @@ ErrorMessage http_response_SetStatusCode(http_response *this, uint16_t code) {
 ConstStringResult http_response_ReasonPhrase(http_response *this) {
     if (!this)
         return ConstStringResult_Error("This is null");
+    if (!this->reason_phrase)
+        return ConstStringResult_Ok(http_response_standardReason(this->status_code));
     return ConstStringResult_Ok(this->reason_phrase);
 }
 
@@ -118,7 +345,11 @@ ErrorMessage http_response_SetReasonPhrase(http_response *this,
                                    const char *reason_phrase) {
     if (!this)
         return "This is null";
-    if (!this->reason_phrase)
+    // NULL goes back to the standard phrase of the status code
+    if (!reason_phrase) {
+        sdsfree(this->reason_phrase);
+        this->reason_phrase = NULL;
+    } else if (!this->reason_phrase)
         this->reason_phrase = sdsnew(reason_phrase);
     else
         this->reason_phrase = sdscpy(this->reason_phrase, reason_phrase);
@@ -145,25 +376,24 @@ ErrorMessage http_response_HeaderSetValue(http_response *this, const char *heade
                                   const char *headerValue) {
     if (!this)
         return "This is null";
-    if (!this->header)
-        this->header = map_new();
-
     if (!isStringSafe(headerKey, strlen(headerKey))) {
         return "CRLF sequence rejected in header key";
     }
-    if (!isStringSafe(headerValue, strlen(headerKey))) {
+    size_t valueLength = strlen(headerValue);
+    if (!isStringSafe(headerValue, valueLength)) {
         return "CRLF sequence rejected in header value";
     }
 
-    sds lowerCaseKey = sdsnew(headerKey);
-    sdstolower(lowerCaseKey);
-
-    sds cleanValue = sdsnew(headerValue);
-    cleanValue = sdstrim(cleanValue, " ");
-
-    this->header = map_set(this->header, lowerCaseKey, cleanValue);
-    sdsfree(cleanValue);
-    sdsfree(lowerCaseKey);
+    // The key goes in as given, the map ignores its case. Only values
+    // that need trimming are copied first
+    if (valueLength > 0 && (headerValue[0] == ' ' || headerValue[valueLength - 1] == ' ')) {
+        sds cleanValue = sdsnew(headerValue);
+        cleanValue = sdstrim(cleanValue, " ");
+        map_set(&this->header, headerKey, cleanValue);
+        sdsfree(cleanValue);
+    } else {
+        map_set(&this->header, headerKey, headerValue);
+    }
 
     return NULL;
 }
@@ -172,32 +402,25 @@ ConstStringResult http_response_HeaderGetValue(http_response *this,
                                          const char *headerKey) {
     if (!this)
         return ConstStringResult_Error("This is null");
-    return ConstStringResult_Ok(map_get(this->header, headerKey));
+    return ConstStringResult_Ok(map_get(&this->header, headerKey));
 }
 
 ConstStringArrResult http_response_HeaderKeys(http_response *this,
                                       size_t *keys_length) {
     if (!this)
         return ConstStringArrResult_Error("This is null");
-    if (!this->header)
+    if (this->header.size == 0)
         return ConstStringArrResult_Error("Header is null");
-    return ConstStringArrResult_Ok(map_keys(this->header, keys_length));
+    return ConstStringArrResult_Ok(map_keys(&this->header, keys_length));
 }
 
 BoolResult http_response_HeaderContains(http_response *this, const char *headerKey) {
     if (!this)
         return BoolResult_Error("This is null");
-    const char **headerKeys = NULL;
-    size_t headerKeysLength = 0;
-
-    headerKeys = map_keys(this->header, &headerKeysLength);
     if (!headerKey)
         return BoolResult_Ok(false);
 
-    bool contains = str_arr_contains(headerKeys, headerKey, headerKeysLength);
-    free(headerKeys);
-
-    return BoolResult_Ok(contains);
+    return BoolResult_Ok(map_get(&this->header, headerKey) != NULL);
 }
 
 ErrorMessage http_response_SetBody(http_response *this, void *data, size_t length) {
@@ -206,10 +429,13 @@ ErrorMessage http_response_SetBody(http_response *this, void *data, size_t lengt
     if (!data)
         return "Data is null";
     if (this->body.length != 0 || this->body.data) {
-        free(this->body.data);
+        http_free(this->body.data);
     }
+    http_file_release(this->body_file);
+    this->body_file = NULL;
+    http_response_dropProducer(this);
     this->body.length = length;
-    this->body.data = malloc(this->body.length);
+    this->body.data = http_malloc(this->body.length);
     if (!this->body.data)
         return "Out of memory";
 
@@ -218,6 +444,44 @@ ErrorMessage http_response_SetBody(http_response *this, void *data, size_t lengt
     return NULL;
 }
 
+ErrorMessage http_response_SetBodyFile(http_response *this, const char *path) {
+    if (!this)
+        return "This is null";
+
+    HTTPFileResult file_res = http_file_open(path);
+    if (!file_res.Ok)
+        return file_res.Err;
+
+    http_free(this->body.data);
+    this->body.data = NULL;
+    http_file_release(this->body_file);
+    http_response_dropProducer(this);
+    this->body_file = file_res.Value;
+    this->body.length = this->body_file->st.st_size;
+
+    return NULL;
+}
+
+ErrorMessage http_response_SetBodyProducer(http_response *this, http_body_producer producer,
+                                          void *ctx, void (*release)(void *ctx)) {
+    if (!this)
+        return "This is null";
+    if (!producer)
+        return "Producer is null";
+
+    http_free(this->body.data);
+    this->body.data = NULL;
+    this->body.length = 0;
+    http_file_release(this->body_file);
+    this->body_file = NULL;
+    http_response_dropProducer(this);
+    this->producer = producer;
+    this->producer_ctx = ctx;
+    this->producer_release = release;
+
+    return NULL;
+}
+
 HTTPBodyResult http_response_GetBody(http_response *this) {
     if (!this)
         return HTTPBodyResult_Error("This is null");
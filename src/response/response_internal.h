@@ -1,16 +1,94 @@
 #pragma once
 
+#include "file/file.h"
 #include "http/body.h"
+#include "http/response.h"
+#include "http/results.h"
 #include "http/version.h"
+#include "output/output.h"
 #include <map/map.h>
+#include <stddef.h>
 #include <stdint.h>
 
+// Most body a producer is asked for per call
+#define HTTP_RESPONSE_STREAM_PIECE (16 * 1024)
+
 struct http_response {
     uint16_t            status_code;
     sds                 reason_phrase;
     http_version        version;
-    map*                header;
+    // Embedded, stays inline for the usual handful of headers
+    map                 header;
     http_body           body;
+    // Set instead of body.data for file bodies, body.length is the size
+    http_file*          body_file;
+    // Set instead of body.data for streamed bodies
+    http_body_producer  producer;
+    void*               producer_ctx;
+    void                (*producer_release)(void* ctx);
+    // Streamed body is sent with chunked transfer coding
+    bool                chunked;
 };
 
+/**
+ * Standard reason phrase of code
+ *
+ * @returns Reason phrase or NULL if code is not in response_codes.h
+ */
+const char*     http_response_standardReason(uint16_t code);
+
+/**
+ * Pre-rendered "HTTP/1.x <code> <reason>" status line for code,
+ * CRLF included
+ *
+ * @param len   Set to the length of the line
+ *
+ * @returns Line or NULL if code has no standard reason phrase or
+ *          version is not HTTP/1.0 or HTTP/1.1
+ */
+const char*     http_response_statusLine(uint16_t code, http_version version, size_t* len);
+
+/**
+ * Frees the body, whichever way it was set, for responses that must not
+ * carry one. Headers are kept.
+ */
+void            http_response_dropBody(struct http_response* this);
+
+/**
+ * Checks the response can be put on the wire
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage    http_response_validate(struct http_response* this);
+
+/**
+ * Exact size of the status line and header block, final CRLF included
+ */
+size_t          http_response_headLength(struct http_response* this);
+
+/**
+ * Writes the status line and header block to dst, which must have
+ * room for http_response_headLength bytes
+ *
+ * @returns End of the written bytes
+ */
+char*           http_response_writeHead(struct http_response* this, char* dst);
+
+/**
+ * Queues the response on out. Small bodies are copied after the head,
+ * larger ones are moved to the queue and sent in place.
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage    http_response_writeTo(struct http_response* this, http_output* out);
 
+/**
+ * Queues the next piece of a streamed body on out, framed as a chunk if
+ * this->chunked. Once the producer is done the last chunk is queued and
+ * the producer released.
+ *
+ * @param done  Set once the body is complete
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage    http_response_produce(struct http_response* this, http_output* out, bool* done);
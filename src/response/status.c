@@ -0,0 +1,122 @@
+#include "response_internal.h"
+
+#include "response/response_codes.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_STATUS_FIRST 100
+#define HTTP_STATUS_LAST  599
+
+#define HTTP_STATUS_STR_(code) #code
+#define HTTP_STATUS_STR(code)  HTTP_STATUS_STR_(code)
+
+typedef struct http_status_entry {
+    const char*         reason;
+    // "HTTP/1.0 ..." and "HTTP/1.1 ...", CRLF included
+    const char*         line[2];
+    uint8_t             length;
+} http_status_entry;
+
+#define HTTP_STATUS_LINE(minor, code, reason) \
+    "HTTP/1." #minor " " HTTP_STATUS_STR(code) " " reason "\r\n"
+
+#define HTTP_STATUS(code, text)                                   \
+    [(code) - HTTP_STATUS_FIRST] = {                              \
+        .reason = text,                                           \
+        .line = { HTTP_STATUS_LINE(0, code, text),                \
+                  HTTP_STATUS_LINE(1, code, text) },              \
+        .length = sizeof(HTTP_STATUS_LINE(1, code, text)) - 1,    \
+    }
+
+static const http_status_entry http_status_table[HTTP_STATUS_LAST - HTTP_STATUS_FIRST + 1] = {
+    HTTP_STATUS(HTTP_STATUS_CONTINUE, "Continue"),
+    HTTP_STATUS(HTTP_STATUS_SWITCHING_PROTOCOLS, "Switching Protocols"),
+    HTTP_STATUS(HTTP_STATUS_PROCESSING, "Processing"),
+    HTTP_STATUS(HTTP_STATUS_EARLY_HINTS, "Early Hints"),
+
+    HTTP_STATUS(HTTP_STATUS_OK, "OK"),
+    HTTP_STATUS(HTTP_STATUS_CREATED, "Created"),
+    HTTP_STATUS(HTTP_STATUS_ACCEPTED, "Accepted"),
+    HTTP_STATUS(HTTP_STAUTS_NON_AUTHORITATIVE_INFORMATION, "Non-Authoritative Information"),
+    HTTP_STATUS(HTTP_STATUS_NO_CONTENT, "No Content"),
+    HTTP_STATUS(HTTP_STATUS_RESET_CONTENT, "Reset Content"),
+    HTTP_STATUS(HTTP_STATUS_PARTIAL_CONTENT, "Partial Content"),
+    HTTP_STATUS(HTTP_STATUS_MULTI_STATUS, "Multi-Status"),
+    HTTP_STATUS(HTTP_STATUS_ALREADY_REPORTED, "Already Reported"),
+    HTTP_STATUS(HTTP_STATUS_IM_USED, "IM Used"),
+
+    HTTP_STATUS(HTTP_STATUS_MULTIPLE_CHOICES, "Multiple Choices"),
+    HTTP_STATUS(HTTP_STATUS_MOVED_PERMANENTLY, "Moved Permanently"),
+    HTTP_STATUS(HTTP_STATUS_FOUND, "Found"),
+    HTTP_STATUS(HTTP_STATUS_SEE_OTHER, "See Other"),
+    HTTP_STATUS(HTTP_STATUS_NOT_MODIFIED, "Not Modified"),
+    HTTP_STATUS(HTTP_STATUS_USE_PROXY, "Use Proxy"),
+    HTTP_STATUS(HTTP_STATUS_SWITCH_PROXY, "Switch Proxy"),
+    HTTP_STATUS(HTTP_STATUS_TEMPORARY_REDIRECT, "Temporary Redirect"),
+    HTTP_STATUS(HTTP_STATUS_PERMANENT_REDIRECT, "Permanent Redirect"),
+
+    HTTP_STATUS(HTTP_STATUS_BAD_REQUEST, "Bad Request"),
+    HTTP_STATUS(HTTP_STATUS_UNAUTHORIZED, "Unauthorized"),
+    HTTP_STATUS(HTTP_STATUS_PAYMENT_REQUIRED, "Payment Required"),
+    HTTP_STATUS(HTTP_STATUS_FORBIDDEN, "Forbidden"),
+    HTTP_STATUS(HTTP_STATUS_NOT_FOUND, "Not Found"),
+    HTTP_STATUS(HTTP_STATUS_METHOD_NOT_ALLOWED, "Method Not Allowed"),
+    HTTP_STATUS(HTTP_STATUS_NOT_ACCEPTABLE, "Not Acceptable"),
+    HTTP_STATUS(HTTP_STATUS_PROXY_AUTHENTICATION_REQUIRED, "Proxy Authentication Required"),
+    HTTP_STATUS(HTTP_STATUS_REQUEST_TIMEOUT, "Request Timeout"),
+    HTTP_STATUS(HTTP_STATUS_CONFLICT, "Conflict"),
+    HTTP_STATUS(HTTP_STATUS_GONE, "Gone"),
+    HTTP_STATUS(HTTP_STATUS_LENGTH_REQUIRED, "Length Required"),
+    HTTP_STATUS(HTTP_STATUS_PRECONDITION_FAILED, "Precondition Failed"),
+    HTTP_STATUS(HTTP_STATUS_PAYLOAD_TOO_LARGE, "Payload Too Large"),
+    HTTP_STATUS(HTTP_STATUS_URI_TOO_LONG, "URI Too Long"),
+    HTTP_STATUS(HTTP_STATUS_UNSUPPORTED_MEDIA_TYPE, "Unsupported Media Type"),
+    HTTP_STATUS(HTTP_STATUS_RANGE_NOT_SATISFIABLE, "Range Not Satisfiable"),
+    HTTP_STATUS(HTTP_STATUS_EXPECTATION_FAILED, "Expectation Failed"),
+    HTTP_STATUS(HTTP_STATUS_IM_A_TEAPOT, "I'm a teapot"),
+    HTTP_STATUS(HTTP_STATUS_MISDIRECTED_REQUEST, "Misdirected Request"),
+    HTTP_STATUS(HTTP_STATUS_UNPROCESSABLE_CONTENT, "Unprocessable Content"),
+    HTTP_STATUS(HTTP_STATUS_LOCKED, "Locked"),
+    HTTP_STATUS(HTTP_STATUS_FAILED_DEPENDENCY, "Failed Dependency"),
+    HTTP_STATUS(HTTP_STATUS_TOO_EARLY, "Too Early"),
+    HTTP_STATUS(HTTP_STATUS_UPGRADE_REQUIRED, "Upgrade Required"),
+    HTTP_STATUS(HTTP_STATUS_PRECONDITION_REQUIRED, "Precondition Required"),
+    HTTP_STATUS(HTTP_STATUS_TOO_MAY_REQUESTS, "Too Many Requests"),
+    HTTP_STATUS(HTTP_STATUS_REQUEST_HEADER_FIELDS_TOO_LARGE, "Request Header Fields Too Large"),
+    HTTP_STATUS(HTTP_STATUS_UNAVAILABLE_FOR_LEGAL_REASONS, "Unavailable For Legal Reasons"),
+
+    HTTP_STATUS(HTTP_STATUS_INTERNAL_SERVER_ERROR, "Internal Server Error"),
+    HTTP_STATUS(HTTP_STATUS_NOT_IMPLEMENTED, "Not Implemented"),
+    HTTP_STATUS(HTTP_STATUS_BAD_GATEWAY, "Bad Gateway"),
+    HTTP_STATUS(HTTP_STATUS_SERVICE_UNAVAILABLE, "Service Unavailable"),
+    HTTP_STATUS(HTTP_STATUS_GATEWAY_TIMEOUT, "Gateway Timeout"),
+    HTTP_STATUS(HTTP_STATUS_HTTP_VERSION_NOT_SUPPORTED, "HTTP Version Not Supported"),
+    HTTP_STATUS(HTTP_STATUS_VARIANT_ALSO_NEGOTIATES, "Variant Also Negotiates"),
+    HTTP_STATUS(HTTP_STATUS_INSUFFICIENT_STORAGE, "Insufficient Storage"),
+    HTTP_STATUS(HTTP_STATUS_LOOP_DETECTED, "Loop Detected"),
+    HTTP_STATUS(HTTP_STATUS_NOT_EXTENDED, "Not Extended"),
+    HTTP_STATUS(HTTP_STATUS_NETWORK_AUTHENTICATION_REQUIRED, "Network Authentication Required"),
+};
+
+static const http_status_entry *http_status_find(uint16_t code) {
+    if (code < HTTP_STATUS_FIRST || code > HTTP_STATUS_LAST)
+        return NULL;
+
+    const http_status_entry *entry = &http_status_table[code - HTTP_STATUS_FIRST];
+    return entry->reason ? entry : NULL;
+}
+
+const char *http_response_standardReason(uint16_t code) {
+    const http_status_entry *entry = http_status_find(code);
+    return entry ? entry->reason : NULL;
+}
+
+const char *http_response_statusLine(uint16_t code, http_version version, size_t *len) {
+    const http_status_entry *entry = http_status_find(code);
+    if (!entry || version.major != 1 || version.minor > 1)
+        return NULL;
+
+    *len = entry->length;
+    return entry->line[version.minor];
+}
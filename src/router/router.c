@@ -0,0 +1,383 @@
+#include "router_internal.h"
+#include "http/router.h"
+
+#include "http/alloc.h"
+#include "http/results.h"
+#include "logger/logger.h"
+#include "sds.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+DEFINE_RESULT_TYPE(http_router *, HTTPRouterResult);
+
+static http_route_node *http_route_node_new(const char *prefix, size_t len) {
+    http_route_node *node = http_calloc(1, sizeof(http_route_node));
+    if (!node)
+        return NULL;
+
+    node->prefix = sdsnewlen(prefix, len);
+    node->indices = sdsempty();
+    if (!node->prefix || !node->indices) {
+        sdsfree(node->prefix);
+        sdsfree(node->indices);
+        http_free(node);
+        return NULL;
+    }
+
+    return node;
+}
+
+static void http_route_node_delete(http_route_node *this) {
+    if (!this)
+        return;
+
+    for (size_t i = 0; i < this->child_count; i++)
+        http_route_node_delete(this->children[i]);
+    http_free(this->children);
+    http_route_node_delete(this->param);
+    http_route_node_delete(this->wildcard);
+
+    for (size_t i = 0; i < this->route_count; i++)
+        sdsfree(this->routes[i].method);
+    http_free(this->routes);
+
+    sdsfree(this->prefix);
+    sdsfree(this->name);
+    sdsfree(this->indices);
+    sdsfree(this->allow);
+    http_free(this);
+}
+
+static ErrorMessage http_route_node_addChild(http_route_node *this,
+                                             http_route_node *child) {
+    http_route_node **children =
+        http_realloc(this->children, (this->child_count + 1) * sizeof(http_route_node *));
+    if (!children)
+        return "Failed to allocate memory";
+    this->children = children;
+
+    sds indices = sdscatlen(this->indices, child->prefix, 1);
+    if (!indices)
+        return "Failed to allocate memory";
+    this->indices = indices;
+
+    this->children[this->child_count++] = child;
+    return NULL;
+}
+
+/**
+ * Splits this at byte at of its prefix. this keeps the head, a new
+ * child takes the tail together with everything this used to hold.
+ */
+static ErrorMessage http_route_node_split(http_route_node *this, size_t at) {
+    http_route_node *tail =
+        http_route_node_new(this->prefix + at, sdslen(this->prefix) - at);
+    if (!tail)
+        return "Failed to allocate memory";
+
+    sds indices = sdsempty();
+    if (!indices) {
+        http_route_node_delete(tail);
+        return "Failed to allocate memory";
+    }
+
+    sdsfree(tail->indices);
+    tail->indices = this->indices;
+    tail->children = this->children;
+    tail->child_count = this->child_count;
+    tail->param = this->param;
+    tail->wildcard = this->wildcard;
+    tail->routes = this->routes;
+    tail->route_count = this->route_count;
+    tail->allow = this->allow;
+
+    this->indices = indices;
+    this->children = NULL;
+    this->child_count = 0;
+    this->param = NULL;
+    this->wildcard = NULL;
+    this->routes = NULL;
+    this->route_count = 0;
+    this->allow = NULL;
+    sdsrange(this->prefix, 0, at - 1);
+
+    return http_route_node_addChild(this, tail);
+}
+
+/**
+ * Walks down from this along the static string s, splitting and
+ * creating nodes as needed.
+ *
+ * @returns Node at the end of s or NULL if out of memory
+ */
+static http_route_node *http_route_node_insertStatic(http_route_node *this,
+                                                     const char *s, size_t len) {
+    while (len > 0) {
+        const char *index = memchr(this->indices, s[0], sdslen(this->indices));
+        if (!index) {
+            http_route_node *child = http_route_node_new(s, len);
+            if (!child)
+                return NULL;
+            if (http_route_node_addChild(this, child)) {
+                http_route_node_delete(child);
+                return NULL;
+            }
+            return child;
+        }
+
+        http_route_node *child = this->children[index - this->indices];
+        size_t prefix_len = sdslen(child->prefix);
+        size_t common = 0;
+        while (common < prefix_len && common < len && child->prefix[common] == s[common])
+            common++;
+
+        if (common < prefix_len && http_route_node_split(child, common))
+            return NULL;
+
+        this = child;
+        s += common;
+        len -= common;
+    }
+
+    return this;
+}
+
+static const http_route *http_route_node_route(const http_route_node *this,
+                                               const char *method) {
+    for (size_t i = 0; i < this->route_count; i++) {
+        if (strcmp(this->routes[i].method, method) == 0)
+            return &this->routes[i];
+    }
+    return NULL;
+}
+
+static ErrorMessage http_route_node_addRoute(http_route_node *this, const char *method,
+                                             http_body_handler on_body, http_handler handler,
+                                             void *ctx) {
+    if (http_route_node_route(this, method))
+        return "Route error: route already registered";
+
+    http_route *routes = http_realloc(this->routes, (this->route_count + 1) * sizeof(http_route));
+    if (!routes)
+        return "Failed to allocate memory";
+    this->routes = routes;
+
+    // Nothing may fail once sdscatprintf has moved this->allow
+    sds route_method = sdsnew(method);
+    if (!route_method)
+        return "Failed to allocate memory";
+    sds allow = this->allow ? sdscatprintf(this->allow, ", %s", method) : sdsnew(method);
+    if (!allow) {
+        sdsfree(route_method);
+        return "Failed to allocate memory";
+    }
+    this->allow = allow;
+
+    this->routes[this->route_count++] = (http_route){
+        .method = route_method,
+        .handler = handler,
+        .on_body = on_body,
+        .ctx = ctx,
+    };
+    return NULL;
+}
+
+HTTPRouterResult http_router_new(void) {
+    http_router *router = http_malloc(sizeof(http_router));
+    if (!router)
+        return HTTPRouterResult_Error("Failed to allocate memory");
+
+    router->root = http_route_node_new("", 0);
+    if (!router->root) {
+        http_free(router);
+        return HTTPRouterResult_Error("Failed to allocate memory");
+    }
+
+    return HTTPRouterResult_Ok(router);
+}
+
+ErrorMessage http_router_add(http_router *this, const char *method,
+                             const char *pattern, http_handler handler, void *ctx) {
+    return http_router_addStreaming(this, method, pattern, NULL, handler, ctx);
+}
+
+ErrorMessage http_router_addStreaming(http_router *this, const char *method,
+                                      const char *pattern, http_body_handler on_body,
+                                      http_handler handler, void *ctx) {
+    if (!this)
+        return "This is null";
+    if (!method || !*method)
+        return "Route error: method is empty";
+    if (!pattern || pattern[0] != '/')
+        return "Route error: pattern must start with '/'";
+    if (!handler)
+        return "Route error: handler is null";
+
+    http_route_node *node = this->root;
+    size_t len = strlen(pattern);
+    size_t params = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        char c = pattern[i];
+
+        // ':' and '*' are only special at the start of a segment
+        if ((c == ':' || c == '*') && pattern[i - 1] == '/') {
+            size_t end = i + 1;
+            while (end < len && pattern[end] != '/')
+                end++;
+            if (end == i + 1)
+                return "Route error: parameter must have a name";
+            if (c == '*' && end != len)
+                return "Route error: wildcard must be the last segment";
+            if (++params > HTTP_ROUTER_MAX_PARAMS)
+                return "Route error: too many parameters";
+
+            const char *name = pattern + i + 1;
+            size_t name_len = end - i - 1;
+            http_route_node **slot = c == ':' ? &node->param : &node->wildcard;
+            if (!*slot) {
+                *slot = http_route_node_new("", 0);
+                if (!*slot)
+                    return "Failed to allocate memory";
+                (*slot)->name = sdsnewlen(name, name_len);
+                if (!(*slot)->name)
+                    return "Failed to allocate memory";
+            } else if (sdslen((*slot)->name) != name_len ||
+                       memcmp((*slot)->name, name, name_len) != 0) {
+                LOG_ERROR("Route %s conflicts with parameter '%s'", pattern, (*slot)->name);
+                return "Route error: conflicting parameter names";
+            }
+
+            node = *slot;
+            i = end;
+            continue;
+        }
+
+        // Static run up to the next parameter
+        size_t end = i + 1;
+        while (end < len &&
+               !(pattern[end - 1] == '/' && (pattern[end] == ':' || pattern[end] == '*')))
+            end++;
+
+        node = http_route_node_insertStatic(node, pattern + i, end - i);
+        if (!node)
+            return "Failed to allocate memory";
+        i = end;
+    }
+
+    return http_route_node_addRoute(node, method, on_body, handler, ctx);
+}
+
+typedef struct http_route_search {
+    const char*         method;
+    const char*         path;
+    size_t              len;
+    http_route_match*   match;
+} http_route_search;
+
+static bool http_route_search_accept(http_route_search *this,
+                                     const http_route_node *node) {
+    const http_route *route = http_route_node_route(node, this->method);
+    if (!route) {
+        if (node->route_count > 0 && !this->match->allow)
+            this->match->allow = node->allow;
+        return false;
+    }
+
+    this->match->status = HTTP_ROUTE_FOUND;
+    this->match->handler = route->handler;
+    this->match->on_body = route->on_body;
+    this->match->ctx = route->ctx;
+    return true;
+}
+
+/**
+ * Matches path from pos against the subtree of node, whose own prefix
+ * is already consumed. Tries static children, then parameters, then the
+ * wildcard, backtracking only when a more specific branch dead-ends.
+ */
+static bool http_route_node_find(const http_route_node *node,
+                                 http_route_search *search, size_t pos) {
+    const char *path = search->path;
+    http_route_match *match = search->match;
+
+    if (pos == search->len) {
+        if (http_route_search_accept(search, node))
+            return true;
+    } else {
+        const char *index = memchr(node->indices, path[pos], sdslen(node->indices));
+        if (index) {
+            const http_route_node *child = node->children[index - node->indices];
+            size_t prefix_len = sdslen(child->prefix);
+            if (prefix_len <= search->len - pos &&
+                memcmp(path + pos, child->prefix, prefix_len) == 0 &&
+                http_route_node_find(child, search, pos + prefix_len))
+                return true;
+        }
+
+        if (node->param && path[pos] != '/') {
+            const char *slash = memchr(path + pos, '/', search->len - pos);
+            size_t end = slash ? (size_t)(slash - path) : search->len;
+
+            match->params[match->param_count++] = (http_route_param){
+                .name = node->param->name,
+                .offset = pos,
+                .length = end - pos,
+            };
+            if (http_route_node_find(node->param, search, end))
+                return true;
+            match->param_count--;
+        }
+    }
+
+    if (node->wildcard) {
+        match->params[match->param_count++] = (http_route_param){
+            .name = node->wildcard->name,
+            .offset = pos,
+            .length = search->len - pos,
+        };
+        if (http_route_search_accept(search, node->wildcard))
+            return true;
+        match->param_count--;
+    }
+
+    return false;
+}
+
+ErrorMessage http_router_match(const http_router *this, const char *method,
+                               const char *path, size_t path_len,
+                               http_route_match *match) {
+    if (!this)
+        return "This is null";
+    if (!method || !path || !match)
+        return "Route error: missing method, path or match";
+
+    match->status = HTTP_ROUTE_NOT_FOUND;
+    match->handler = NULL;
+    match->on_body = NULL;
+    match->ctx = NULL;
+    match->allow = NULL;
+    match->param_count = 0;
+
+    http_route_search search = {
+        .method = method,
+        .path = path,
+        .len = path_len,
+        .match = match,
+    };
+
+    if (!http_route_node_find(this->root, &search, 0) && match->allow)
+        match->status = HTTP_ROUTE_METHOD_NOT_ALLOWED;
+
+    return NULL;
+}
+
+void http_router_delete(http_router *this) {
+    if (this) {
+        http_route_node_delete(this->root);
+        http_free(this);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "http/router.h"
+#include "sds.h"
+
+#include <stddef.h>
+
+typedef struct http_route {
+    sds                 method;
+    http_handler        handler;
+    http_body_handler   on_body;
+    void*               ctx;
+} http_route;
+
+/**
+ * Node of the compressed radix tree. Static children are indexed by
+ * the first byte of their prefix, parameter and wildcard children have
+ * an empty prefix and carry the parameter name instead.
+ */
+typedef struct http_route_node {
+    sds                         prefix;
+    sds                         name;
+
+    sds                         indices;
+    struct http_route_node**    children;
+    size_t                      child_count;
+
+    struct http_route_node*     param;
+    struct http_route_node*     wildcard;
+
+    http_route*                 routes;
+    size_t                      route_count;
+    sds                         allow;
+} http_route_node;
+
+struct http_router {
+    http_route_node*    root;
+};
@@ -0,0 +1,116 @@
+#include "scan.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HTTP_SCAN_X86
+#endif
+
+static inline bool http_scan_isStop(unsigned char c) {
+    return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+size_t http_scan_lineScalar(const char *data, size_t from, size_t len, char delim,
+                            size_t *delim_pos) {
+    for (size_t i = from; i < len; i++) {
+        if (http_scan_isStop(data[i]))
+            return i;
+        if (data[i] == delim && *delim_pos == SIZE_MAX)
+            *delim_pos = i;
+    }
+    return len;
+}
+
+#ifdef HTTP_SCAN_X86
+
+/**
+ * Records the first delimiter of a block that comes before its first
+ * stop byte.
+ *
+ * @returns true if the block holds a stop byte
+ */
+static inline bool http_scan_block(uint32_t stop, uint32_t found, size_t at,
+                                   size_t *delim_pos) {
+    if (stop)
+        found &= (stop & -stop) - 1;
+    if (found && *delim_pos == SIZE_MAX)
+        *delim_pos = at + __builtin_ctz(found);
+    return stop != 0;
+}
+
+// SSE2 is part of x86-64, only AVX2 needs a runtime check
+static size_t http_scan_lineSSE2(const char *data, size_t from, size_t len, char delim,
+                                 size_t *delim_pos) {
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i dlm = _mm_set1_epi8(delim);
+
+    size_t i = from;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        // Unsigned v <= 0x1f, minus tabs, plus DEL
+        __m128i stop = _mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v);
+        stop = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), stop);
+        stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, del));
+
+        uint32_t stop_mask = (uint32_t)_mm_movemask_epi8(stop);
+        uint32_t found_mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dlm));
+        if (http_scan_block(stop_mask, found_mask, i, delim_pos))
+            return i + __builtin_ctz(stop_mask);
+    }
+
+    return http_scan_lineScalar(data, i, len, delim, delim_pos);
+}
+
+__attribute__((target("avx2")))
+static size_t http_scan_lineAVX2(const char *data, size_t from, size_t len, char delim,
+                                 size_t *delim_pos) {
+    const __m256i ctl = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const __m256i dlm = _mm256_set1_epi8(delim);
+
+    size_t i = from;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i stop = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl), v);
+        stop = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), stop);
+        stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, del));
+
+        uint32_t stop_mask = (uint32_t)_mm256_movemask_epi8(stop);
+        uint32_t found_mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, dlm));
+        if (http_scan_block(stop_mask, found_mask, i, delim_pos))
+            return i + __builtin_ctz(stop_mask);
+    }
+
+    return http_scan_lineSSE2(data, i, len, delim, delim_pos);
+}
+
+typedef size_t (*http_scan_fn)(const char *, size_t, size_t, char, size_t *);
+
+static http_scan_fn http_scan_impl = http_scan_lineSSE2;
+
+// Picked once at load time so the hot path is a plain indirect call
+__attribute__((constructor))
+static void http_scan_select(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        http_scan_impl = http_scan_lineAVX2;
+}
+
+size_t http_scan_line(const char *data, size_t from, size_t len, char delim,
+                      size_t *delim_pos) {
+    return http_scan_impl(data, from, len, delim, delim_pos);
+}
+
+#else
+
+size_t http_scan_line(const char *data, size_t from, size_t len, char delim,
+                      size_t *delim_pos) {
+    return http_scan_lineScalar(data, from, len, delim, delim_pos);
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Scans data from byte from up to len for the end of a request line or
+ * header line. Stops at the first control character, which is CR or LF
+ * on a well formed line and anything else below 0x20 except HT, or DEL,
+ * on a malformed one. Bytes from 0x80 up are accepted as obs-text.
+ *
+ * In the same pass, if *delim_pos is SIZE_MAX it is set to the first
+ * occurrence of delim before the stop, so callers can split the line
+ * without scanning it again. Vectorized with AVX2 or SSE2 depending on
+ * what the CPU supports, with a scalar fallback.
+ *
+ * @param data      Buffer
+ * @param from      Offset to start scanning at
+ * @param len       Bytes available in data
+ * @param delim     Byte to locate, e.g. ':' in a header line
+ * @param delim_pos In/out offset of delim, SIZE_MAX until found
+ *
+ * @returns Offset of the first control character or len if there is none
+ */
+size_t  http_scan_line(const char *data, size_t from, size_t len, char delim,
+                       size_t *delim_pos);
+
+/**
+ * Byte at a time version of http_scan_line, used for short tails and on
+ * CPUs without vector support
+ */
+size_t  http_scan_lineScalar(const char *data, size_t from, size_t len, char delim,
+                             size_t *delim_pos);
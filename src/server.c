@@ -1,108 +1,1113 @@
+#include "http/alloc.h"
 #include "http/request.h"
+#include "http/response.h"
 #include "http/results.h"
+#include "file/file.h"
+#include "http/router.h"
 #include "logger/logger.h"
+#include "map/map.h"
+#include "request/request_internal.h"
+#include "response/response_codes.h"
+#include "response/response_internal.h"
 #include "sds.h"
 #include "server_internal.h"
+#include "uring/uring.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <http/server.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #define READ_CHUNK 4096
 
+DEFINE_RESULT_TYPE(http_server *, HTTPServerResult);
+
+/**
+ * Sets the per-client state of a new or recycled connection to that of
+ * a fresh one. Buffers are left alone.
+ */
+static void http_connection_clear(http_connection *this) {
+    this->fd = -1;
+    this->pipe_pending = 0;
+    http_parser_init(&this->parser);
+    this->request = NULL;
+    this->routed = false;
+    this->spilling = false;
+    this->stream = NULL;
+    this->keep_alive = true;
+    this->eof = false;
+    this->read_at = 0;
+    this->request_start = 0;
+    this->send_start = 0;
+    this->parse_ns = 0;
+    this->pending_ops = 0;
+    this->recv_armed = false;
+    this->recv_cancelled = false;
+    this->recv_oneshot = false;
+    this->send_pending = false;
+    this->closing = false;
+    this->worker = NULL;
+    this->next = NULL;
+    this->prev = NULL;
+}
+
 http_connection *http_connection_new() {
-    http_connection *new_connection = malloc(sizeof(http_connection));
-    new_connection->fd = 0;
+    http_connection *new_connection = http_malloc(sizeof(http_connection));
+    if (!new_connection)
+        return NULL;
     new_connection->buffer = sdsempty();
-    new_connection->content_length = 0;
-    new_connection->header_parsed = false;
-    new_connection->keep_alive = false;
+    http_output_init(&new_connection->out);
+    new_connection->pipe_fds[0] = -1;
+    new_connection->pipe_fds[1] = -1;
+    http_arena_init(&new_connection->arena, 0);
+    http_spill_init(&new_connection->spill, 0);
+    http_connection_clear(new_connection);
 
     return new_connection;
 }
 
+/**
+ * Memory a pooled connection holds on to
+ */
+static size_t http_connection_footprint(const http_connection *this) {
+    size_t bytes = sizeof(http_connection) + sdsalloc(this->buffer) +
+                   http_arena_capacity(&this->arena);
+    if (this->out.spare)
+        bytes += sdsalloc(this->out.spare->data);
+    if (this->spill.memory)
+        bytes += sdsalloc(this->spill.memory);
+    return bytes;
+}
+
+/**
+ * Drops what the last client left in this and puts it in the pool of
+ * worker, trimmed to buffers worth keeping. Deleted instead once the
+ * pool is full.
+ */
+static void http_worker_recycle(http_worker *worker, http_connection *this) {
+    // Closing the fd also drops it from the epoll interest list
+    if (this->fd >= 0)
+        close(this->fd);
+    this->fd = -1;
+    if (this->request)
+        http_request_delete(this->request);
+    this->request = NULL;
+    http_response_delete(this->stream);
+    this->stream = NULL;
+    http_spill_reset(&this->spill);
+    http_output_clear(&this->out);
+
+    // Leftovers in the splice pipe would go to the next client, and
+    // pipe_pending is zeroed when a splice fails
+    int unread = 0;
+    if (this->pipe_fds[0] >= 0 &&
+        (ioctl(this->pipe_fds[0], FIONREAD, &unread) < 0 || unread > 0)) {
+        close(this->pipe_fds[0]);
+        close(this->pipe_fds[1]);
+        this->pipe_fds[0] = -1;
+        this->pipe_fds[1] = -1;
+    }
+
+    if (sdsalloc(this->buffer) > HTTP_POOL_MAX_BUFFER) {
+        sdsfree(this->buffer);
+        this->buffer = sdsempty();
+    } else {
+        sdsclear(this->buffer);
+    }
+    if (http_arena_capacity(&this->arena) > HTTP_POOL_MAX_BUFFER)
+        http_arena_deinit(&this->arena);
+
+    size_t bytes = http_connection_footprint(this);
+    if (!this->buffer || worker->pool_count >= HTTP_POOL_MAX_CONNECTIONS ||
+        worker->pool_bytes + bytes > HTTP_POOL_MAX_RETAINED) {
+        http_connection_delete(this);
+        return;
+    }
+
+    http_connection_clear(this);
+    this->next = worker->pool;
+    worker->pool = this;
+    worker->pool_count++;
+    worker->pool_bytes += bytes;
+}
+
+/**
+ * Frees every pooled connection of worker
+ */
+static void http_worker_clearPool(http_worker *worker) {
+    while (worker->pool) {
+        http_connection *next = worker->pool->next;
+        http_connection_delete(worker->pool);
+        worker->pool = next;
+    }
+    worker->pool_count = 0;
+    worker->pool_bytes = 0;
+}
+
+void http_connection_close(http_connection *this) {
+    http_worker *worker = this->worker;
+    if (!worker) {
+        http_connection_delete(this);
+        return;
+    }
+
+    if (this->prev)
+        this->prev->next = this->next;
+    else
+        worker->connections = this->next;
+    if (this->next)
+        this->next->prev = this->prev;
+    worker->connection_count--;
+    http_metrics_add(worker->metrics, HTTP_COUNTER_CONNECTIONS_CLOSED, 1);
+
+    http_worker_recycle(worker, this);
+}
+
+void http_connection_abort(http_connection *this) {
+    http_output_clear(&this->out);
+    http_response_delete(this->stream);
+    this->stream = NULL;
+    this->keep_alive = false;
+    this->eof = true;
+}
+
+/**
+ * Serializes res for req onto this->out, filling in the headers the
+ * handler is not expected to care about. A streamed body is framed
+ * here but queued later by http_connection_pump.
+ *
+ * @returns false if res could not be serialized
+ */
+static bool http_connection_queue(http_connection *this, http_request *req,
+                                  http_response *res) {
+    bool http10 = false;
+    if (req) {
+        http_version *version = http_request_Version(req).Value;
+        http10 = version->major == 1 && version->minor == 0;
+    }
+
+    // Answer HTTP/1.0 clients in kind
+    if (http10)
+        http_response_SetVersion(res, 1, 0);
+    // 1xx, 204 and 304 never have a body (RFC 9110 §8.6), whatever the
+    // handler set: any bytes after the head would be read as the next
+    // response
+    uint16_t status = res->status_code;
+    bool bodiless = status < 200 || status == HTTP_STATUS_NO_CONTENT ||
+                    status == HTTP_STATUS_NOT_MODIFIED;
+    if (bodiless)
+        http_response_dropBody(res);
+    bool framed = map_get(&res->header, "content-length") != NULL || bodiless;
+    // HEAD gets the headers GET would, less the framing of a streamed
+    // body whose length is only known once it is produced
+    bool head = req && strcmp(http_request_Method(req).Value, "HEAD") == 0;
+    bool streamed = res->producer != NULL;
+    if (head && streamed)
+        http_response_dropBody(res);
+    if (res->producer && !framed) {
+        // The body ends with the last chunk, or with the connection for
+        // clients that can't take chunks
+        if (req && !http10 && res->version.major == 1 && res->version.minor >= 1) {
+            res->chunked = true;
+            http_response_HeaderSetValue(res, "Transfer-Encoding", "chunked");
+        } else {
+            this->keep_alive = false;
+        }
+    } else if (!framed && !streamed) {
+        char content_length[24];
+        snprintf(content_length, sizeof(content_length), "%zu", res->body.length);
+        http_response_HeaderSetValue(res, "Content-Length", content_length);
+    }
+    if (!this->keep_alive)
+        http_response_HeaderSetValue(res, "Connection", "close");
+    else if (http10)
+        http_response_HeaderSetValue(res, "Connection", "keep-alive");
+    if (head)
+        http_response_dropBody(res);
+
+    ErrorMessage err = http_response_writeTo(res, &this->out);
+    if (err) {
+        LOG_ERROR("Error serializing response: %s", err);
+        this->keep_alive = false;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Pulls the streamed body of this->stream until enough output is
+ * pending or the body ends, then drops the response
+ */
+static void http_connection_pump(http_connection *this) {
+    while (this->out.pending < HTTP_MAX_PENDING_OUTPUT) {
+        bool done;
+        ErrorMessage err = http_response_produce(this->stream, &this->out, &done);
+        if (err) {
+            // Cut short, the client tells from the missing last chunk
+            LOG_ERROR("Error streaming response: %s", err);
+            this->keep_alive = false;
+            done = true;
+        }
+        if (done) {
+            http_response_delete(this->stream);
+            this->stream = NULL;
+            return;
+        }
+    }
+}
+
+/**
+ * Queues an empty response with status_code, for requests that never
+ * reach a handler.
+ */
+static void http_connection_respond(http_connection *this, http_request *req,
+                                    uint16_t status_code) {
+    HTTPResponseResult res_res = http_response_new();
+    if (!res_res.Ok) {
+        LOG_ERROR("Error allocating response object: %s", res_res.Err);
+        this->keep_alive = false;
+        return;
+    }
+    http_response *res = res_res.Value;
+
+    http_response_SetStatusCode(res, status_code);
+    http_connection_queue(this, req, res);
+
+    http_response_delete(res);
+}
+
+/**
+ * Looks up the route of req into this->match as soon as its head is
+ * parsed, so a streaming route gets its body before it is complete.
+ * Bodies of other routes that may outgrow the spill threshold are
+ * streamed into this->spill instead of the buffer. The query string is
+ * not part of the routed path.
+ *
+ * @returns false if the request was answered and the connection must
+ *          close
+ */
+static bool http_connection_route(http_connection *this, http_request *req,
+                                  http_parse_status status) {
+    const char *method = http_request_Method(req).Value;
+    const char *uri = http_request_Uri(req).Value;
+    size_t path_len = strcspn(uri, "?");
+
+    ErrorMessage err = http_router_match(this->worker->server->router, method, uri,
+                                         path_len, &this->match);
+    if (err) {
+        LOG_ERROR("Error routing request: %s", err);
+        this->keep_alive = false;
+        http_connection_respond(this, req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+        return false;
+    }
+
+    this->routed = true;
+    if (this->match.status != HTTP_ROUTE_FOUND)
+        return true;
+
+    http_request_setParams(req, &this->match);
+    size_t threshold = this->worker->server->body_spill_threshold;
+    if (this->match.on_body) {
+        this->parser.stream_body = true;
+    } else if (threshold > 0 && status == HTTP_PARSE_HEADERS_COMPLETE &&
+               (this->parser.chunked || this->parser.content_length > threshold)) {
+        // Chunked bodies give no size up front, they spill once they
+        // pass threshold
+        this->spill.threshold = threshold;
+        this->spilling = true;
+        this->parser.stream_body = true;
+    }
+    return true;
+}
+
+/**
+ * Adds a piece of body to this->spill
+ *
+ * @returns false if the request was answered and the connection must
+ *          close
+ */
+static bool http_connection_spillBody(http_connection *this, http_request *req,
+                                      const char *data, size_t len) {
+    ErrorMessage err = http_spill_write(&this->spill, data, len);
+    if (!err)
+        return true;
+
+    LOG_ERROR("Error storing request body: %s", err);
+    this->keep_alive = false;
+    http_connection_respond(this, req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+    return false;
+}
+
+/**
+ * Attaches the body collected in this->spill to req
+ *
+ * @returns false if the request was answered and the connection must
+ *          close
+ */
+static bool http_connection_attachSpill(http_connection *this, http_request *req) {
+    void *data;
+    ErrorMessage err = http_spill_view(&this->spill, &data);
+    if (err) {
+        LOG_ERROR("Error storing request body: %s", err);
+        this->keep_alive = false;
+        http_connection_respond(this, req, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+        return false;
+    }
+
+    if (this->spill.fd >= 0)
+        http_request_setBodyFile(req, data, this->spill.length, this->spill.fd);
+    else
+        http_request_setBody(req, data, this->spill.length);
+    return true;
+}
+
+/**
+ * Hands a piece of body to the streaming route of req
+ *
+ * @returns false if the handler refused it, the request is answered
+ *          and the connection must close
+ */
+static bool http_connection_streamBody(http_connection *this, http_request *req,
+                                       const char *data, size_t len) {
+    if (len == 0 || this->match.on_body(req, data, len, this->match.ctx))
+        return true;
+
+    this->keep_alive = false;
+    http_connection_respond(this, req, HTTP_STATUS_PAYLOAD_TOO_LARGE);
+    return false;
+}
+
+/**
+ * Cuts the streamed body bytes the parser is done with out of the
+ * buffer, the request starts at offset
+ */
+static void http_connection_releaseBody(http_connection *this, size_t offset) {
+    size_t cut = http_parser_release(&this->parser);
+    if (cut == 0)
+        return;
+
+    char *from = this->buffer + offset + this->parser.body_start;
+    size_t tail = sdslen(this->buffer) - (size_t)(from - this->buffer) - cut;
+    memmove(from, from + cut, tail + 1);
+    sdssetlen(this->buffer, sdslen(this->buffer) - cut);
+}
+
+/**
+ * Runs the handler routed for req and queues the response
+ */
+static void http_connection_dispatch(http_connection *this, http_request *req) {
+    http_route_match *match = &this->match;
+    this->routed = false;
+
+    if (match->status == HTTP_ROUTE_NOT_FOUND) {
+        http_connection_respond(this, req, HTTP_STATUS_NOT_FOUND);
+        return;
+    }
+
+    HTTPResponseResult res_res = http_response_new();
+    if (!res_res.Ok) {
+        LOG_ERROR("Error allocating response object: %s", res_res.Err);
+        this->keep_alive = false;
+        return;
+    }
+    http_response *res = res_res.Value;
+
+    if (match->status == HTTP_ROUTE_METHOD_NOT_ALLOWED) {
+        http_response_SetStatusCode(res, HTTP_STATUS_METHOD_NOT_ALLOWED);
+        http_response_HeaderSetValue(res, "Allow", match->allow);
+    } else {
+        http_response_SetStatusCode(res, HTTP_STATUS_OK);
+        match->handler(req, res, match->ctx);
+    }
+
+    // A streamed response stays with the connection until its body ends
+    if (http_connection_queue(this, req, res) && res->producer) {
+        this->stream = res;
+        return;
+    }
+    http_response_delete(res);
+}
+
+bool http_connection_process(http_connection *this) {
+    http_metrics *metrics = this->worker->metrics;
+    size_t offset = 0;
+    bool backpressure = false;
+
+    while (this->stream || (this->keep_alive && offset < sdslen(this->buffer))) {
+        if (this->out.pending >= HTTP_MAX_PENDING_OUTPUT) {
+            backpressure = true;
+            break;
+        }
+
+        // Pipelined requests wait until the streamed body is out
+        if (this->stream) {
+            http_connection_pump(this);
+            continue;
+        }
+
+        if (!this->request) {
+            HTTPRequestResult req_res = http_request_newInArena(&this->arena);
+            if (!req_res.Ok) {
+                LOG_ERROR("Error allocating request object: %s", req_res.Err);
+                this->keep_alive = false;
+                break;
+            }
+            this->request = req_res.Value;
+            // Requests never outlive the buffer they were read into
+            http_request_SetZeroCopy(this->request, true);
+            http_parser_init(&this->parser);
+            this->routed = false;
+            this->request_start = this->read_at;
+            this->parse_ns = 0;
+        }
+
+        http_request *req = this->request;
+        uint64_t parse_start = http_metrics_start(metrics);
+        http_parse_status status =
+            http_parser_feed(&this->parser, req, this->buffer + offset,
+                             sdslen(this->buffer) - offset);
+        if (metrics)
+            this->parse_ns += http_metrics_now() - parse_start;
+        if (status == HTTP_PARSE_ERROR) {
+            LOG_ERROR("Error parsing request: %s", this->parser.err);
+            http_metrics_parseError(metrics, this->parser.reason);
+            this->keep_alive = false;
+            http_connection_respond(this, NULL, HTTP_STATUS_BAD_REQUEST);
+            break;
+        }
+        if (status == HTTP_PARSE_INCOMPLETE) {
+            http_connection_releaseBody(this, offset);
+            break;
+        }
+        if (!this->routed && !http_connection_route(this, req, status))
+            break;
+        if (status == HTTP_PARSE_HEADERS_COMPLETE)
+            continue;
+        if (status == HTTP_PARSE_BODY_CHUNK) {
+            bool ok = this->spilling
+                          ? http_connection_spillBody(this, req, this->parser.chunk,
+                                                      this->parser.chunk_length)
+                          : http_connection_streamBody(this, req, this->parser.chunk,
+                                                       this->parser.chunk_length);
+            if (!ok)
+                break;
+            http_connection_releaseBody(this, offset);
+            continue;
+        }
+        if (this->spilling && !http_connection_attachSpill(this, req))
+            break;
+
+        // Arrived whole before streaming could start, hand it over at once
+        if (this->match.on_body && this->match.status == HTTP_ROUTE_FOUND) {
+            http_body *body = http_request_Body(req).Value;
+            if (!http_connection_streamBody(this, req, body->data, body->length))
+                break;
+            http_request_setBody(req, NULL, 0);
+        }
+
+        BoolResult keep_alive = http_request_KeepAlive(req);
+        this->keep_alive = keep_alive.Ok && keep_alive.Value;
+
+        uint64_t handle_start = http_metrics_start(metrics);
+        http_connection_dispatch(this, this->request);
+        if (metrics) {
+            uint64_t now = http_metrics_now();
+            http_metrics_record(metrics, HTTP_STAGE_HANDLE, now - handle_start);
+            http_metrics_record(metrics, HTTP_STAGE_PARSE, this->parse_ns);
+            http_metrics_record(metrics, HTTP_STAGE_REQUEST, now - this->request_start);
+            http_metrics_add(metrics, HTTP_COUNTER_REQUESTS, 1);
+        }
+        if (this->spilling) {
+            http_spill_reset(&this->spill);
+            this->spilling = false;
+        }
+
+        offset += this->parser.consumed;
+        http_request_delete(this->request);
+        this->request = NULL;
+    }
+
+    // The request in progress, if any, now starts at the buffer head
+    if (offset > 0)
+        sdsrange(this->buffer, offset, -1);
+
+    return backpressure;
+}
+
+/**
+ * Drains the socket until EAGAIN as required by edge-triggered epoll.
+ *
+ * @returns false if the connection must be closed
+ */
+static bool http_connection_readAll(http_connection *this, bool *more) {
+    char tmp[READ_CHUNK];
+
+    *more = false;
+    while (true) {
+        // A streamed body is read no faster than its handler takes it,
+        // and a new request is routed before much of its body is read
+        if ((!this->request || this->parser.stream_body) &&
+            sdslen(this->buffer) >= HTTP_MAX_STREAM_BUFFER) {
+            *more = true;
+            return true;
+        }
+
+        ssize_t nread = read(this->fd, tmp, sizeof(tmp));
+        if (nread > 0) {
+            sds buffer = sdscatlen(this->buffer, tmp, nread);
+            if (!buffer) {
+                LOG_ERROR("Error reading from client: out of memory");
+                return false;
+            }
+            this->buffer = buffer;
+            http_metrics_add(this->worker->metrics, HTTP_COUNTER_BYTES_IN, nread);
+            continue;
+        }
+        if (nread == 0) {
+            this->eof = true;
+            return true;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return true;
+
+        LOG_ERROR("Error reading from client: %s", strerror(errno));
+        return false;
+    }
+}
+
+/**
+ * Writes as much of this->out as the socket takes, gathering queued
+ * heads and bodies into one sendmsg per batch. File bodies go out with
+ * sendfile.
+ *
+ * @returns false if the connection must be closed
+ */
+static bool http_connection_flush(http_connection *this) {
+    while (this->out.pending > 0) {
+        ssize_t nwritten;
+        int file_fd;
+        off_t file_offset;
+        size_t file_length;
+        if (http_output_file(&this->out, &file_fd, &file_offset, &file_length)) {
+            nwritten = sendfile(this->fd, file_fd, &file_offset, file_length);
+            // The file shrank under us, Content-Length can't be honoured
+            if (nwritten == 0) {
+                LOG_ERROR("Error writing to client: body file truncated");
+                return false;
+            }
+        } else {
+            struct iovec iov[HTTP_OUTPUT_MAX_IOVEC];
+            struct msghdr msg = {
+                .msg_iov = iov,
+                .msg_iovlen = http_output_iovec(&this->out, iov, HTTP_OUTPUT_MAX_IOVEC),
+            };
+            nwritten = sendmsg(this->fd, &msg, MSG_NOSIGNAL);
+        }
+        if (nwritten > 0) {
+            http_output_consume(&this->out, nwritten);
+            http_metrics_add(this->worker->metrics, HTTP_COUNTER_BYTES_OUT, nwritten);
+            continue;
+        }
+        if (nwritten < 0 && errno == EINTR)
+            continue;
+        if (nwritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        LOG_ERROR("Error writing to client: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool http_connection_onEvent(http_connection *this) {
+    http_metrics *metrics = this->worker->metrics;
+    while (true) {
+        bool can_read = this->out.pending < HTTP_MAX_PENDING_OUTPUT;
+        bool more = false;
+        if (can_read && !this->eof) {
+            uint64_t read_start = http_metrics_start(metrics);
+            if (!http_connection_readAll(this, &more))
+                return false;
+            if (metrics) {
+                this->read_at = http_metrics_now();
+                http_metrics_record(metrics, HTTP_STAGE_READ, this->read_at - read_start);
+            }
+        }
+
+        bool backpressure = http_connection_process(this);
+        bool writing = this->out.pending > 0;
+        uint64_t write_start = http_metrics_start(metrics);
+        if (!http_connection_flush(this))
+            return false;
+        if (writing)
+            http_metrics_stop(metrics, HTTP_STAGE_WRITE, write_start);
+
+        // Wait for EPOLLOUT to resume
+        if (this->out.pending > 0)
+            return true;
+        if (this->stream)
+            continue;
+        if (!this->keep_alive || (can_read && !backpressure && !more))
+            break;
+    }
+
+    return this->keep_alive && !this->eof;
+}
+
+http_connection *http_worker_addConnection(http_worker *this, int fd) {
+    http_connection *client = this->pool;
+    if (client) {
+        this->pool = client->next;
+        this->pool_count--;
+        this->pool_bytes -= http_connection_footprint(client);
+        client->next = NULL;
+    } else {
+        client = http_connection_new();
+    }
+    if (!client || !client->buffer) {
+        LOG_ERROR("Connection error: could not allocate connection");
+        http_connection_delete(client);
+        close(fd);
+        return NULL;
+    }
+
+    client->fd = fd;
+    client->worker = this;
+    client->next = this->connections;
+    if (this->connections)
+        this->connections->prev = client;
+    this->connections = client;
+    this->connection_count++;
+    http_metrics_add(this->metrics, HTTP_COUNTER_CONNECTIONS_OPENED, 1);
+
+    return client;
+}
+
+static void http_worker_acceptAll(http_worker *this) {
+    while (true) {
+        uint64_t start = http_metrics_start(this->metrics);
+        int client_fd = accept4(this->listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG_ERROR("Connection error: failed to accept connection: %s", strerror(errno));
+            return;
+        }
+
+        http_connection *client = http_worker_addConnection(this, client_fd);
+        if (!client)
+            continue;
+
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                                 .data.ptr = client};
+        if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            LOG_ERROR("Connection error: could not watch client: %s", strerror(errno));
+            http_connection_close(client);
+            continue;
+        }
+        http_metrics_stop(this->metrics, HTTP_STAGE_ACCEPT, start);
+    }
+}
+
 ErrorMessage http_connection_bindAndListen(http_connection *this, int port) {
-    int client_fd;
     struct sockaddr_in address;
-    socklen_t addrlen = sizeof(address);
 
-    this->fd = socket(AF_INET, SOCK_STREAM, 0);
+    this->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (this->fd == -1) {
         return "Connection error: could not create socket";
     }
 
+    int opt = 1;
+    setsockopt(this->fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(this->fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        close(this->fd);
+        this->fd = -1;
+        return "Connection error: could not set SO_REUSEPORT";
+    }
+
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
 
     if(bind(this->fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
         close(this->fd);
+        this->fd = -1;
         return "Connection error: could not bind socket";
     }
 
-    if (listen(this->fd, 10) < 0) {
+    if (listen(this->fd, HTTP_LISTEN_BACKLOG) < 0) {
         close(this->fd);
+        this->fd = -1;
         return "Connection error: could not listen through socket";
     }
 
-    LOG_DEBUG("Server listening on port %d...\n", port);
+    return NULL;
+}
 
-    char tmp[READ_CHUNK];
-    while (true) {
-        client_fd = accept(this->fd, (struct sockaddr*)&address, &addrlen);
-        if (client_fd < 0) {
-            LOG_ERROR("Connection error: failed to accept connection: %s", strerror(errno));
-            continue;
+void http_connection_delete(http_connection *this) {
+    if (this) {
+        if (this->fd >= 0)
+            close(this->fd);
+        if (this->buffer)
+            sdsfree(this->buffer);
+        http_output_deinit(&this->out);
+        if (this->pipe_fds[0] >= 0) {
+            close(this->pipe_fds[0]);
+            close(this->pipe_fds[1]);
         }
+        if (this->request)
+            http_request_delete(this->request);
+        http_response_delete(this->stream);
+        http_spill_deinit(&this->spill);
+        http_arena_deinit(&this->arena);
+        http_free(this);
+    }
+}
+
+ErrorMessage http_worker_run(http_worker *this) {
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd < 0)
+        return "Worker error: could not create epoll instance";
 
-        size_t nread;
-        while((nread = read(client_fd, tmp, sizeof(tmp))) > 0) {
-            this->buffer = sdscatlen(this->buffer, tmp, nread);
-            // TODO: Look for complete request or keep_alive: false
-            // probably change parse strategy to stream reading strategy
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLET, .data.ptr = this->listener};
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->listener->fd, &ev) < 0) {
+        close(this->epoll_fd);
+        return "Worker error: could not watch listening socket";
+    }
+
+    // Level-triggered and never read so every worker sees the stop
+    struct epoll_event stop_ev = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->server->stop_fd, &stop_ev) < 0) {
+        close(this->epoll_fd);
+        return "Worker error: could not watch stop event";
+    }
+
+    ErrorMessage err = NULL;
+    bool running = true;
+    struct epoll_event events[HTTP_MAX_EVENTS];
+    while (running) {
+        int n = epoll_wait(this->epoll_fd, events, HTTP_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("Worker error: epoll_wait failed: %s", strerror(errno));
+            err = "Worker error: event loop failed";
+            break;
         }
 
-        if (nread < 0) {
-            LOG_ERROR("Error reading from client: %s", strerror(errno));
-            sdsclear(this->buffer);
-            close(client_fd);
-            continue;
+        for (int i = 0; i < n; i++) {
+            http_connection *conn = events[i].data.ptr;
+            if (conn == NULL) {
+                running = false;
+                continue;
+            }
+
+            if (conn == this->listener) {
+                http_worker_acceptAll(this);
+                continue;
+            }
+
+            if (events[i].events & EPOLLERR) {
+                http_connection_close(conn);
+                continue;
+            }
+
+            if (!http_connection_onEvent(conn))
+                http_connection_close(conn);
         }
+    }
 
-        // PROCESS buffer
-        HTTPRequestResult req_res = http_request_new();
-        if (!req_res.Ok) {
-            LOG_ERROR("Error allocating request object: %s", req_res.Err);
-            sdsclear(this->buffer);
-            close(client_fd);
-            continue;
+    while (this->connections)
+        http_connection_close(this->connections);
+    close(this->epoll_fd);
+    this->epoll_fd = -1;
+
+    return err;
+}
+
+static void *http_worker_thread(void *arg) {
+    http_worker *worker = arg;
+
+    // sendfile and splice have no MSG_NOSIGNAL, a peer that went away
+    // must not kill the process
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, NULL);
+    if (worker->server->backend == HTTP_BACKEND_IO_URING)
+        worker->err = http_worker_runUring(worker);
+    else
+        worker->err = http_worker_run(worker);
+    if (worker->err)
+        LOG_ERROR("Worker %zu stopped: %s", worker->id, worker->err);
+
+    http_file_cacheClear();
+    return NULL;
+}
+
+static size_t http_server_defaultWorkers(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (size_t)cpus : 1;
+}
+
+HTTPServerResult http_server_new(void) {
+    http_server *server = http_malloc(sizeof(http_server));
+    if (!server)
+        return HTTPServerResult_Error("Failed to allocate memory");
+
+    atomic_init(&server->port, 0);
+    server->backend = HTTP_BACKEND_EPOLL;
+    server->worker_count = http_server_defaultWorkers();
+    server->body_spill_threshold = HTTP_DEFAULT_BODY_SPILL;
+    server->workers = NULL;
+    server->metrics_enabled = false;
+    server->metrics = NULL;
+    server->metrics_count = 0;
+    atomic_init(&server->running, false);
+
+    HTTPRouterResult router_res = http_router_new();
+    if (!router_res.Ok) {
+        http_free(server);
+        return HTTPServerResult_Error(router_res.Err);
+    }
+    server->router = router_res.Value;
+
+    server->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->stop_fd < 0) {
+        http_router_delete(server->router);
+        http_free(server);
+        return HTTPServerResult_Error("Failed to create stop event");
+    }
+
+    return HTTPServerResult_Ok(server);
+}
+
+ErrorMessage http_server_SetWorkers(http_server *this, size_t workers) {
+    if (!this)
+        return "This is null";
+    if (atomic_load(&this->running))
+        return "Cannot change workers while listening";
+
+    this->worker_count = workers ? workers : http_server_defaultWorkers();
+    return NULL;
+}
+
+ErrorMessage http_server_SetBackend(http_server *this, http_backend backend) {
+    if (!this)
+        return "This is null";
+    if (atomic_load(&this->running))
+        return "Cannot change backend while listening";
+    if (backend != HTTP_BACKEND_EPOLL && backend != HTTP_BACKEND_IO_URING)
+        return "Unknown backend";
+
+    this->backend = backend;
+    return NULL;
+}
+
+ErrorMessage http_server_SetBodySpillThreshold(http_server *this, size_t threshold) {
+    if (!this)
+        return "This is null";
+    if (atomic_load(&this->running))
+        return "Cannot change body spill threshold while listening";
+
+    this->body_spill_threshold = threshold;
+    return NULL;
+}
+
+ErrorMessage http_server_AddRoute(http_server *this, const char *method,
+                                  const char *pattern, http_handler handler, void *ctx) {
+    if (!this)
+        return "This is null";
+    // Workers read the router without locking
+    if (atomic_load(&this->running))
+        return "Cannot add routes while listening";
+
+    return http_router_add(this->router, method, pattern, handler, ctx);
+}
+
+ErrorMessage http_server_AddStreamingRoute(http_server *this, const char *method,
+                                           const char *pattern, http_body_handler on_body,
+                                           http_handler handler, void *ctx) {
+    if (!this)
+        return "This is null";
+    if (atomic_load(&this->running))
+        return "Cannot add routes while listening";
+
+    return http_router_addStreaming(this->router, method, pattern, on_body, handler, ctx);
+}
+
+/**
+ * Handler of the metrics route, ctx is the server
+ */
+static void http_server_serveMetrics(http_request *req, http_response *res, void *ctx) {
+    SDSResult text = http_server_Metrics(ctx);
+    if (!text.Ok) {
+        LOG_ERROR("Error rendering metrics: %s", text.Err);
+        http_response_SetStatusCode(res, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+        return;
+    }
+
+    http_response_HeaderSetValue(res, "Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+    http_response_SetBody(res, text.Value, sdslen(text.Value));
+    sdsfree(text.Value);
+}
+
+ErrorMessage http_server_EnableMetrics(http_server *this, const char *path) {
+    if (!this)
+        return "This is null";
+    if (atomic_load(&this->running))
+        return "Cannot enable metrics while listening";
+
+    if (path) {
+        ErrorMessage err =
+            http_router_add(this->router, "GET", path, http_server_serveMetrics, this);
+        if (err)
+            return err;
+    }
+    this->metrics_enabled = true;
+    return NULL;
+}
+
+SDSResult http_server_Metrics(http_server *this) {
+    if (!this)
+        return SDSResult_Error("This is null");
+    if (!this->metrics_enabled)
+        return SDSResult_Error("Metrics are not enabled");
+
+    sds text = http_metrics_render(this->metrics, this->metrics_count);
+    if (!text)
+        return SDSResult_Error("Out of memory");
+    return SDSResult_Ok(text);
+}
+
+UInt16Result http_server_Port(http_server *this) {
+    if (!this)
+        return UInt16Result_Error("This is null");
+    return UInt16Result_Ok(atomic_load(&this->port));
+}
+
+static void http_server_closeWorkers(http_server *this) {
+    for (size_t i = 0; i < this->worker_count; i++) {
+        http_connection_delete(this->workers[i].listener);
+        http_worker_clearPool(&this->workers[i]);
+    }
+    http_free(this->workers);
+    this->workers = NULL;
+}
+
+ErrorMessage http_server_listen(http_server *this, uint16_t port) {
+    if (!this)
+        return "This is null";
+
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&this->running, &expected, true))
+        return "Server is already listening";
+
+    if (this->backend == HTTP_BACKEND_IO_URING && !http_uring_isSupported()) {
+        LOG_WARNING("io_uring backend not supported by this kernel, using epoll");
+        this->backend = HTTP_BACKEND_EPOLL;
+    }
+
+    this->workers = http_calloc(this->worker_count, sizeof(http_worker));
+    if (!this->workers) {
+        atomic_store(&this->running, false);
+        return "Failed to allocate memory";
+    }
+
+    // Counters carry over from the last listen unless workers changed
+    if (this->metrics_enabled && this->metrics_count != this->worker_count) {
+        http_free(this->metrics);
+        this->metrics = http_calloc(this->worker_count, sizeof(http_metrics));
+        this->metrics_count = this->metrics ? this->worker_count : 0;
+        if (!this->metrics) {
+            http_free(this->workers);
+            this->workers = NULL;
+            atomic_store(&this->running, false);
+            return "Failed to allocate memory";
         }
+    }
 
-        http_request* req = req_res.Value;
-        ErrorMessage reqErr = http_request_parse(req, this->buffer, sdslen(this->buffer));
-        if (reqErr){
-            LOG_ERROR("Error parsing request: %s", reqErr);
-            http_request_delete(req);
-            sdsclear(this->buffer);// conn object conn.buffer gets reused
-            close(client_fd);
-            continue;
+    // Bind every listener up front so bind errors are reported here and
+    // port 0 resolves to the same ephemeral port for every worker
+    ErrorMessage err = NULL;
+    for (size_t i = 0; i < this->worker_count && !err; i++) {
+        http_worker *worker = &this->workers[i];
+        worker->id = i;
+        worker->server = this;
+        worker->epoll_fd = -1;
+        worker->metrics = this->metrics_enabled ? &this->metrics[i] : NULL;
+        worker->listener = http_connection_new();
+        if (!worker->listener) {
+            err = "Failed to allocate memory";
+            break;
+        }
+
+        err = http_connection_bindAndListen(worker->listener, port);
+        if (!err && port == 0) {
+            struct sockaddr_in bound;
+            socklen_t bound_len = sizeof(bound);
+            getsockname(worker->listener->fd, (struct sockaddr *)&bound, &bound_len);
+            port = ntohs(bound.sin_port);
+        }
+    }
+    atomic_store(&this->port, port);
+
+    size_t started = 0;
+    for (; started < this->worker_count && !err; started++) {
+        if (pthread_create(&this->workers[started].thread, NULL,
+                           http_worker_thread, &this->workers[started]) != 0) {
+            err = "Failed to start worker thread";
+            http_server_stop(this);
+            break;
         }
+    }
 
-        // TODO: Read METHOD and pass to funcition in TRIE (TRIE not implemented yet)
+    LOG_DEBUG("Server listening on port %d with %zu workers...\n", port, started);
 
-        // CLEAN
-        sdsclear(this->buffer);
-        http_request_delete(req);
-        close(client_fd);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(this->workers[i].thread, NULL);
+        if (!err)
+            err = this->workers[i].err;
     }
+
+    http_server_closeWorkers(this);
+
+    // Re-arm for the next listen
+    uint64_t drained;
+    while (read(this->stop_fd, &drained, sizeof(drained)) > 0)
+        ;
+    atomic_store(&this->running, false);
+
+    return err;
 }
 
-void http_connection_delete(http_connection *this) {
+void http_server_stop(http_server *this) {
+    if (!this)
+        return;
+    // Only write(2) here so this stays async-signal-safe
+    uint64_t one = 1;
+    ssize_t written = write(this->stop_fd, &one, sizeof(one));
+    (void)written;
+}
+
+void http_server_delete(http_server *this) {
     if (this) {
-        close(this->fd);
-        if (this->buffer)
-            sdsfree(this->buffer);
-        free(this);
+        if (this->workers)
+            http_server_closeWorkers(this);
+        close(this->stop_fd);
+        http_router_delete(this->router);
+        http_free(this->metrics);
+        http_free(this);
     }
 }
@@ -1,18 +1,195 @@
 #pragma once
 
+#include "arena/arena.h"
+#include "http/request.h"
+#include "http/response.h"
+#include "http/results.h"
+#include "http/router.h"
+#include "http/server.h"
+#include "metrics/metrics.h"
+#include "output/output.h"
+#include "request/parser.h"
+#include "request/spill.h"
 #include "sds.h"
 #include <netinet/in.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
 
+#define HTTP_LISTEN_BACKLOG     SOMAXCONN
+#define HTTP_MAX_EVENTS         256
+#define HTTP_MAX_PENDING_OUTPUT (256 * 1024)
+// Input buffered while streaming a body, above the largest head
+#define HTTP_MAX_STREAM_BUFFER  (HTTP_PARSER_MAX_HEADER_SIZE + 64 * 1024)
+#define HTTP_DEFAULT_BODY_SPILL (1024 * 1024)
+// Closed connections a worker keeps for reuse, and the memory they may
+// hold in total and per buffer
+#define HTTP_POOL_MAX_CONNECTIONS   256
+#define HTTP_POOL_MAX_RETAINED      (4 * 1024 * 1024)
+#define HTTP_POOL_MAX_BUFFER        (16 * 1024)
+
+typedef struct http_worker http_worker;
+
+/**
+ * Per-connection state tracked by a worker's event loop.
+ * A worker's listening socket is an http_connection too, it just
+ * never gets a buffer filled.
+ */
 typedef struct http_connection {
-    int     fd;
-    sds     buffer;
-    size_t  content_length;
-    bool    header_parsed;
-    bool    keep_alive;
+    // Over-aligned so the io_uring backend can tag pointers with an op
+    alignas(16) int         fd;
+    sds                     buffer;
+    http_output             out;
+    http_parser             parser;
+    http_arena              arena;
+    http_request*           request;
+    // Route of request, looked up once its head is parsed
+    http_route_match        match;
+    bool                    routed;
+    // Body of request when it is too large for the buffer
+    http_spill              spill;
+    bool                    spilling;
+    // Response whose body is still being produced
+    http_response*          stream;
+    bool                    keep_alive;
+    bool                    eof;
+    // Metrics timestamps, left at 0 when metrics are off: last read
+    // that brought bytes in, start of the request being parsed and of
+    // the send in flight, and parse time of the request so far
+    uint64_t                read_at;
+    uint64_t                request_start;
+    uint64_t                send_start;
+    uint64_t                parse_ns;
+
+    // io_uring backend bookkeeping, unused by epoll
+    struct msghdr           msg;
+    struct iovec            iov[HTTP_OUTPUT_MAX_IOVEC];
+    // File bodies are spliced file -> pipe -> socket
+    int                     pipe_fds[2];
+    size_t                  pipe_pending;
+    size_t                  pipe_size;
+    uint32_t                pending_ops;
+    bool                    recv_armed;
+    // Reading is paused, the recv in flight was asked to stop
+    bool                    recv_cancelled;
+    // The recv in flight is not multishot
+    bool                    recv_oneshot;
+    bool                    send_pending;
+    bool                    closing;
+
+    http_worker*            worker;
+    struct http_connection* next;
+    struct http_connection* prev;
 } http_connection;
 
 http_connection*    http_connection_new();
-int                 http_connection_bindAndListen(http_connection *this,
+
+/**
+ * Binds a non-blocking SO_REUSEPORT listening socket to port
+ *
+ * @param this  Listening connection
+ * @param port  TCP port, 0 picks an ephemeral port
+ *
+ * @returns Error message or NULL
+ */
+ErrorMessage        http_connection_bindAndListen(http_connection *this,
                                                   int port);
 void                http_connection_delete(http_connection* this);
 
+/**
+ * Unlinks connection from its worker and puts it in the worker's pool,
+ * or deletes it if the pool is full or it has no worker
+ *
+ * @param this  Connection
+ */
+void                http_connection_close(http_connection *this);
+
+/**
+ * Gives up on the output of a connection after a write error: drops
+ * what is queued and any streamed response, then marks it for closing
+ *
+ * @param this  Connection
+ */
+void                http_connection_abort(http_connection *this);
+
+/**
+ * Parses and answers every complete request sitting in this->buffer,
+ * in order, so pipelined requests need no extra reads. Responses are
+ * appended to this->out, I/O is left to the backend.
+ *
+ * @param this  Connection
+ *
+ * @returns true if it stopped because too much output is pending
+ */
+bool                http_connection_process(http_connection *this);
+
+/**
+ * Handles readiness on a client socket for the epoll backend: reads,
+ * answers complete requests and flushes. Reading is skipped while too
+ * much output is pending so a client that pipelines without reading
+ * cannot grow our buffers.
+ *
+ * @param this  Connection, its fd non-blocking
+ *
+ * @returns false if the connection must be closed
+ */
+bool                http_connection_onEvent(http_connection *this);
+
+/**
+ * One thread with its own listener, epoll instance and connections.
+ * Workers never touch each other's state.
+ */
+struct http_worker {
+    size_t              id;
+    pthread_t           thread;
+    http_server*        server;
+    http_connection*    listener;
+    http_connection*    connections;
+    size_t              connection_count;
+    // Closed connections ready for reuse, linked through next
+    http_connection*    pool;
+    size_t              pool_count;
+    size_t              pool_bytes;
+    int                 epoll_fd;
+    // NULL when metrics are off
+    http_metrics*       metrics;
+    ErrorMessage        err;
+};
+
+struct http_server {
+    // Set by the listening thread, read from any
+    _Atomic(uint16_t)   port;
+    http_backend        backend;
+    http_router*        router;
+    size_t              worker_count;
+    size_t              body_spill_threshold;
+    http_worker*        workers;
+    bool                metrics_enabled;
+    // One per worker of the last listen, kept after it returns
+    http_metrics*       metrics;
+    size_t              metrics_count;
+    int                 stop_fd;
+    atomic_bool         running;
+};
+
+/**
+ * Runs the edge-triggered epoll loop of a worker until the server
+ * is stopped
+ *
+ * @param this  Worker, listener must already be bound
+ *
+ * @returns Error message or NULL on clean stop
+ */
+ErrorMessage        http_worker_run(http_worker *this);
+
+/**
+ * Creates a connection for an accepted fd, reusing a pooled one when
+ * there is one, and links it to the worker. Closes fd on failure.
+ *
+ * @param this  Worker
+ * @param fd    Accepted client socket
+ *
+ * @returns New connection or NULL
+ */
+http_connection*    http_worker_addConnection(http_worker *this, int fd);
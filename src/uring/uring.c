@@ -0,0 +1,847 @@
+#include "uring.h"
+
+#include "http/alloc.h"
+#include "http/results.h"
+#include "logger/logger.h"
+#include "sds.h"
+#include "server_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// Multishot recv is the newest feature used, without it the backend
+// is compiled out and http_uring_isSupported always says no
+#if defined(IORING_RECV_MULTISHOT)
+
+#define URING_ENTRIES       4096
+#define URING_BUF_COUNT     1024
+#define URING_BUF_SIZE      4096
+#define URING_BUF_GROUP     0
+// Pipe used to splice file bodies, one per connection serving files
+#define URING_PIPE_SIZE     (256 * 1024)
+#define URING_PIPE_MIN_SIZE (64 * 1024)
+
+// user_data is a pointer with the operation in the low bits
+#define URING_OP_MASK       ((uint64_t)15)
+
+typedef enum http_uring_op {
+    URING_OP_ACCEPT,
+    URING_OP_RECV,
+    URING_OP_SEND,
+    URING_OP_SHUTDOWN,
+    URING_OP_CLOSE,
+    URING_OP_STOP,
+    URING_OP_CANCEL,
+    URING_OP_SPLICE_IN,
+    URING_OP_SPLICE_OUT,
+} http_uring_op;
+
+static_assert(_Alignof(http_connection) > URING_OP_MASK,
+              "connection pointers must leave room for the op tag");
+
+typedef struct http_uring {
+    int                         fd;
+
+    unsigned                   *sq_head;
+    unsigned                   *sq_tail;
+    unsigned                    sq_mask;
+    unsigned                    sq_entries;
+    unsigned                   *sq_array;
+    unsigned                    sq_local_tail;
+    unsigned                    sq_submitted;
+    struct io_uring_sqe        *sqes;
+
+    unsigned                   *cq_head;
+    unsigned                   *cq_tail;
+    unsigned                    cq_mask;
+    struct io_uring_cqe        *cqes;
+
+    void                       *sq_ring;
+    size_t                      sq_ring_size;
+    void                       *cq_ring;
+    size_t                      cq_ring_size;
+    size_t                      sqes_size;
+
+    struct io_uring_buf_ring   *buf_ring;
+    size_t                      buf_ring_size;
+    char                       *buf_base;
+    uint16_t                    buf_tail;
+
+    // Operations whose final completion has not arrived yet
+    size_t                      inflight;
+} http_uring;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                        NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+                                 unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void http_uring_unmap(http_uring *this) {
+    if (this->sqes && this->sqes != MAP_FAILED)
+        munmap(this->sqes, this->sqes_size);
+    if (this->cq_ring && this->cq_ring != MAP_FAILED && this->cq_ring != this->sq_ring)
+        munmap(this->cq_ring, this->cq_ring_size);
+    if (this->sq_ring && this->sq_ring != MAP_FAILED)
+        munmap(this->sq_ring, this->sq_ring_size);
+}
+
+static void http_uring_deinit(http_uring *this) {
+    if (this->fd >= 0)
+        close(this->fd);
+    http_uring_unmap(this);
+    if (this->buf_ring && this->buf_ring != MAP_FAILED)
+        munmap(this->buf_ring, this->buf_ring_size);
+    http_free(this->buf_base);
+}
+
+static ErrorMessage http_uring_init(http_uring *this, unsigned entries) {
+    memset(this, 0, sizeof(*this));
+    this->fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    this->fd = sys_io_uring_setup(entries, &params);
+    if (this->fd < 0 && errno == EINVAL) {
+        // Older kernels reject the optional flags
+        memset(&params, 0, sizeof(params));
+        this->fd = sys_io_uring_setup(entries, &params);
+    }
+    if (this->fd < 0)
+        return "io_uring error: could not set up ring";
+
+    this->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (this->cq_ring_size > this->sq_ring_size)
+            this->sq_ring_size = this->cq_ring_size;
+        this->cq_ring_size = this->sq_ring_size;
+    }
+
+    this->sq_ring = mmap(NULL, this->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+    if (this->sq_ring == MAP_FAILED)
+        return "io_uring error: could not map submission ring";
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        this->cq_ring = this->sq_ring;
+    } else {
+        this->cq_ring = mmap(NULL, this->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING);
+        if (this->cq_ring == MAP_FAILED)
+            return "io_uring error: could not map completion ring";
+    }
+
+    this->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    this->sqes = mmap(NULL, this->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES);
+    if (this->sqes == MAP_FAILED)
+        return "io_uring error: could not map submission entries";
+
+    char *sq = this->sq_ring;
+    this->sq_head = (unsigned *)(sq + params.sq_off.head);
+    this->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    this->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    this->sq_entries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    this->sq_array = (unsigned *)(sq + params.sq_off.array);
+    this->sq_local_tail = *this->sq_tail;
+    this->sq_submitted = this->sq_local_tail;
+
+    char *cq = this->cq_ring;
+    this->cq_head = (unsigned *)(cq + params.cq_off.head);
+    this->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    this->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    this->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return NULL;
+}
+
+static void http_uring_provideBuffer(http_uring *this, uint16_t bid) {
+    struct io_uring_buf *buf = &this->buf_ring->bufs[this->buf_tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(this->buf_base + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    this->buf_tail++;
+}
+
+static void http_uring_publishBuffers(http_uring *this) {
+    __atomic_store_n(&this->buf_ring->tail, this->buf_tail, __ATOMIC_RELEASE);
+}
+
+static ErrorMessage http_uring_initBuffers(http_uring *this) {
+    this->buf_ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    this->buf_ring = mmap(NULL, this->buf_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (this->buf_ring == MAP_FAILED)
+        return "io_uring error: could not map buffer ring";
+
+    this->buf_base = http_malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (!this->buf_base)
+        return "io_uring error: could not allocate receive buffers";
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)this->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_io_uring_register(this->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return "io_uring error: could not register buffer ring";
+
+    for (uint16_t bid = 0; bid < URING_BUF_COUNT; bid++)
+        http_uring_provideBuffer(this, bid);
+    http_uring_publishBuffers(this);
+
+    return NULL;
+}
+
+/**
+ * Hands pending submissions to the kernel and optionally waits for
+ * completions
+ *
+ * @returns false on a fatal ring error
+ */
+static bool http_uring_submit(http_uring *this, unsigned wait_nr) {
+    __atomic_store_n(this->sq_tail, this->sq_local_tail, __ATOMIC_RELEASE);
+
+    while (true) {
+        unsigned to_submit = this->sq_local_tail - this->sq_submitted;
+        int ret = sys_io_uring_enter(this->fd, to_submit, wait_nr,
+                                     wait_nr ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0) {
+            this->sq_submitted += (unsigned)ret;
+            return true;
+        }
+        if (errno == EINTR)
+            continue;
+        // Completion ring is full, let the caller reap first
+        if (errno == EBUSY || errno == EAGAIN)
+            return true;
+
+        LOG_ERROR("io_uring error: io_uring_enter failed: %s", strerror(errno));
+        return false;
+    }
+}
+
+/**
+ * @returns Number of submission entries available, after flushing the
+ * queue to the kernel if it was full
+ */
+static unsigned http_uring_sqSpace(http_uring *this) {
+    unsigned head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+    if (this->sq_local_tail - head >= this->sq_entries) {
+        http_uring_submit(this, 0);
+        head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+    }
+    return this->sq_entries - (this->sq_local_tail - head);
+}
+
+static struct io_uring_sqe *http_uring_getSqe(http_uring *this) {
+    unsigned head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+    if (this->sq_local_tail - head >= this->sq_entries) {
+        http_uring_submit(this, 0);
+        head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+        if (this->sq_local_tail - head >= this->sq_entries)
+            return NULL;
+    }
+
+    unsigned idx = this->sq_local_tail & this->sq_mask;
+    struct io_uring_sqe *sqe = &this->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    this->sq_array[idx] = idx;
+    this->sq_local_tail++;
+    this->inflight++;
+
+    return sqe;
+}
+
+static inline uint64_t http_uring_tag(void *ptr, http_uring_op op) {
+    return (uint64_t)(uintptr_t)ptr | (uint64_t)op;
+}
+
+static bool http_uring_prepAccept(http_uring *this, http_connection *listener) {
+    struct io_uring_sqe *sqe = http_uring_getSqe(this);
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener->fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = http_uring_tag(listener, URING_OP_ACCEPT);
+    return true;
+}
+
+static bool http_uring_prepPollStop(http_uring *this, int stop_fd) {
+    struct io_uring_sqe *sqe = http_uring_getSqe(this);
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = stop_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = http_uring_tag(NULL, URING_OP_STOP);
+    return true;
+}
+
+static bool http_uring_prepCancelAll(http_uring *this) {
+    struct io_uring_sqe *sqe = http_uring_getSqe(this);
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = http_uring_tag(NULL, URING_OP_CANCEL);
+    return true;
+}
+
+/**
+ * Stops the multishot recv of conn, its last completion comes back with
+ * -ECANCELED
+ */
+static bool http_uring_prepCancelRecv(http_uring *this, http_connection *conn) {
+    struct io_uring_sqe *sqe = http_uring_getSqe(this);
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = http_uring_tag(conn, URING_OP_RECV);
+    sqe->user_data = http_uring_tag(NULL, URING_OP_CANCEL);
+    conn->recv_cancelled = true;
+    return true;
+}
+
+/**
+ * Whether the body of the request in conn goes to an on_body handler
+ * as it arrives
+ */
+static bool http_uring_streamingBody(http_connection *conn) {
+    return conn->request && conn->routed && conn->parser.stream_body &&
+           conn->match.status == HTTP_ROUTE_FOUND && conn->match.on_body;
+}
+
+/**
+ * Arms a multishot recv, or a single one while a body is streamed to
+ * on_body: a multishot recv would keep draining the socket into the
+ * buffer ring however slowly on_body takes the body, where one at a
+ * time lets the client stall on a full socket instead
+ */
+static bool http_uring_prepRecv(http_uring *this, http_connection *conn) {
+    struct io_uring_sqe *sqe = http_uring_getSqe(this);
+    if (!sqe)
+        return false;
+    conn->recv_oneshot = http_uring_streamingBody(conn);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = conn->recv_oneshot ? 0 : IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = http_uring_tag(conn, URING_OP_RECV);
+
+    conn->pending_ops++;
+    conn->recv_armed = true;
+    return true;
+}
+
+/**
+ * Sends what is queued in conn->out, heads and bodies gathered into one
+ * sendmsg. For the last response of a connection
+ * the send is linked to a shutdown and a close so the whole teardown is
+ * one submission.
+ */
+static bool http_uring_prepSend(http_uring *this, http_connection *conn, bool last) {
+    struct io_uring_sqe *sqe = http_uring_getSqe(this);
+    if (!sqe)
+        return false;
+    // msg and iov live in conn, they must outlive the submission
+    conn->msg = (struct msghdr){
+        .msg_iov = conn->iov,
+        .msg_iovlen = http_output_iovec(&conn->out, conn->iov, HTTP_OUTPUT_MAX_IOVEC),
+    };
+
+    // Only tear down after the send that drains conn->out
+    size_t len = 0;
+    for (size_t i = 0; i < conn->msg.msg_iovlen; i++)
+        len += conn->iov[i].iov_len;
+    last = last && len == conn->out.pending;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&conn->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | (last ? MSG_WAITALL : 0);
+    sqe->user_data = http_uring_tag(conn, URING_OP_SEND);
+    conn->pending_ops++;
+    conn->send_pending = true;
+    conn->send_start = http_metrics_start(conn->worker->metrics);
+
+    if (!last)
+        return true;
+
+    sqe->flags |= IOSQE_IO_LINK;
+    conn->closing = true;
+
+    // The kernel holds its own file reference while the multishot recv
+    // is armed, so only a shutdown makes the peer see the connection end
+    struct io_uring_sqe *shut = http_uring_getSqe(this);
+    if (!shut) {
+        sqe->flags &= ~IOSQE_IO_LINK;
+        shutdown(conn->fd, SHUT_RD);
+        return true;
+    }
+    shut->opcode = IORING_OP_SHUTDOWN;
+    shut->fd = conn->fd;
+    shut->len = SHUT_RDWR;
+    shut->flags = IOSQE_IO_LINK;
+    shut->user_data = http_uring_tag(conn, URING_OP_SHUTDOWN);
+    conn->pending_ops++;
+
+    struct io_uring_sqe *cls = http_uring_getSqe(this);
+    if (!cls) {
+        shut->flags &= ~IOSQE_IO_LINK;
+        return true;
+    }
+    cls->opcode = IORING_OP_CLOSE;
+    cls->fd = conn->fd;
+    cls->user_data = http_uring_tag(conn, URING_OP_CLOSE);
+    conn->pending_ops++;
+
+    return true;
+}
+
+static void http_uring_prepSpliceOut(struct io_uring_sqe *sqe, http_connection *conn,
+                                     size_t len) {
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = conn->pipe_fds[0];
+    sqe->splice_off_in = (uint64_t)-1;
+    sqe->fd = conn->fd;
+    sqe->off = (uint64_t)-1;
+    sqe->len = len;
+    sqe->user_data = http_uring_tag(conn, URING_OP_SPLICE_OUT);
+    conn->pending_ops++;
+    conn->send_pending = true;
+    conn->send_start = http_metrics_start(conn->worker->metrics);
+}
+
+/**
+ * Sends the file segment at the head of conn->out without copying it
+ * through user space: one splice fills conn's pipe from the file and a
+ * linked one drains the pipe into the socket. Data left in the pipe by
+ * a short write is drained first.
+ */
+static bool http_uring_prepSplice(http_uring *this, http_connection *conn) {
+    if (conn->pipe_pending > 0) {
+        struct io_uring_sqe *out = http_uring_getSqe(this);
+        if (!out)
+            return false;
+        http_uring_prepSpliceOut(out, conn, conn->pipe_pending);
+        return true;
+    }
+
+    if (conn->pipe_fds[0] < 0) {
+        if (pipe2(conn->pipe_fds, O_CLOEXEC) < 0) {
+            LOG_ERROR("Error writing to client: could not create pipe: %s", strerror(errno));
+            conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+            return false;
+        }
+        int size = fcntl(conn->pipe_fds[1], F_SETPIPE_SZ, URING_PIPE_SIZE);
+        conn->pipe_size = size > 0 ? (size_t)size : URING_PIPE_MIN_SIZE;
+    }
+
+    int fd;
+    off_t offset;
+    size_t len;
+    http_output_file(&conn->out, &fd, &offset, &len);
+    if (len > conn->pipe_size)
+        len = conn->pipe_size;
+
+    if (http_uring_sqSpace(this) < 2)
+        return false;
+
+    struct io_uring_sqe *in = http_uring_getSqe(this);
+    in->opcode = IORING_OP_SPLICE;
+    in->splice_fd_in = fd;
+    in->splice_off_in = (uint64_t)offset;
+    in->fd = conn->pipe_fds[1];
+    in->off = (uint64_t)-1;
+    in->len = len;
+    in->flags = IOSQE_IO_LINK;
+    in->user_data = http_uring_tag(conn, URING_OP_SPLICE_IN);
+    conn->pending_ops++;
+
+    http_uring_prepSpliceOut(http_uring_getSqe(this), conn, len);
+    return true;
+}
+
+/**
+ * Starts tearing down a connection. It is freed once the kernel has
+ * returned every operation that references it.
+ */
+static void http_uring_startClose(http_connection *conn) {
+    if (!conn->closing) {
+        conn->closing = true;
+        if (conn->fd >= 0)
+            shutdown(conn->fd, SHUT_RDWR);
+    }
+    if (conn->pending_ops == 0)
+        http_connection_close(conn);
+}
+
+/**
+ * Whether conn must stop taking input, under the same limits as the
+ * epoll backend: too much output pending, or too much input ahead of a
+ * request not routed yet or whose body is streamed
+ */
+static bool http_uring_readPaused(http_connection *conn) {
+    return conn->out.pending >= HTTP_MAX_PENDING_OUTPUT ||
+           ((!conn->request || conn->parser.stream_body) &&
+            sdslen(conn->buffer) >= HTTP_MAX_STREAM_BUFFER);
+}
+
+/**
+ * Cancels the recv of conn once it must stop taking input, or once a
+ * multishot recv is armed for a body now streamed to on_body, drive
+ * arms a single one then. Otherwise the kernel would keep filling
+ * conn->buffer however slowly the client reads or the handler takes
+ * the body.
+ *
+ * @returns false if the cancel could not be queued
+ */
+static bool http_uring_pauseRecv(http_uring *this, http_connection *conn) {
+    if (!conn->recv_armed || conn->recv_cancelled)
+        return true;
+    if (!http_uring_readPaused(conn) &&
+        (conn->recv_oneshot || !http_uring_streamingBody(conn)))
+        return true;
+    return http_uring_prepCancelRecv(this, conn);
+}
+
+/**
+ * Answers whatever is complete in conn->buffer and keeps exactly one
+ * send and one multishot recv armed as needed. The recv is cancelled
+ * while reading is paused and armed again once the output has drained.
+ */
+static void http_uring_drive(http_uring *this, http_connection *conn) {
+    if (conn->closing) {
+        http_uring_startClose(conn);
+        return;
+    }
+
+    // conn->out must stay put while the kernel reads from it
+    if (conn->send_pending) {
+        if (!http_uring_pauseRecv(this, conn))
+            http_uring_startClose(conn);
+        return;
+    }
+
+    http_connection_process(conn);
+    if (!http_uring_pauseRecv(this, conn)) {
+        http_uring_startClose(conn);
+        return;
+    }
+
+    bool last = (!conn->keep_alive || conn->eof) && !conn->stream;
+    int fd;
+    off_t offset;
+    size_t len;
+    if (conn->pipe_pending > 0 || http_output_file(&conn->out, &fd, &offset, &len)) {
+        if (!http_uring_prepSplice(this, conn))
+            http_uring_startClose(conn);
+        return;
+    }
+    if (conn->out.pending > 0) {
+        if (!http_uring_prepSend(this, conn, last))
+            http_uring_startClose(conn);
+        return;
+    }
+
+    if (last) {
+        http_uring_startClose(conn);
+        return;
+    }
+
+    if (!conn->recv_armed && !http_uring_readPaused(conn) && !http_uring_prepRecv(this, conn))
+        http_uring_startClose(conn);
+}
+
+static void http_uring_onRecv(http_uring *this, http_connection *conn,
+                              struct io_uring_cqe *cqe) {
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe->res > 0 && !conn->closing) {
+            http_metrics *metrics = conn->worker->metrics;
+            uint64_t start = http_metrics_start(metrics);
+            sds buffer = sdscatlen(conn->buffer, this->buf_base + (size_t)bid * URING_BUF_SIZE,
+                                   cqe->res);
+            if (!buffer) {
+                LOG_ERROR("Error reading from client: out of memory");
+                http_connection_abort(conn);
+            } else {
+                conn->buffer = buffer;
+                if (metrics) {
+                    conn->read_at = http_metrics_now();
+                    http_metrics_record(metrics, HTTP_STAGE_READ, conn->read_at - start);
+                    http_metrics_add(metrics, HTTP_COUNTER_BYTES_IN, cqe->res);
+                }
+            }
+        }
+        http_uring_provideBuffer(this, bid);
+        http_uring_publishBuffers(this);
+    }
+
+    bool cancelled = conn->recv_cancelled;
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        conn->recv_armed = false;
+        conn->recv_cancelled = false;
+    }
+
+    // -ENOBUFS only means the buffer ring ran dry and -ECANCELED after
+    // http_uring_pauseRecv that reading is paused, recv is re-armed
+    bool paused = cqe->res == -ECANCELED && cancelled;
+    if (cqe->res == 0) {
+        conn->eof = true;
+    } else if (cqe->res < 0 && cqe->res != -ENOBUFS && !paused) {
+        if (cqe->res != -ECANCELED && !conn->closing)
+            LOG_ERROR("Error reading from client: %s", strerror(-cqe->res));
+        conn->eof = true;
+        conn->keep_alive = false;
+    }
+}
+
+/**
+ * Records a completed send or splice into the socket
+ */
+static void http_uring_sent(http_connection *conn, int res) {
+    http_metrics *metrics = conn->worker->metrics;
+    http_metrics_stop(metrics, HTTP_STAGE_WRITE, conn->send_start);
+    http_metrics_add(metrics, HTTP_COUNTER_BYTES_OUT, res);
+}
+
+static void http_uring_onSend(http_connection *conn, struct io_uring_cqe *cqe) {
+    conn->send_pending = false;
+
+    if (cqe->res < 0) {
+        if (cqe->res != -ECANCELED)
+            LOG_ERROR("Error writing to client: %s", strerror(-cqe->res));
+        http_connection_abort(conn);
+        return;
+    }
+
+    http_output_consume(&conn->out, cqe->res);
+    http_uring_sent(conn, cqe->res);
+}
+
+static void http_uring_onSpliceIn(http_connection *conn, struct io_uring_cqe *cqe) {
+    if (cqe->res > 0) {
+        conn->pipe_pending += cqe->res;
+        http_output_consume(&conn->out, cqe->res);
+        return;
+    }
+
+    // The file shrank under us, Content-Length can't be honoured
+    if (cqe->res == 0)
+        LOG_ERROR("Error writing to client: body file truncated");
+    else if (cqe->res != -ECANCELED)
+        LOG_ERROR("Error writing to client: %s", strerror(-cqe->res));
+    http_connection_abort(conn);
+}
+
+static void http_uring_onSpliceOut(http_connection *conn, struct io_uring_cqe *cqe) {
+    conn->send_pending = false;
+
+    if (cqe->res > 0) {
+        conn->pipe_pending -= cqe->res;
+        http_uring_sent(conn, cqe->res);
+        return;
+    }
+
+    // A short fill cancels the linked drain, drive resubmits it
+    if (cqe->res == -ECANCELED && conn->pipe_pending > 0)
+        return;
+
+    if (cqe->res != -ECANCELED)
+        LOG_ERROR("Error writing to client: %s",
+                  cqe->res == 0 ? "connection closed" : strerror(-cqe->res));
+    conn->pipe_pending = 0;
+    http_connection_abort(conn);
+}
+
+static void http_uring_onTeardown(http_connection *conn, struct io_uring_cqe *cqe,
+                                  http_uring_op op) {
+    if (op == URING_OP_CLOSE && cqe->res == 0)
+        conn->fd = -1;
+    // A broken link, e.g. a short send, cancels the rest of the chain
+    if (cqe->res == -ECANCELED && op == URING_OP_SHUTDOWN && conn->fd >= 0)
+        shutdown(conn->fd, SHUT_RDWR);
+}
+
+/**
+ * Dispatches one completion
+ *
+ * @returns false once the server asked the worker to stop
+ */
+static bool http_uring_onCompletion(http_uring *this, http_worker *worker,
+                                    struct io_uring_cqe *cqe, bool running) {
+    http_uring_op op = cqe->user_data & URING_OP_MASK;
+    void *ptr = (void *)(uintptr_t)(cqe->user_data & ~URING_OP_MASK);
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+
+    if (!more)
+        this->inflight--;
+
+    switch (op) {
+    case URING_OP_STOP:
+        return false;
+
+    case URING_OP_CANCEL:
+        return running;
+
+    case URING_OP_ACCEPT:
+        if (cqe->res >= 0) {
+            uint64_t start = http_metrics_start(worker->metrics);
+            http_connection *conn = http_worker_addConnection(worker, cqe->res);
+            if (conn && running && !http_uring_prepRecv(this, conn))
+                http_uring_startClose(conn);
+            else if (conn)
+                http_metrics_stop(worker->metrics, HTTP_STAGE_ACCEPT, start);
+        } else if (cqe->res != -ECANCELED) {
+            LOG_ERROR("Connection error: failed to accept connection: %s", strerror(-cqe->res));
+        }
+        if (!more && running)
+            http_uring_prepAccept(this, worker->listener);
+        return running;
+
+    case URING_OP_RECV:
+    case URING_OP_SEND:
+    case URING_OP_SHUTDOWN:
+    case URING_OP_CLOSE:
+    case URING_OP_SPLICE_IN:
+    case URING_OP_SPLICE_OUT: {
+        http_connection *conn = ptr;
+        if (!more)
+            conn->pending_ops--;
+
+        if (op == URING_OP_RECV)
+            http_uring_onRecv(this, conn, cqe);
+        else if (op == URING_OP_SEND)
+            http_uring_onSend(conn, cqe);
+        else if (op == URING_OP_SPLICE_IN)
+            http_uring_onSpliceIn(conn, cqe);
+        else if (op == URING_OP_SPLICE_OUT)
+            http_uring_onSpliceOut(conn, cqe);
+        else
+            http_uring_onTeardown(conn, cqe, op);
+
+        if (running)
+            http_uring_drive(this, conn);
+        else if (conn->pending_ops == 0)
+            http_connection_close(conn);
+        return running;
+    }
+    }
+
+    return running;
+}
+
+bool http_uring_isSupported(void) {
+    http_uring ring;
+    if (http_uring_init(&ring, 8)) {
+        http_uring_deinit(&ring);
+        return false;
+    }
+
+    // IORING_OP_SEND_ZC landed in the same release as multishot recv,
+    // the probe cannot see flags so the opcode stands in for it
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = http_calloc(1, probe_size);
+    bool supported = probe &&
+                     sys_io_uring_register(ring.fd, IORING_REGISTER_PROBE, probe, 256) >= 0 &&
+                     probe->last_op >= IORING_OP_SEND_ZC &&
+                     (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED) &&
+                     (probe->ops[IORING_OP_SHUTDOWN].flags & IO_URING_OP_SUPPORTED);
+    http_free(probe);
+
+    if (supported)
+        supported = http_uring_initBuffers(&ring) == NULL;
+
+    http_uring_deinit(&ring);
+    return supported;
+}
+
+ErrorMessage http_worker_runUring(http_worker *this) {
+    http_uring ring;
+    ErrorMessage err = http_uring_init(&ring, URING_ENTRIES);
+    if (!err)
+        err = http_uring_initBuffers(&ring);
+    if (!err && (!http_uring_prepAccept(&ring, this->listener) ||
+                 !http_uring_prepPollStop(&ring, this->server->stop_fd)))
+        err = "io_uring error: could not queue initial operations";
+    if (err) {
+        http_uring_deinit(&ring);
+        return err;
+    }
+
+    bool running = true;
+    bool cancelled = false;
+    while (ring.inflight > 0) {
+        if (!running && !cancelled) {
+            // Every pending operation must come back before the
+            // connections and buffers it points to are freed
+            cancelled = http_uring_prepCancelAll(&ring);
+            if (!cancelled) {
+                err = "io_uring error: could not cancel operations";
+                break;
+            }
+        }
+
+        if (!http_uring_submit(&ring, 1)) {
+            err = "io_uring error: event loop failed";
+            break;
+        }
+
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & ring.cq_mask];
+            running = http_uring_onCompletion(&ring, this, cqe, running);
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // Closing the ring also drops anything left after a fatal error
+    http_uring_deinit(&ring);
+    while (this->connections)
+        http_connection_close(this->connections);
+
+    return err;
+}
+
+#else
+
+bool http_uring_isSupported(void) { return false; }
+
+ErrorMessage http_worker_runUring(http_worker *this) {
+    return "io_uring error: backend not available in this build";
+}
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "http/results.h"
+#include "server_internal.h"
+
+/**
+ * Whether this build and the running kernel support everything the
+ * io_uring backend needs: multishot accept and recv plus provided
+ * buffer rings (Linux 6.0+)
+ *
+ * @returns true if http_worker_runUring can be used
+ */
+bool            http_uring_isSupported(void);
+
+/**
+ * Runs a worker on io_uring until the server is stopped. Accepts with
+ * one multishot accept, reads with one multishot recv per connection
+ * into a ring of provided buffers, and chains send/shutdown/close for
+ * the last response of a connection.
+ *
+ * @param this  Worker, listener must already be bound
+ *
+ * @returns Error message or NULL on clean stop
+ */
+ErrorMessage    http_worker_runUring(http_worker *this);
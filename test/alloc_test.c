@@ -0,0 +1,145 @@
+#include "http/alloc.h"
+#include "map/map.h"
+
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+typedef struct counting_ctx {
+    size_t  allocs;
+    size_t  reallocs;
+    size_t  frees;
+} counting_ctx;
+
+static void *counting_alloc(size_t size, size_t alignment, void *ctx) {
+    ((counting_ctx *)ctx)->allocs++;
+    if (alignment <= alignof(max_align_t))
+        return malloc(size);
+    return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+}
+
+static void *counting_realloc(void *ptr, size_t size, void *ctx) {
+    ((counting_ctx *)ctx)->reallocs++;
+    return realloc(ptr, size);
+}
+
+static void counting_free(void *ptr, void *ctx) {
+    ((counting_ctx *)ctx)->frees++;
+    free(ptr);
+}
+
+void setUp(void) {
+    http_allocator_ResetStats();
+}
+
+void tearDown(void) {
+    http_allocator_SetCounting(false);
+    http_allocator_Set(NULL);
+}
+
+void test_http_allocator_Stats_Counting(void) {
+    http_allocator_SetCounting(true);
+    void *ptr = http_malloc(100);
+    TEST_ASSERT_NOT_NULL(ptr);
+
+    http_alloc_stats stats = http_allocator_Stats();
+    TEST_ASSERT_EQUAL_UINT64(1, stats.allocs);
+    TEST_ASSERT_EQUAL_UINT64(0, stats.frees);
+    TEST_ASSERT_TRUE(stats.bytes_allocated >= 100);
+    TEST_ASSERT_EQUAL_UINT64(stats.bytes_allocated, stats.peak);
+
+    ptr = http_realloc(ptr, 1000);
+    TEST_ASSERT_NOT_NULL(ptr);
+    stats = http_allocator_Stats();
+    TEST_ASSERT_EQUAL_UINT64(2, stats.allocs);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.frees);
+    TEST_ASSERT_TRUE(stats.peak >= 1000);
+
+    http_free(ptr);
+    stats = http_allocator_Stats();
+    TEST_ASSERT_EQUAL_UINT64(2, stats.frees);
+    TEST_ASSERT_EQUAL_UINT64(stats.bytes_allocated, stats.bytes_freed);
+
+    // Nothing counted once off
+    http_allocator_SetCounting(false);
+    http_free(http_malloc(10));
+    TEST_ASSERT_EQUAL_UINT64(2, http_allocator_Stats().allocs);
+
+    http_allocator_ResetStats();
+    TEST_ASSERT_EQUAL_UINT64(0, http_allocator_Stats().allocs);
+    TEST_ASSERT_EQUAL_UINT64(0, http_allocator_Stats().peak);
+}
+
+void test_http_allocator_Set_Custom(void) {
+    counting_ctx ctx = { 0 };
+    http_allocator allocator = {
+        .alloc = counting_alloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+        .ctx = &ctx,
+    };
+    TEST_ASSERT_NULL(http_allocator_Set(&allocator));
+    http_allocator_SetCounting(true);
+
+    map *m = map_new();
+    TEST_ASSERT_NOT_NULL(m);
+    char key[16];
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        TEST_ASSERT_NOT_NULL(map_set(m, key, "value"));
+    }
+    map_delete(m);
+
+    TEST_ASSERT_TRUE(ctx.allocs > 1);
+    TEST_ASSERT_EQUAL_UINT(ctx.allocs, ctx.frees);
+    http_alloc_stats stats = http_allocator_Stats();
+    TEST_ASSERT_EQUAL_UINT64(ctx.allocs, stats.allocs);
+    TEST_ASSERT_EQUAL_UINT64(ctx.frees, stats.frees);
+    // No size callback, no bytes
+    TEST_ASSERT_EQUAL_UINT64(0, stats.bytes_allocated);
+}
+
+void test_http_allocator_Set_MissingCallback_Fail(void) {
+    http_allocator allocator = { .alloc = counting_alloc, .free = counting_free };
+    TEST_ASSERT_NOT_NULL(http_allocator_Set(&allocator));
+
+    // Still the default one
+    void *ptr = http_malloc(8);
+    TEST_ASSERT_NOT_NULL(ptr);
+    http_free(ptr);
+}
+
+void test_http_alignedAlloc_Aligned(void) {
+    size_t alignments[] = { 16, 64, 4096 };
+    for (size_t i = 0; i < sizeof(alignments) / sizeof(alignments[0]); i++) {
+        void *ptr = http_alignedAlloc(alignments[i], 100);
+        TEST_ASSERT_NOT_NULL(ptr);
+        TEST_ASSERT_EQUAL_UINT(0, (uintptr_t)ptr % alignments[i]);
+        http_free(ptr);
+    }
+}
+
+void test_http_calloc_Overflow_Fail(void) {
+    unsigned char *ptr = http_calloc(16, 4);
+    TEST_ASSERT_NOT_NULL(ptr);
+    for (size_t i = 0; i < 64; i++)
+        TEST_ASSERT_EQUAL_UINT(0, ptr[i]);
+    http_free(ptr);
+
+    TEST_ASSERT_NULL(http_calloc(SIZE_MAX / 2, 4));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_allocator_Stats_Counting);
+    RUN_TEST(test_http_allocator_Set_Custom);
+    RUN_TEST(test_http_allocator_Set_MissingCallback_Fail);
+    RUN_TEST(test_http_alignedAlloc_Aligned);
+    RUN_TEST(test_http_calloc_Overflow_Fail);
+    return UNITY_END();
+}
@@ -0,0 +1,92 @@
+#include "arena/arena.h"
+
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+http_arena arena;
+
+void setUp(void) { http_arena_init(&arena, 256); }
+
+void tearDown(void) { http_arena_deinit(&arena); }
+
+void test_http_arena_alloc_Aligned(void) {
+    for (size_t size = 1; size < 64; size += 7) {
+        void *ptr = http_arena_alloc(&arena, size);
+        TEST_ASSERT_NOT_NULL(ptr);
+        TEST_ASSERT_EQUAL_UINT(0, (uintptr_t)ptr % alignof(max_align_t));
+        memset(ptr, 0xab, size);
+    }
+}
+
+void test_http_arena_alloc_LargerThanBlock(void) {
+    char *small = http_arena_alloc(&arena, 16);
+    char *large = http_arena_alloc(&arena, 1000);
+    TEST_ASSERT_NOT_NULL(small);
+    TEST_ASSERT_NOT_NULL(large);
+    memset(large, 'x', 1000);
+    memset(small, 'y', 16);
+    TEST_ASSERT_EQUAL_INT('x', large[999]);
+}
+
+void test_http_arena_strndup_Success(void) {
+    char *copy = http_arena_strndup(&arena, "Host: example.com", 4);
+    TEST_ASSERT_EQUAL_STRING("Host", copy);
+}
+
+void test_http_arena_reset_ReusesBlock(void) {
+    void *first = http_arena_alloc(&arena, 32);
+    http_arena_reset(&arena);
+    TEST_ASSERT_EQUAL_PTR(first, http_arena_alloc(&arena, 32));
+}
+
+void test_http_arena_reset_CoalescesBlocks(void) {
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_NOT_NULL(http_arena_alloc(&arena, 200));
+    http_arena_reset(&arena);
+
+    // Everything from the last round now fits in the kept block
+    size_t stride = (200 + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    void *first = http_arena_alloc(&arena, 200);
+    for (int i = 1; i < 10; i++)
+        TEST_ASSERT_EQUAL_PTR((char *)first + i * stride, http_arena_alloc(&arena, 200));
+}
+
+void test_http_arena_reset_DropsPeak(void) {
+    for (int i = 0; i < 100; i++)
+        TEST_ASSERT_NOT_NULL(http_arena_alloc(&arena, 1024));
+    TEST_ASSERT_TRUE(http_arena_capacity(&arena) > HTTP_ARENA_MAX_KEPT);
+    http_arena_reset(&arena);
+
+    TEST_ASSERT_TRUE(http_arena_capacity(&arena) < 1024);
+    TEST_ASSERT_NOT_NULL(http_arena_alloc(&arena, 200));
+}
+
+void test_http_arena_capacity_CountsBlocks(void) {
+    TEST_ASSERT_EQUAL_size_t(0, http_arena_capacity(&arena));
+
+    http_arena_alloc(&arena, 16);
+    size_t one = http_arena_capacity(&arena);
+    TEST_ASSERT_TRUE(one >= 256);
+
+    http_arena_alloc(&arena, 1024);
+    TEST_ASSERT_TRUE(http_arena_capacity(&arena) >= one + 1024);
+
+    http_arena_deinit(&arena);
+    TEST_ASSERT_EQUAL_size_t(0, http_arena_capacity(&arena));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_arena_alloc_Aligned);
+    RUN_TEST(test_http_arena_alloc_LargerThanBlock);
+    RUN_TEST(test_http_arena_strndup_Success);
+    RUN_TEST(test_http_arena_reset_ReusesBlock);
+    RUN_TEST(test_http_arena_reset_CoalescesBlocks);
+    RUN_TEST(test_http_arena_reset_DropsPeak);
+    RUN_TEST(test_http_arena_capacity_CountsBlocks);
+    return UNITY_END();
+}
@@ -0,0 +1,128 @@
+#include "file/file.h"
+#include "output/output.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+char path[] = "/tmp/http_file_testXXXXXX";
+
+static void write_file(const char *s) {
+    FILE *f = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(f);
+    fputs(s, f);
+    fclose(f);
+}
+
+void setUp(void) {
+    int fd = mkstemp(path);
+    if (fd < 0)
+        exit(EXIT_FAILURE);
+    close(fd);
+    write_file("hello file");
+}
+
+void tearDown(void) {
+    http_file_cacheClear();
+    unlink(path);
+    strcpy(path, "/tmp/http_file_testXXXXXX");
+}
+
+void test_http_file_open_Success(void) {
+    HTTPFileResult res = http_file_open(path);
+    TEST_ASSERT_TRUE(res.Ok);
+    http_file *file = res.Value;
+    TEST_ASSERT_EQUAL_INT(10, file->st.st_size);
+
+    char buf[16];
+    TEST_ASSERT_EQUAL_INT(10, pread(file->fd, buf, sizeof(buf), 0));
+    TEST_ASSERT_EQUAL_MEMORY("hello file", buf, 10);
+    http_file_release(file);
+}
+
+void test_http_file_open_CacheHit(void) {
+    http_file *first = http_file_open(path).Value;
+    http_file *second = http_file_open(path).Value;
+    TEST_ASSERT_EQUAL_PTR(first, second);
+    // Cache plus two callers
+    TEST_ASSERT_EQUAL_UINT(3, first->refs);
+    http_file_release(first);
+    http_file_release(second);
+
+    // Cached descriptor stays open for the next caller
+    http_file *third = http_file_open(path).Value;
+    TEST_ASSERT_EQUAL_PTR(first, third);
+    http_file_release(third);
+}
+
+void test_http_file_open_Revalidates(void) {
+    http_file *first = http_file_open(path).Value;
+    write_file("changed contents");
+    first->checked_at -= HTTP_FILE_CACHE_REVALIDATE;
+
+    http_file *second = http_file_open(path).Value;
+    TEST_ASSERT_TRUE(first != second);
+    TEST_ASSERT_EQUAL_INT(16, second->st.st_size);
+    // The response still holding the old file keeps it usable
+    TEST_ASSERT_EQUAL_UINT(1, first->refs);
+    TEST_ASSERT_EQUAL_INT(10, first->st.st_size);
+    http_file_release(first);
+    http_file_release(second);
+}
+
+void test_http_file_open_Errors(void) {
+    TEST_ASSERT_FALSE(http_file_open("/tmp/http_file_test_missing").Ok);
+    TEST_ASSERT_FALSE(http_file_open("/tmp").Ok);
+    TEST_ASSERT_FALSE(http_file_open(NULL).Ok);
+}
+
+void test_http_output_appendFile_Segments(void) {
+    http_output out;
+    http_output_init(&out);
+
+    char *head = http_output_reserve(&out, 4);
+    memcpy(head, "HEAD", 4);
+    http_file *file = http_file_open(path).Value;
+    TEST_ASSERT_NULL(http_output_appendFile(&out, file, 6, 4));
+    TEST_ASSERT_EQUAL_size_t(8, out.pending);
+
+    int fd;
+    off_t offset;
+    size_t length;
+    TEST_ASSERT_FALSE(http_output_file(&out, &fd, &offset, &length));
+
+    // Head goes out gathered, the file segment is not part of the iovec
+    struct iovec iov[HTTP_OUTPUT_MAX_IOVEC];
+    TEST_ASSERT_EQUAL_size_t(1, http_output_iovec(&out, iov, HTTP_OUTPUT_MAX_IOVEC));
+    TEST_ASSERT_EQUAL_size_t(4, iov[0].iov_len);
+    http_output_consume(&out, 4);
+
+    TEST_ASSERT_TRUE(http_output_file(&out, &fd, &offset, &length));
+    TEST_ASSERT_EQUAL_INT(file->fd, fd);
+    TEST_ASSERT_EQUAL_INT(6, offset);
+    TEST_ASSERT_EQUAL_size_t(4, length);
+
+    http_output_consume(&out, 1);
+    TEST_ASSERT_TRUE(http_output_file(&out, &fd, &offset, &length));
+    TEST_ASSERT_EQUAL_INT(7, offset);
+    TEST_ASSERT_EQUAL_size_t(3, length);
+
+    http_output_consume(&out, 3);
+    TEST_ASSERT_EQUAL_size_t(0, out.pending);
+    TEST_ASSERT_FALSE(http_output_file(&out, &fd, &offset, &length));
+    http_output_deinit(&out);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_file_open_Success);
+    RUN_TEST(test_http_file_open_CacheHit);
+    RUN_TEST(test_http_file_open_Revalidates);
+    RUN_TEST(test_http_file_open_Errors);
+    RUN_TEST(test_http_output_appendFile_Segments);
+    return UNITY_END();
+}
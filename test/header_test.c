@@ -0,0 +1,49 @@
+#include "http/header.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_http_header_lookup_EveryName(void) {
+    char upper[64];
+    for (int id = HTTP_HEADER_UNKNOWN + 1; id < HTTP_HEADER_COUNT; id++) {
+        const char *name = http_header_name(id);
+        TEST_ASSERT_NOT_NULL(name);
+        TEST_ASSERT_EQUAL_INT(id, http_header_lookup(name, strlen(name)));
+
+        size_t len = strlen(name);
+        for (size_t i = 0; i < len; i++)
+            upper[i] = toupper((unsigned char)name[i]);
+        TEST_ASSERT_EQUAL_INT(id, http_header_lookup(upper, len));
+    }
+}
+
+void test_http_header_lookup_Unknown(void) {
+    const char *names[] = {"x", "", "x-custom", "hosts", "hos", "content-lengths",
+                           "contentlength", "sec-fetch-xyz", "accept-encodinf"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        TEST_ASSERT_EQUAL_INT(HTTP_HEADER_UNKNOWN, http_header_lookup(names[i], strlen(names[i])));
+
+    // Only len bytes take part
+    TEST_ASSERT_EQUAL_INT(HTTP_HEADER_HOST, http_header_lookup("Host: example.com", 4));
+}
+
+void test_http_header_name_Bounds(void) {
+    TEST_ASSERT_NULL(http_header_name(HTTP_HEADER_UNKNOWN));
+    TEST_ASSERT_NULL(http_header_name(HTTP_HEADER_COUNT));
+    TEST_ASSERT_EQUAL_STRING("content-length", http_header_name(HTTP_HEADER_CONTENT_LENGTH));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_header_lookup_EveryName);
+    RUN_TEST(test_http_header_lookup_Unknown);
+    RUN_TEST(test_http_header_name_Bounds);
+    return UNITY_END();
+}
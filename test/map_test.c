@@ -2,6 +2,7 @@
 #include <string.h>
 #include <unity.h>
 #include <unity_internals.h>
+#include <http/alloc.h>
 #include <map/map.h>
 
 map* m1;
@@ -48,7 +49,7 @@ void test_MapRemoveValueLookup_KeyNotFound(void) {
     TEST_ASSERT_NOT_NULL(res);
     TEST_ASSERT_EQUAL_STRING("text/html; charset=utf-8", res);
 
-    free(res);
+    http_free(res);
 
     const char* val2 = map_get(m1, "Content-Type");
     TEST_ASSERT_NULL(val2);
@@ -98,16 +99,16 @@ void test_MapSizeTracking_Success(void) {
     m1 = map_set(m1, "Content-Type", "text/html; charset=utf-8");
     TEST_ASSERT_EQUAL_UINT(m1->size, 3);
 
-    free(map_remove_value(m1, "Connection"));
+    http_free(map_remove_value(m1, "Connection"));
     TEST_ASSERT_EQUAL_UINT(m1->size, 2);
-    free(map_remove_value(m1, "Content-Encoding"));
+    http_free(map_remove_value(m1, "Content-Encoding"));
     TEST_ASSERT_EQUAL_UINT(m1->size, 1);
-    free(map_remove_value(m1, "Content-Type"));
+    http_free(map_remove_value(m1, "Content-Type"));
     TEST_ASSERT_EQUAL_UINT(m1->size, 0);
 }
 
 void test_MapOverload_ShouldGrow(void) {
-    TEST_ASSERT_EQUAL_UINT(m1->capacity, 11);
+    TEST_ASSERT_EQUAL_UINT(m1->capacity, MAP_SMALL_SIZE);
 
     m1 = map_set(m1, "key1", "value1");
     m1 = map_set(m1, "key2", "value2");
@@ -121,27 +122,63 @@ void test_MapOverload_ShouldGrow(void) {
     m1 = map_set(m1, "key10", "value10");
     m1 = map_set(m1, "key11", "value11");
     m1 = map_set(m1, "key12", "value12");
+    m1 = map_set(m1, "key13", "value13");
+    m1 = map_set(m1, "key14", "value14");
+    m1 = map_set(m1, "key15", "value15");
+    m1 = map_set(m1, "key16", "value16");
+    m1 = map_set(m1, "key17", "value17");
 
-    TEST_ASSERT_GREATER_THAN_UINT(11, m1->capacity);
+    TEST_ASSERT_GREATER_THAN_UINT(16, m1->capacity);
+}
+
+void test_MapSmallPromote_KeepsEntries(void) {
+    char key[16], value[16];
+    for (int i = 0; i < MAP_SMALL_SIZE; i++) {
+        sprintf(key, "k%d", i);
+        sprintf(value, "v%d", i);
+        m1 = map_set(m1, key, value);
+    }
+    TEST_ASSERT_NULL(m1->ctrl);
+
+    // Removing inline entries keeps the rest in order
+    http_free(map_remove_value(m1, "k3"));
+    TEST_ASSERT_NULL(map_get(m1, "k3"));
+    TEST_ASSERT_EQUAL_STRING("v4", map_get(m1, "k4"));
+    m1 = map_set(m1, "k3", "v3");
+    TEST_ASSERT_NULL(m1->ctrl);
+
+    m1 = map_set(m1, "k16", "v16");
+    TEST_ASSERT_NOT_NULL(m1->ctrl);
+    TEST_ASSERT_EQUAL_UINT(MAP_SMALL_SIZE + 1, m1->size);
+    for (int i = 0; i <= MAP_SMALL_SIZE; i++) {
+        sprintf(key, "k%d", i);
+        sprintf(value, "v%d", i);
+        TEST_ASSERT_EQUAL_STRING(value, map_get(m1, key));
+    }
+
+    const char* expected[] = { "k16", "k3", "k15", "k14" };
+    map_pair* pair = map_next(m1, NULL);
+    for (size_t i = 0; i < 4; i++, pair = map_next(m1, pair))
+        TEST_ASSERT_EQUAL_STRING(expected[i], pair->key);
 }
 
 void test_MapRemoveValue_KeyNotFound(void) {
     char* res = map_remove_value(m1, "new key");
     TEST_ASSERT_NULL(res);
-    free(res);// Good practice
+    http_free(res);// Good practice
 }
 
 void test_MapRemovePair_KeyNotFound(void) {
     map_pair* res = map_remove_pair(m1, "new key");
     TEST_ASSERT_NULL(res);
-    free(res);// Good practice
+    http_free(res);// Good practice
 }
 
 void test_MapInsertRemoveInsertLookup_Success(void) {
     m1 = map_set(m1, "Content-Type", "text/html; charset=utf-8");
     TEST_ASSERT_NOT_NULL(m1);
 
-    free(map_remove_value(m1, "Content-Type"));
+    http_free(map_remove_value(m1, "Content-Type"));
 
     m1 = map_set(m1, "Content-Type", "application/json");
     const char* res = map_get(m1, "Content-Type");
@@ -160,11 +197,11 @@ void test_MapSizeAfterOverwrite_Success(void) {
     m1 = map_set(m1, "Content-Type", "application/json");
     TEST_ASSERT_EQUAL_UINT(m1->size, 3);
 
-    free(map_remove_value(m1, "Connection"));
+    http_free(map_remove_value(m1, "Connection"));
     TEST_ASSERT_EQUAL_UINT(m1->size, 2);
-    free(map_remove_value(m1, "Content-Encoding"));
+    http_free(map_remove_value(m1, "Content-Encoding"));
     TEST_ASSERT_EQUAL_UINT(m1->size, 1);
-    free(map_remove_value(m1, "Content-Type"));
+    http_free(map_remove_value(m1, "Content-Type"));
     TEST_ASSERT_EQUAL_UINT(m1->size, 0);
 }
 
@@ -214,7 +251,119 @@ void test_MapKeysAfterGrow_Success(void) {
         TEST_ASSERT_TRUE(str_arr_contains(keys, expected_keys[i], keys_len));
     }
 
-    free(keys);
+    http_free(keys);
+}
+
+void test_MapManyKeysChurn_Success(void) {
+    char key[32], value[32];
+    for (int i = 0; i < 5000; i++) {
+        sprintf(key, "key-%d", i);
+        sprintf(value, "value-%d", i);
+        m1 = map_set(m1, key, value);
+    }
+    TEST_ASSERT_EQUAL_UINT(5000, m1->size);
+
+    // Remove every other key, then reinsert with new values, several
+    // times so tombstones pile up and get compacted
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < 5000; i += 2) {
+            sprintf(key, "key-%d", i);
+            http_free(map_remove_value(m1, key));
+        }
+        TEST_ASSERT_EQUAL_UINT(2500, m1->size);
+        for (int i = 0; i < 5000; i += 2) {
+            sprintf(key, "key-%d", i);
+            sprintf(value, "round-%d", round);
+            m1 = map_set(m1, key, value);
+        }
+    }
+
+    for (int i = 0; i < 5000; i++) {
+        sprintf(key, "key-%d", i);
+        sprintf(value, i % 2 ? "value-%d" : "round-3", i);
+        TEST_ASSERT_EQUAL_STRING(value, map_get(m1, key));
+    }
+    TEST_ASSERT_NULL(map_get(m1, "key-5000"));
+    TEST_ASSERT_EQUAL_UINT(5000, m1->size);
+}
+
+void test_MapKeysAfterRemove_KeepsOrder(void) {
+    m1 = map_set(m1, "key1", "value1");
+    m1 = map_set(m1, "key2", "value2");
+    m1 = map_set(m1, "key3", "value3");
+    m1 = map_set(m1, "key4", "value4");
+    http_free(map_remove_value(m1, "key2"));
+    m1 = map_set(m1, "key1", "updated");
+    m1 = map_set(m1, "key2", "again");
+
+    size_t keys_len;
+    const char** keys = map_keys(m1, &keys_len);
+    const char* expected_keys[] = { "key2", "key4", "key3", "key1" };
+    TEST_ASSERT_EQUAL_UINT(4, keys_len);
+    TEST_ASSERT_EQUAL_STRING_ARRAY(expected_keys, keys, keys_len);
+    http_free(keys);
+}
+
+void test_MapKeys_IgnoreCase(void) {
+    char key[96], lower[96];
+    for (int i = 0; i < 40; i++) {
+        sprintf(key, "X-Header-Name-%d-ABCDEFGHIJKLMNOPQRSTUVWXYZ-ABCDEFGHIJKLMNOPQRSTUVWXYZ", i);
+        m1 = map_set(m1, key, key);
+    }
+
+    for (int i = 0; i < 40; i++) {
+        sprintf(lower, "x-header-name-%d-abcdefghijklmnopqrstuvwxyz-abcdefghijklmnopqrstuvwxyz", i);
+        sprintf(key, "X-Header-Name-%d-ABCDEFGHIJKLMNOPQRSTUVWXYZ-ABCDEFGHIJKLMNOPQRSTUVWXYZ", i);
+        TEST_ASSERT_EQUAL_STRING(key, map_get(m1, lower));
+        TEST_ASSERT_EQUAL_UINT(map_hash(lower), map_hash_fold(key, strlen(key)));
+    }
+
+    // Prefixes must not match, nor bytes that only differ by 0x20
+    TEST_ASSERT_NULL(map_get(m1, "x-header-name-1"));
+    TEST_ASSERT(map_hash_fold("[", 1) != map_hash_fold("{", 1));
+    m1 = map_set(m1, "[", "bracket");
+    TEST_ASSERT_NULL(map_get(m1, "{"));
+    TEST_ASSERT_EQUAL_UINT(41, m1->size);
+}
+
+static void* failing_alloc(size_t size, size_t alignment, void* ctx) {
+    return NULL;
+}
+
+static void* failing_realloc(void* ptr, size_t size, void* ctx) {
+    return NULL;
+}
+
+static void failing_free(void* ptr, void* ctx) {
+    free(ptr);
+}
+
+void test_MapSmallPromote_OutOfMemory(void) {
+    char key[16];
+    for (int i = 0; i < MAP_SMALL_SIZE; i++) {
+        sprintf(key, "key%d", i);
+        m1 = map_set(m1, key, key);
+    }
+
+    // The 17th insert needs the hashed table, which can't be allocated
+    http_allocator failing = {
+        .alloc = failing_alloc, .realloc = failing_realloc, .free = failing_free
+    };
+    TEST_ASSERT_NULL(http_allocator_Set(&failing));
+    m1 = map_set(m1, "key16", "key16");
+    http_allocator_Set(NULL);
+
+    TEST_ASSERT_NOT_NULL(m1);
+    TEST_ASSERT_EQUAL_UINT(MAP_SMALL_SIZE, m1->size);
+    TEST_ASSERT_NULL(map_get(m1, "key16"));
+    for (int i = 0; i < MAP_SMALL_SIZE; i++) {
+        sprintf(key, "key%d", i);
+        TEST_ASSERT_EQUAL_STRING(key, map_get(m1, key));
+    }
+
+    // Growing works again once memory is back
+    m1 = map_set(m1, "key16", "key16");
+    TEST_ASSERT_EQUAL_STRING("key16", map_get(m1, "key16"));
 }
 
 int main(void) {
@@ -233,6 +382,11 @@ int main(void) {
     RUN_TEST(test_MapInsertRemoveInsertLookup_Success);
     RUN_TEST(test_MapSizeAfterOverwrite_Success);
     RUN_TEST(test_MapKeysBeforeGrow_Success);
+    RUN_TEST(test_MapManyKeysChurn_Success);
+    RUN_TEST(test_MapKeysAfterRemove_KeepsOrder);
+    RUN_TEST(test_MapSmallPromote_KeepsEntries);
+    RUN_TEST(test_MapKeys_IgnoreCase);
+    RUN_TEST(test_MapSmallPromote_OutOfMemory);
 
     return UNITY_END();
 }
@@ -0,0 +1,109 @@
+#include "metrics/metrics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+http_metrics *workers;
+
+void setUp(void) { workers = calloc(2, sizeof(http_metrics)); }
+
+void tearDown(void) { free(workers); }
+
+void test_http_histogram_bucket_HoldsValue(void) {
+    uint64_t values[] = { 0, 1, 7, 8, 9, 15, 16, 1000, 4095, 4096, 123456789, 1ull << 35 };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        size_t bucket = http_histogram_bucket(values[i]);
+        uint64_t start = bucket == 0 ? 0 : http_histogram_bucketEnd(bucket - 1);
+        uint64_t end = http_histogram_bucketEnd(bucket);
+        TEST_ASSERT_TRUE(bucket < HTTP_HISTOGRAM_BUCKETS);
+        TEST_ASSERT_TRUE(start <= values[i]);
+        TEST_ASSERT_TRUE(values[i] < end);
+        // Within 12.5% of the bucket start
+        TEST_ASSERT_TRUE(end - start <= start / 8 + 1);
+    }
+
+    TEST_ASSERT_EQUAL_UINT(HTTP_HISTOGRAM_BUCKETS - 1, http_histogram_bucket(UINT64_MAX));
+}
+
+void test_http_histogram_percentile_Success(void) {
+    http_histogram *h = &workers[0].stages[HTTP_STAGE_REQUEST];
+    TEST_ASSERT_EQUAL_UINT64(0, http_histogram_percentile(h, 50));
+
+    for (uint64_t us = 1; us <= 1000; us++)
+        http_histogram_record(h, us * 1000);
+
+    TEST_ASSERT_EQUAL_UINT64(1000, atomic_load(&h->count));
+    TEST_ASSERT_EQUAL_UINT64(500500000, atomic_load(&h->sum));
+    uint64_t p50 = http_histogram_percentile(h, 50);
+    TEST_ASSERT_TRUE(p50 >= 500000 && p50 <= 500000 + 500000 / 8);
+    uint64_t p100 = http_histogram_percentile(h, 100);
+    TEST_ASSERT_TRUE(p100 > 1000000 && p100 <= 1000000 + 1000000 / 8);
+}
+
+void test_http_metrics_merge_AddsWorkers(void) {
+    http_metrics_add(&workers[0], HTTP_COUNTER_REQUESTS, 3);
+    http_metrics_add(&workers[1], HTTP_COUNTER_REQUESTS, 4);
+    http_metrics_record(&workers[0], HTTP_STAGE_PARSE, 100);
+    http_metrics_record(&workers[1], HTTP_STAGE_PARSE, 100);
+    http_metrics_parseError(&workers[1], HTTP_PARSE_ERROR_CHUNK);
+    // Metrics off
+    http_metrics_add(NULL, HTTP_COUNTER_REQUESTS, 1);
+    http_metrics_parseError(NULL, HTTP_PARSE_ERROR_CHUNK);
+
+    http_metrics *total = malloc(sizeof(http_metrics));
+    http_metrics_merge(total, workers, 2);
+    TEST_ASSERT_EQUAL_UINT64(7, atomic_load(&total->counters[HTTP_COUNTER_REQUESTS]));
+    TEST_ASSERT_EQUAL_UINT64(1, atomic_load(&total->parse_errors[HTTP_PARSE_ERROR_CHUNK]));
+    TEST_ASSERT_EQUAL_UINT64(2, atomic_load(&total->stages[HTTP_STAGE_PARSE].count));
+    TEST_ASSERT_EQUAL_UINT64(200, atomic_load(&total->stages[HTTP_STAGE_PARSE].sum));
+    TEST_ASSERT_EQUAL_UINT64(
+        2, atomic_load(&total->stages[HTTP_STAGE_PARSE].buckets[http_histogram_bucket(100)]));
+    free(total);
+}
+
+void test_http_metrics_render_Prometheus(void) {
+    http_metrics_add(&workers[0], HTTP_COUNTER_CONNECTIONS_OPENED, 3);
+    http_metrics_add(&workers[1], HTTP_COUNTER_CONNECTIONS_OPENED, 2);
+    http_metrics_add(&workers[1], HTTP_COUNTER_CONNECTIONS_CLOSED, 1);
+    http_metrics_add(&workers[0], HTTP_COUNTER_BYTES_IN, 512);
+    http_metrics_parseError(&workers[0], HTTP_PARSE_ERROR_HEADER);
+    // 2 µs, 30 µs and 2 s
+    http_metrics_record(&workers[0], HTTP_STAGE_HANDLE, 2000);
+    http_metrics_record(&workers[1], HTTP_STAGE_HANDLE, 30000);
+    http_metrics_record(&workers[1], HTTP_STAGE_HANDLE, 2000000000);
+
+    sds text = http_metrics_render(workers, 2);
+    TEST_ASSERT_NOT_NULL(text);
+    TEST_ASSERT_NOT_NULL(strstr(text, "# TYPE http_connections_opened_total counter\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\nhttp_connections_opened_total 5\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\nhttp_connections_active 4\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\nhttp_received_bytes_total 512\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\nhttp_parse_errors_total{reason=\"header\"} 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\nhttp_parse_errors_total{reason=\"chunk\"} 0\n"));
+    TEST_ASSERT_NULL(strstr(text, "reason=\"none\""));
+    TEST_ASSERT_NOT_NULL(strstr(text, "# TYPE http_stage_duration_seconds histogram\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(text, "\nhttp_stage_duration_seconds_bucket{stage=\"handle\",le=\"1e-06\"} 0\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(text, "\nhttp_stage_duration_seconds_bucket{stage=\"handle\",le=\"5e-05\"} 2\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(text, "\nhttp_stage_duration_seconds_bucket{stage=\"handle\",le=\"1\"} 2\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(text, "\nhttp_stage_duration_seconds_bucket{stage=\"handle\",le=\"+Inf\"} 3\n"));
+    TEST_ASSERT_NOT_NULL(
+        strstr(text, "\nhttp_stage_duration_seconds_sum{stage=\"handle\"} 2.000032000\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\nhttp_stage_duration_seconds_count{stage=\"handle\"} 3\n"));
+    TEST_ASSERT_NOT_NULL(strstr(text, "\nhttp_stage_duration_seconds_count{stage=\"accept\"} 0\n"));
+    sdsfree(text);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_histogram_bucket_HoldsValue);
+    RUN_TEST(test_http_histogram_percentile_Success);
+    RUN_TEST(test_http_metrics_merge_AddsWorkers);
+    RUN_TEST(test_http_metrics_render_Prometheus);
+    return UNITY_END();
+}
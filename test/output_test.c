@@ -0,0 +1,111 @@
+#include "output/output.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+http_output out;
+
+void setUp(void) { http_output_init(&out); }
+
+void tearDown(void) { http_output_deinit(&out); }
+
+static void append(const char *s) {
+    char *dst = http_output_reserve(&out, strlen(s));
+    TEST_ASSERT_NOT_NULL(dst);
+    memcpy(dst, s, strlen(s));
+}
+
+static void append_body(const char *s) {
+    char *body = malloc(strlen(s));
+    memcpy(body, s, strlen(s));
+    TEST_ASSERT_NULL(http_output_appendBody(&out, body, strlen(s)));
+}
+
+/**
+ * Concatenates what http_output_iovec describes
+ */
+static size_t gather(char *dst, struct iovec *iov, size_t *count) {
+    *count = http_output_iovec(&out, iov, HTTP_OUTPUT_MAX_IOVEC);
+    size_t len = 0;
+    for (size_t i = 0; i < *count; i++) {
+        memcpy(dst + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+void test_http_output_iovec_CoalescesHeads(void) {
+    struct iovec iov[HTTP_OUTPUT_MAX_IOVEC];
+    char buf[128];
+    size_t count;
+
+    append("HTTP/1.1 200 OK\r\n\r\n");
+    append("HTTP/1.1 204 No Content\r\n\r\n");
+
+    size_t len = gather(buf, iov, &count);
+    TEST_ASSERT_EQUAL_UINT(1, count);
+    TEST_ASSERT_EQUAL_UINT(out.pending, len);
+    TEST_ASSERT_EQUAL_MEMORY("HTTP/1.1 200 OK\r\n\r\nHTTP/1.1 204 No Content\r\n\r\n", buf, len);
+}
+
+void test_http_output_iovec_BodyInPlace(void) {
+    struct iovec iov[HTTP_OUTPUT_MAX_IOVEC];
+    char buf[128];
+    size_t count;
+
+    append("head1|");
+    append_body("body1|");
+    append("head2|");
+    append_body("body2");
+
+    size_t len = gather(buf, iov, &count);
+    TEST_ASSERT_EQUAL_UINT(4, count);
+    TEST_ASSERT_EQUAL_MEMORY("head1|body1|head2|body2", buf, len);
+}
+
+void test_http_output_consume_Partial(void) {
+    struct iovec iov[HTTP_OUTPUT_MAX_IOVEC];
+    char buf[128];
+    size_t count;
+
+    append("head1|");
+    append_body("body1|");
+    append("head2|");
+
+    // Stop in the middle of the first body
+    http_output_consume(&out, 8);
+    size_t len = gather(buf, iov, &count);
+    TEST_ASSERT_EQUAL_UINT(2, count);
+    TEST_ASSERT_EQUAL_MEMORY("dy1|head2|", buf, len);
+
+    http_output_consume(&out, 4);
+    len = gather(buf, iov, &count);
+    TEST_ASSERT_EQUAL_UINT(1, count);
+    TEST_ASSERT_EQUAL_MEMORY("head2|", buf, len);
+
+    http_output_consume(&out, 6);
+    TEST_ASSERT_EQUAL_UINT(0, out.pending);
+    TEST_ASSERT_NULL(out.head);
+    TEST_ASSERT_EQUAL_UINT(0, http_output_iovec(&out, iov, HTTP_OUTPUT_MAX_IOVEC));
+}
+
+void test_http_output_reserve_ReusesSpare(void) {
+    append("first");
+    http_output_chunk *chunk = out.head;
+    http_output_consume(&out, 5);
+
+    append("second");
+    TEST_ASSERT_EQUAL_PTR(chunk, out.head);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_output_iovec_CoalescesHeads);
+    RUN_TEST(test_http_output_iovec_BodyInPlace);
+    RUN_TEST(test_http_output_consume_Partial);
+    RUN_TEST(test_http_output_reserve_ReusesSpare);
+    return UNITY_END();
+}
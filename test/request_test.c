@@ -1,8 +1,12 @@
+#include "arena/arena.h"
+#include "http/alloc.h"
 #include "http/request.h"
+#include "request/parser.h"
 #include "request/request_internal.h"
 
 #include "http/results.h"
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unity.h>
@@ -138,6 +142,40 @@ void test_http_request_parse_WhitespaceHeaderKey_Fail(void) {
         http_request_parse(req, exampleRequest, strlen(exampleRequest)));
 }
 
+void test_http_parser_feed_InvalidHeaderKey_Fail(void) {
+    const char *requests[] = {
+        "POST / HTTP/1.1\r\nTransfer-Encoding : chunked\r\n\r\n0\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding\t: chunked\r\n\r\n0\r\n\r\n",
+        "POST / HTTP/1.1\r\nX-A: a\r\n Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n",
+        "POST / HTTP/1.1\r\nX-A: a\r\n\tTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n",
+        "GET / HTTP/1.1\r\nX Y: 1\r\n\r\n",
+        "GET / HTTP/1.1\r\nX\"Y: 1\r\n\r\n",
+    };
+
+    for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+        http_parser parser;
+        http_parser_init(&parser);
+        TEST_ASSERT_EQUAL_INT(HTTP_PARSE_ERROR,
+                              http_parser_feed(&parser, req, requests[i], strlen(requests[i])));
+        TEST_ASSERT_EQUAL_INT(HTTP_PARSE_ERROR_HEADER, parser.reason);
+
+        http_request_delete(req);
+        req = http_request_new().Value;
+    }
+}
+
+void test_http_request_parse_TabAroundHeaderValue_Success(void) {
+    const char *exampleRequest = "POST / HTTP/1.1\r\n"
+                                 "Content-Length:\t0\r\n"
+                                 "X-Token: \t~a.b|c \t\r\n"
+                                 "\r\n";
+
+    TEST_ASSERT_NULL(
+        http_request_parse(req, exampleRequest, strlen(exampleRequest)));
+    TEST_ASSERT_EQUAL_STRING("0", http_request_HeaderGetValue(req, "content-length").Value);
+    TEST_ASSERT_EQUAL_STRING("~a.b|c", http_request_HeaderGetValue(req, "x-token").Value);
+}
+
 void test_http_request_parse_EmptyHeaderValue_Success(void) {
     const char *exampleRequest = "POST /api/v1/users HTTP/1.1\r\n"
                                  "Host: example.com\r\n"
@@ -170,6 +208,440 @@ void test_http_request_parse_Body_Success(void) {
         req->body.length);
 }
 
+void test_http_parser_feed_ByteByByte_Success(void) {
+    const char *exampleRequest =
+        "POST /users HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello";
+    size_t len = strlen(exampleRequest);
+    size_t header_len = len - 5;
+
+    http_parser parser;
+    http_parser_init(&parser);
+
+    for (size_t i = 1; i < len; i++) {
+        http_parse_status status = http_parser_feed(&parser, req, exampleRequest, i);
+        if (i == header_len)
+            TEST_ASSERT_EQUAL_INT(HTTP_PARSE_HEADERS_COMPLETE, status);
+        else
+            TEST_ASSERT_EQUAL_INT(HTTP_PARSE_INCOMPLETE, status);
+    }
+
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_COMPLETE,
+                          http_parser_feed(&parser, req, exampleRequest, len));
+    TEST_ASSERT_EQUAL_UINT(len, parser.consumed);
+
+    TEST_ASSERT_EQUAL_STRING("POST", req->method);
+    TEST_ASSERT_EQUAL_STRING("/users", req->uri);
+    ConstStringResult cstr_res = http_request_HeaderGetValue(req, "host");
+    TEST_ASSERT(cstr_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("example.com", cstr_res.Value);
+    TEST_ASSERT_EQUAL_MEMORY("hello", req->body.data, req->body.length);
+}
+
+void test_http_parser_feed_Pipelined_StopsAtRequestEnd(void) {
+    const char *first = "GET /a HTTP/1.1\r\nHost: example.com\r\n\r\n";
+    const char *pipelined =
+        "GET /a HTTP/1.1\r\nHost: example.com\r\n\r\n"
+        "GET /b HTTP/1.1\r\nHost: example.com\r\n\r\n";
+
+    http_parser parser;
+    http_parser_init(&parser);
+
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_COMPLETE,
+                          http_parser_feed(&parser, req, pipelined, strlen(pipelined)));
+    TEST_ASSERT_EQUAL_UINT(strlen(first), parser.consumed);
+    TEST_ASSERT_EQUAL_STRING("/a", req->uri);
+    TEST_ASSERT_NULL(req->body.data);
+}
+
+void test_http_parser_feed_BareLF_Fail(void) {
+    const char *exampleRequest = "GET / HTTP/1.1\nHost: example.com\n\n";
+
+    http_parser parser;
+    http_parser_init(&parser);
+
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_ERROR,
+                          http_parser_feed(&parser, req, exampleRequest, strlen(exampleRequest)));
+    TEST_ASSERT_NOT_NULL(parser.err);
+}
+
+void test_http_parser_feed_ControlCharacter_Fail(void) {
+    const char *requests[] = {
+        "GET / HTTP/1.1\r\nHost: exa\x01mple.com\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost: example.com\rX: y\r\n\r\n",
+        "GET /\x7f HTTP/1.1\r\n\r\n",
+    };
+
+    for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+        http_parser parser;
+        http_parser_init(&parser);
+        TEST_ASSERT_EQUAL_INT(HTTP_PARSE_ERROR,
+                              http_parser_feed(&parser, req, requests[i], strlen(requests[i])));
+    }
+
+    // Tabs and obs-text are fine in values
+    const char *exampleRequest = "GET / HTTP/1.1\r\nX-Name: a\tb \xc3\xa9\r\n\r\n";
+    http_parser parser;
+    http_parser_init(&parser);
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_COMPLETE,
+                          http_parser_feed(&parser, req, exampleRequest, strlen(exampleRequest)));
+    TEST_ASSERT_EQUAL_STRING("a\tb \xc3\xa9", http_request_HeaderGetValue(req, "x-name").Value);
+}
+
+void test_http_parser_feed_InvalidContentLength_Fail(void) {
+    const char *exampleRequest = "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n";
+
+    http_parser parser;
+    http_parser_init(&parser);
+
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_ERROR,
+                          http_parser_feed(&parser, req, exampleRequest, strlen(exampleRequest)));
+}
+
+void test_http_parser_feed_RepeatedContentLength_Success(void) {
+    const char *exampleRequest =
+        "POST / HTTP/1.1\r\nContent-Length: 3\r\ncontent-length:  3 \r\n\r\nabc";
+
+    http_parser parser;
+    http_parser_init(&parser);
+
+    http_parse_status status =
+        http_parser_feed(&parser, req, exampleRequest, strlen(exampleRequest));
+    if (status == HTTP_PARSE_HEADERS_COMPLETE)
+        status = http_parser_feed(&parser, req, exampleRequest, strlen(exampleRequest));
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_COMPLETE, status);
+    TEST_ASSERT_EQUAL_UINT(3, parser.content_length);
+}
+
+void test_http_parser_feed_ZeroCopy_ViewsIntoBuffer(void) {
+    char buffer[] =
+        "POST /users HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello";
+    size_t len = strlen(buffer);
+
+    TEST_ASSERT_NULL(http_request_SetZeroCopy(req, true));
+
+    http_parser parser;
+    http_parser_init(&parser);
+
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_COMPLETE, http_parser_feed(&parser, req, buffer, len));
+    TEST_ASSERT_EQUAL_PTR(buffer, req->method);
+    TEST_ASSERT_EQUAL_STRING("POST", req->method);
+    TEST_ASSERT_EQUAL_PTR(buffer + 5, req->uri);
+    TEST_ASSERT_EQUAL_STRING("/users", req->uri);
+    ConstStringResult cstr_res = http_request_HeaderGetValue(req, "host");
+    TEST_ASSERT(cstr_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("example.com", cstr_res.Value);
+    TEST_ASSERT_EQUAL_PTR(buffer + len - 5, req->body.data);
+    TEST_ASSERT_EQUAL_UINT(5, req->body.length);
+    TEST_ASSERT_NOT_NULL(http_request_SetZeroCopy(req, false));
+}
+
+void test_http_parser_feed_Arena_NoAllocations(void) {
+    const char *request =
+        "GET /users/42?page=2 HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Accept: */*\r\n"
+        "Cookie: session=abc\r\n"
+        "\r\n";
+    char buffer[128];
+    http_arena arena;
+    http_arena_init(&arena, 0);
+    http_allocator_SetCounting(true);
+
+    // The first request grows the arena, later ones reuse its block
+    for (int round = 0; round < 3; round++) {
+        // Zero-copy parsing writes into the buffer
+        strcpy(buffer, request);
+        http_allocator_ResetStats();
+        HTTPRequestResult res = http_request_newInArena(&arena);
+        TEST_ASSERT(res.Ok);
+        TEST_ASSERT_NULL(http_request_SetZeroCopy(res.Value, true));
+        http_parser parser;
+        http_parser_init(&parser);
+        TEST_ASSERT_EQUAL_INT(HTTP_PARSE_COMPLETE,
+                              http_parser_feed(&parser, res.Value, buffer, strlen(buffer)));
+        http_request_delete(res.Value);
+    }
+
+    http_alloc_stats stats = http_allocator_Stats();
+    http_allocator_SetCounting(false);
+    http_arena_deinit(&arena);
+    TEST_ASSERT_EQUAL_UINT64(0, stats.allocs);
+    TEST_ASSERT_EQUAL_UINT64(0, stats.frees);
+}
+
+void test_http_parser_feed_ZeroCopy_BufferMoved(void) {
+    const char *exampleRequest =
+        "POST /users HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello";
+    size_t len = strlen(exampleRequest);
+    char first[128];
+    char second[128];
+
+    TEST_ASSERT_NULL(http_request_SetZeroCopy(req, true));
+
+    http_parser parser;
+    http_parser_init(&parser);
+
+    // Header block split across two buffers, as after a realloc
+    size_t split = 30;
+    memcpy(first, exampleRequest, split);
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_INCOMPLETE, http_parser_feed(&parser, req, first, split));
+    memcpy(second, first, split);
+    memset(first, 'x', sizeof(first));
+    memcpy(second + split, exampleRequest + split, len - split);
+
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_COMPLETE, http_parser_feed(&parser, req, second, len));
+    TEST_ASSERT_EQUAL_PTR(second, req->method);
+    TEST_ASSERT_EQUAL_STRING("POST", req->method);
+    TEST_ASSERT_EQUAL_STRING("/users", req->uri);
+    ConstStringResult cstr_res = http_request_HeaderGetValue(req, "host");
+    TEST_ASSERT(cstr_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("example.com", cstr_res.Value);
+    TEST_ASSERT_EQUAL_MEMORY("hello", req->body.data, req->body.length);
+}
+
+void test_http_request_parse_ManyHeaders_Success(void) {
+    char request[2048] = "GET / HTTP/1.1\r\n";
+    for (int i = 0; i < 40; i++)
+        sprintf(request + strlen(request), "X-Header-%d: value-%d\r\n", i, i);
+    strcat(request, "\r\n");
+
+    TEST_ASSERT_NULL(http_request_parse(req, request, strlen(request)));
+
+    size_t keys_length = 0;
+    ConstStringArrResult keys_res = http_request_HeaderKeys(req, &keys_length);
+    TEST_ASSERT(keys_res.Ok);
+    TEST_ASSERT_EQUAL_UINT(40, keys_length);
+    http_free(keys_res.Value);
+
+    ConstStringResult cstr_res = http_request_HeaderGetValue(req, "x-header-0");
+    TEST_ASSERT_EQUAL_STRING("value-0", cstr_res.Value);
+    cstr_res = http_request_HeaderGetValue(req, "x-header-39");
+    TEST_ASSERT_EQUAL_STRING("value-39", cstr_res.Value);
+}
+
+void test_http_request_parse_TooManyHeaders_Fail(void) {
+    char request[8192] = "GET / HTTP/1.1\r\n";
+    for (int i = 0; i <= HTTP_REQUEST_MAX_HEADERS; i++)
+        sprintf(request + strlen(request), "X-%d: %d\r\n", i, i);
+    strcat(request, "\r\n");
+
+    TEST_ASSERT_NOT_NULL(http_request_parse(req, request, strlen(request)));
+}
+
+void test_http_request_parse_KnownHeaders_Success(void) {
+    // Hot headers past the inline array, one repeated, plus a cold one
+    char request[2048] = "GET / HTTP/1.1\r\nCONTENT-TYPE: text/plain\r\n";
+    for (int i = 0; i < 20; i++)
+        sprintf(request + strlen(request), "X-Header-%d: value-%d\r\n", i, i);
+    strcat(request, "Host: a.example\r\nUser-Agent: test\r\nhost: b.example\r\n\r\n");
+
+    TEST_ASSERT_NULL(http_request_parse(req, request, strlen(request)));
+
+    TEST_ASSERT_EQUAL_STRING("b.example",
+                             http_request_HeaderGetKnown(req, HTTP_HEADER_HOST).Value);
+    TEST_ASSERT_EQUAL_STRING("text/plain",
+                             http_request_HeaderGetKnown(req, HTTP_HEADER_CONTENT_TYPE).Value);
+    TEST_ASSERT_EQUAL_STRING("test",
+                             http_request_HeaderGetKnown(req, HTTP_HEADER_USER_AGENT).Value);
+    TEST_ASSERT_NULL(http_request_HeaderGetKnown(req, HTTP_HEADER_CONNECTION).Value);
+    TEST_ASSERT_EQUAL_STRING("b.example", http_request_HeaderGetValue(req, "host").Value);
+    TEST_ASSERT_EQUAL_STRING("value-7", http_request_HeaderGetValue(req, "x-header-7").Value);
+
+    TEST_ASSERT_NULL(http_request_HeaderSetValue(req, "Connection", "close"));
+    TEST_ASSERT_EQUAL_STRING("close",
+                             http_request_HeaderGetKnown(req, HTTP_HEADER_CONNECTION).Value);
+    TEST_ASSERT_FALSE(http_request_KeepAlive(req).Value);
+}
+
+void test_http_request_parse_Chunked_Success(void) {
+    const char *exampleRequest =
+        "POST /upload HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Transfer-Encoding: Chunked\r\n"
+        "\r\n"
+        "5\r\nhello\r\n"
+        "7;name=value\r\n, world\r\n"
+        "0\r\n"
+        "X-Checksum: abc\r\n"
+        "\r\n";
+
+    TEST_ASSERT_NULL(http_request_parse(req, exampleRequest, strlen(exampleRequest)));
+    TEST_ASSERT_EQUAL_UINT(12, req->body.length);
+    TEST_ASSERT_EQUAL_MEMORY("hello, world", req->body.data, 12);
+
+    // Trailers are not merged into the header
+    TEST_ASSERT_NULL(http_request_HeaderGetValue(req, "x-checksum").Value);
+}
+
+void test_http_parser_feed_Chunked_ByteByByte(void) {
+    char buffer[] =
+        "POST /upload HTTP/1.1\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "A\r\n0123456789\r\n"
+        "1 ;ext\r\nx\r\n"
+        "0\r\n\r\n"
+        "GET /next HTTP/1.1\r\n\r\n";
+    size_t request_len = strlen(buffer) - strlen("GET /next HTTP/1.1\r\n\r\n");
+    size_t len = strlen(buffer);
+
+    TEST_ASSERT_NULL(http_request_SetZeroCopy(req, true));
+    http_parser parser;
+    http_parser_init(&parser);
+
+    http_parse_status status = HTTP_PARSE_INCOMPLETE;
+    size_t i = 1;
+    for (; i <= len && status != HTTP_PARSE_COMPLETE; i++) {
+        status = http_parser_feed(&parser, req, buffer, i);
+        if (status == HTTP_PARSE_HEADERS_COMPLETE)
+            status = http_parser_feed(&parser, req, buffer, i);
+        TEST_ASSERT_TRUE(status != HTTP_PARSE_ERROR);
+    }
+
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_COMPLETE, status);
+    TEST_ASSERT_EQUAL_UINT(request_len, i - 1);
+    TEST_ASSERT_EQUAL_UINT(request_len, parser.consumed);
+    TEST_ASSERT_EQUAL_UINT(11, req->body.length);
+    TEST_ASSERT_EQUAL_MEMORY("0123456789x", req->body.data, 11);
+    // Decoded in place
+    TEST_ASSERT_TRUE((char *)req->body.data > buffer &&
+                     (char *)req->body.data < buffer + request_len);
+}
+
+void test_http_parser_feed_ChunkedStream_ReleasesBody(void) {
+    const char *head = "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+    char buffer[256];
+    size_t len = strlen(head);
+    memcpy(buffer, head, len);
+
+    TEST_ASSERT_NULL(http_request_SetZeroCopy(req, true));
+    http_parser parser;
+    http_parser_init(&parser);
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSE_HEADERS_COMPLETE, http_parser_feed(&parser, req, buffer, len));
+    parser.stream_body = true;
+
+    // Chunks of 40 bytes arrive 16 bytes at a time, the buffer never
+    // holds more than the head, one read and a partial size line
+    char body[1024] = {0}, raw[2048] = {0};
+    size_t body_len = 0, raw_len = 0;
+    for (int c = 0; c < 20; c++)
+        raw_len += sprintf(raw + raw_len, "28\r\n%040d\r\n", c);
+    raw_len += sprintf(raw + raw_len, "0\r\n\r\n");
+
+    http_parse_status status = HTTP_PARSE_INCOMPLETE;
+    for (size_t sent = 0; status != HTTP_PARSE_COMPLETE;) {
+        size_t n = raw_len - sent < 16 ? raw_len - sent : 16;
+        memcpy(buffer + len, raw + sent, n);
+        len += n;
+        sent += n;
+        TEST_ASSERT_TRUE(len <= strlen(head) + 16 + 8);
+
+        do {
+            status = http_parser_feed(&parser, req, buffer, len);
+            TEST_ASSERT_TRUE(status != HTTP_PARSE_ERROR);
+            if (status == HTTP_PARSE_COMPLETE)
+                break;
+            if (status == HTTP_PARSE_BODY_CHUNK) {
+                memcpy(body + body_len, parser.chunk, parser.chunk_length);
+                body_len += parser.chunk_length;
+            }
+
+            size_t cut = http_parser_release(&parser);
+            memmove(buffer + parser.body_start, buffer + parser.body_start + cut,
+                    len - parser.body_start - cut);
+            len -= cut;
+        } while (status == HTTP_PARSE_BODY_CHUNK);
+    }
+
+    TEST_ASSERT_EQUAL_UINT(800, body_len);
+    TEST_ASSERT_EQUAL_MEMORY("0000000000000000000000000000000000000000", body, 40);
+    TEST_ASSERT_EQUAL_MEMORY("0000000000000000000000000000000000000019", body + 760, 40);
+    TEST_ASSERT_EQUAL_UINT(len, parser.consumed);
+    TEST_ASSERT_NULL(req->body.data);
+}
+
+void test_http_parser_feed_Chunked_Fail(void) {
+    const char *requests[] = {
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nz\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcX\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "fffffffffffffffffff\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 3\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n",
+    };
+
+    for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+        http_parser parser;
+        http_parser_init(&parser);
+        http_parse_status status =
+            http_parser_feed(&parser, req, requests[i], strlen(requests[i]));
+        if (status == HTTP_PARSE_HEADERS_COMPLETE)
+            status = http_parser_feed(&parser, req, requests[i], strlen(requests[i]));
+        TEST_ASSERT_EQUAL_INT(HTTP_PARSE_ERROR, status);
+
+        http_request_delete(req);
+        req = http_request_new().Value;
+    }
+}
+
+void test_http_parser_feed_ErrorReason(void) {
+    const struct {
+        const char *request;
+        http_parse_error reason;
+    } cases[] = {
+        { "GET /\r\n\r\n", HTTP_PARSE_ERROR_REQUEST_LINE },
+        { "GET / HTTP/1.1\r\nHost\r\n\r\n", HTTP_PARSE_ERROR_HEADER },
+        { "GET / HTTP/1.1\nHost: a\n\n", HTTP_PARSE_ERROR_REQUEST_LINE },
+        { "POST / HTTP/1.1\r\nContent-Length: x\r\n\r\n", HTTP_PARSE_ERROR_FRAMING },
+        { "POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 10\r\n\r\nabc",
+          HTTP_PARSE_ERROR_FRAMING },
+        { "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n\r\n"
+          "0\r\n\r\n",
+          HTTP_PARSE_ERROR_FRAMING },
+        { "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nz\r\n",
+          HTTP_PARSE_ERROR_CHUNK },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        http_parser parser;
+        http_parser_init(&parser);
+        TEST_ASSERT_EQUAL_INT(HTTP_PARSE_ERROR_NONE, parser.reason);
+        const char *request = cases[i].request;
+        http_parse_status status = http_parser_feed(&parser, req, request, strlen(request));
+        if (status == HTTP_PARSE_HEADERS_COMPLETE)
+            status = http_parser_feed(&parser, req, request, strlen(request));
+        TEST_ASSERT_EQUAL_INT(HTTP_PARSE_ERROR, status);
+        TEST_ASSERT_EQUAL_INT(cases[i].reason, parser.reason);
+
+        http_request_delete(req);
+        req = http_request_new().Value;
+    }
+}
+
+void test_http_request_BodyFd_OnlyForFileBodies(void) {
+    TEST_ASSERT_FALSE(http_request_BodyFd(req).Ok);
+
+    char data[] = "body";
+    http_request_setBodyFile(req, data, 4, 7);
+    IntResult fd_res = http_request_BodyFd(req);
+    TEST_ASSERT_TRUE(fd_res.Ok);
+    TEST_ASSERT_EQUAL_INT(7, fd_res.Value);
+    TEST_ASSERT_EQUAL_PTR(data, http_request_Body(req).Value->data);
+}
+
 int main(void) {
     UNITY_BEGIN();
 
@@ -180,8 +652,28 @@ int main(void) {
     RUN_TEST(test_http_request_parse_MissingSpace_Fail);
     RUN_TEST(test_http_request_parse_EmptyHeaderKey_Fail);
     RUN_TEST(test_http_request_parse_WhitespaceHeaderKey_Fail);
+    RUN_TEST(test_http_parser_feed_InvalidHeaderKey_Fail);
+    RUN_TEST(test_http_request_parse_TabAroundHeaderValue_Success);
     RUN_TEST(test_http_request_parse_EmptyHeaderValue_Success);
     RUN_TEST(test_http_request_parse_Body_Success);
+    RUN_TEST(test_http_parser_feed_ByteByByte_Success);
+    RUN_TEST(test_http_parser_feed_Pipelined_StopsAtRequestEnd);
+    RUN_TEST(test_http_parser_feed_BareLF_Fail);
+    RUN_TEST(test_http_parser_feed_ControlCharacter_Fail);
+    RUN_TEST(test_http_parser_feed_InvalidContentLength_Fail);
+    RUN_TEST(test_http_parser_feed_RepeatedContentLength_Success);
+    RUN_TEST(test_http_parser_feed_ZeroCopy_ViewsIntoBuffer);
+    RUN_TEST(test_http_parser_feed_ZeroCopy_BufferMoved);
+    RUN_TEST(test_http_parser_feed_Arena_NoAllocations);
+    RUN_TEST(test_http_request_parse_ManyHeaders_Success);
+    RUN_TEST(test_http_request_parse_TooManyHeaders_Fail);
+    RUN_TEST(test_http_request_parse_KnownHeaders_Success);
+    RUN_TEST(test_http_request_parse_Chunked_Success);
+    RUN_TEST(test_http_parser_feed_Chunked_ByteByByte);
+    RUN_TEST(test_http_parser_feed_ChunkedStream_ReleasesBody);
+    RUN_TEST(test_http_parser_feed_Chunked_Fail);
+    RUN_TEST(test_http_parser_feed_ErrorReason);
+    RUN_TEST(test_http_request_BodyFd_OnlyForFileBodies);
 
     return UNITY_END();
 }
@@ -1,7 +1,9 @@
+#include "http/alloc.h"
 #include "http/response.h"
 #include "http/results.h"
 #include "response/response_codes.h"
 #include "response/response_internal.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unity.h>
@@ -48,10 +50,10 @@ void test_http_response_bytes_Success(void) {
 
     const char* expected_response =
         "HTTP/1.1 200 OK\r\n"
-        "date: Mon, 13 Oct 2025 13:21:23 GMT\r\n"
-        "content-type: text/html; charset=UTF-8\r\n"
-        "content-length: 169\r\n"
-        "connection: close\r\n"
+        "Date: Mon, 13 Oct 2025 13:21:23 GMT\r\n"
+        "Content-Type: text/html; charset=UTF-8\r\n"
+        "Content-Length: 169\r\n"
+        "Connection: close\r\n"
         "\r\n"
         "<!DOCTYPE html>"
         "<html lang='en'>"
@@ -111,10 +113,10 @@ void test_http_response_bytes_BodyNoHeader_Fail(void) {
 
     const char* expected_response =
         "HTTP/1.1 200 OK\r\n"
-        "date: Mon, 13 Oct 2025 13:21:23 GMT\r\n"
-        "content-type: text/html; charset=UTF-8\r\n"
-        "content-length: 169\r\n"
-        "connection: close\r\n"
+        "Date: Mon, 13 Oct 2025 13:21:23 GMT\r\n"
+        "Content-Type: text/html; charset=UTF-8\r\n"
+        "Content-Length: 169\r\n"
+        "Connection: close\r\n"
         "\r\n"
         "<!DOCTYPE html>"
         "<html lang='en'>"
@@ -155,6 +157,134 @@ void test_http_response_bytes_CRLFHeader_Fail(void) {
     sdsfree(bytes);
 }
 
+void test_http_response_Header_IgnoresCase(void) {
+    TEST_ASSERT(!http_response_HeaderSetValue(resp, "Content-Type", "text/plain"));
+    TEST_ASSERT(!http_response_HeaderSetValue(resp, "CONTENT-TYPE", "  text/html "));
+
+    ConstStringResult cstr_res = http_response_HeaderGetValue(resp, "content-type");
+    TEST_ASSERT(cstr_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("text/html", cstr_res.Value);
+
+    BoolResult bool_res = http_response_HeaderContains(resp, "Content-type");
+    TEST_ASSERT(bool_res.Ok);
+    TEST_ASSERT(bool_res.Value);
+
+    // First spelling is kept
+    size_t keys_length = 0;
+    ConstStringArrResult keys_res = http_response_HeaderKeys(resp, &keys_length);
+    TEST_ASSERT(keys_res.Ok);
+    TEST_ASSERT_EQUAL_size_t(1, keys_length);
+    TEST_ASSERT_EQUAL_STRING("Content-Type", keys_res.Value[0]);
+    http_free(keys_res.Value);
+}
+
+void test_http_response_bytes_StandardStatusLine_Success(void) {
+    http_response_SetStatusCode(resp, HTTP_STATUS_NOT_FOUND);
+
+    ConstStringResult cstr_res = http_response_ReasonPhrase(resp);
+    TEST_ASSERT(cstr_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("Not Found", cstr_res.Value);
+
+    StringResult str_res = http_response_bytes(resp);
+    TEST_ASSERT(str_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 404 Not Found\r\n\r\n", str_res.Value);
+    sdsfree(str_res.Value);
+
+    http_response_SetVersion(resp, 1, 0);
+    str_res = http_response_bytes(resp);
+    TEST_ASSERT(str_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.0 404 Not Found\r\n\r\n", str_res.Value);
+    sdsfree(str_res.Value);
+
+    // A custom phrase wins over the table, unknown codes get none
+    http_response_SetReasonPhrase(resp, "Nothing Here");
+    str_res = http_response_bytes(resp);
+    TEST_ASSERT(str_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.0 404 Nothing Here\r\n\r\n", str_res.Value);
+    sdsfree(str_res.Value);
+
+    http_response_SetReasonPhrase(resp, NULL);
+    http_response_SetStatusCode(resp, 299);
+    str_res = http_response_bytes(resp);
+    TEST_ASSERT(str_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.0 299 \r\n\r\n", str_res.Value);
+    sdsfree(str_res.Value);
+}
+
+typedef struct counter {
+    int         next;
+    int         last;
+    bool        released;
+} counter;
+
+// Produces "<next>;" for next up to last, one number per call
+static ssize_t produce_numbers(void *buf, size_t cap, void *ctx) {
+    counter *c = ctx;
+    if (c->next > c->last)
+        return 0;
+    return snprintf(buf, cap, "%d;", c->next++);
+}
+
+static void release_counter(void *ctx) { ((counter *)ctx)->released = true; }
+
+void test_http_response_bytes_Producer_Success(void) {
+    counter c = {.next = 1, .last = 3};
+    http_response_SetStatusCode(resp, HTTP_STATUS_OK);
+    TEST_ASSERT(!http_response_SetBodyProducer(resp, produce_numbers, &c, release_counter));
+
+    StringResult str_res = http_response_bytes(resp);
+    TEST_ASSERT(str_res.Ok);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK\r\n\r\n1;2;3;", str_res.Value);
+    TEST_ASSERT(c.released);
+    sdsfree(str_res.Value);
+}
+
+void test_http_response_produce_Chunked_Success(void) {
+    counter c = {.next = 9, .last = 10};
+    http_response_SetStatusCode(resp, HTTP_STATUS_OK);
+    http_response_HeaderSetValue(resp, "Transfer-Encoding", "chunked");
+    TEST_ASSERT(!http_response_SetBodyProducer(resp, produce_numbers, &c, release_counter));
+    resp->chunked = true;
+
+    http_output out;
+    http_output_init(&out);
+    TEST_ASSERT_NULL(http_response_writeTo(resp, &out));
+
+    bool done = false;
+    int calls = 0;
+    while (!done) {
+        TEST_ASSERT_NULL(http_response_produce(resp, &out, &done));
+        calls++;
+    }
+    TEST_ASSERT_EQUAL_INT(3, calls);
+    TEST_ASSERT(c.released);
+
+    struct iovec iov[HTTP_OUTPUT_MAX_IOVEC];
+    size_t count = http_output_iovec(&out, iov, HTTP_OUTPUT_MAX_IOVEC);
+    char wire[256] = {0};
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(wire + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    TEST_ASSERT_EQUAL_size_t(out.pending, len);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                             "2\r\n9;\r\n3\r\n10;\r\n0\r\n\r\n",
+                             wire);
+    http_output_deinit(&out);
+}
+
+void test_http_response_SetBodyProducer_Replaced(void) {
+    counter c = {.next = 1, .last = 1};
+    TEST_ASSERT_NOT_NULL(http_response_SetBodyProducer(resp, NULL, NULL, NULL));
+    TEST_ASSERT(!http_response_SetBodyProducer(resp, produce_numbers, &c, release_counter));
+
+    // Setting a plain body drops the producer
+    TEST_ASSERT(!http_response_SetBody(resp, "x", 1));
+    TEST_ASSERT(c.released);
+    TEST_ASSERT_NULL(resp->producer);
+}
+
 int main(void) {
     UNITY_BEGIN();
 
@@ -162,6 +292,11 @@ int main(void) {
     RUN_TEST(test_http_response_bytes_NoHeader_Success);
     RUN_TEST(test_http_response_bytes_BodyNoHeader_Fail);
     RUN_TEST(test_http_response_bytes_CRLFHeader_Fail);
+    RUN_TEST(test_http_response_Header_IgnoresCase);
+    RUN_TEST(test_http_response_bytes_StandardStatusLine_Success);
+    RUN_TEST(test_http_response_bytes_Producer_Success);
+    RUN_TEST(test_http_response_produce_Chunked_Success);
+    RUN_TEST(test_http_response_SetBodyProducer_Replaced);
 
     return UNITY_END();
 }
@@ -0,0 +1,186 @@
+#include "http/router.h"
+#include "router/router_internal.h"
+
+#include "http/results.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+http_router *router = NULL;
+http_route_match match;
+
+static void handler_a(http_request *req, http_response *res, void *ctx) {}
+static void handler_b(http_request *req, http_response *res, void *ctx) {}
+static bool on_body(http_request *req, const void *data, size_t len, void *ctx) {
+    return true;
+}
+
+static void route(const char *method, const char *path) {
+    TEST_ASSERT_NULL(http_router_match(router, method, path, strlen(path), &match));
+}
+
+static void assert_param(size_t i, const char *path, const char *name,
+                         const char *value) {
+    TEST_ASSERT_EQUAL_STRING(name, match.params[i].name);
+    TEST_ASSERT_EQUAL_size_t(strlen(value), match.params[i].length);
+    TEST_ASSERT_EQUAL_MEMORY(value, path + match.params[i].offset, strlen(value));
+}
+
+void setUp(void) {
+    HTTPRouterResult res = http_router_new();
+    if (!res.Ok)
+        exit(EXIT_FAILURE);
+    router = res.Value;
+}
+
+void tearDown(void) { http_router_delete(router); }
+
+void test_http_router_match_Static(void) {
+    int ctx = 0;
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/", handler_a, NULL));
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/users", handler_a, NULL));
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/user", handler_b, &ctx));
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/us", handler_a, NULL));
+
+    route("GET", "/user");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_FOUND, match.status);
+    TEST_ASSERT_EQUAL_PTR(handler_b, match.handler);
+    TEST_ASSERT_EQUAL_PTR(&ctx, match.ctx);
+    TEST_ASSERT_EQUAL_size_t(0, match.param_count);
+
+    route("GET", "/users");
+    TEST_ASSERT_EQUAL_PTR(handler_a, match.handler);
+    route("GET", "/");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_FOUND, match.status);
+
+    route("GET", "/use");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_NOT_FOUND, match.status);
+    route("GET", "/users/");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_NOT_FOUND, match.status);
+}
+
+void test_http_router_match_Params(void) {
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/users/:id/posts/:post", handler_a, NULL));
+
+    const char *path = "/users/42/posts/hello-world";
+    route("GET", path);
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_FOUND, match.status);
+    TEST_ASSERT_EQUAL_size_t(2, match.param_count);
+    assert_param(0, path, "id", "42");
+    assert_param(1, path, "post", "hello-world");
+
+    route("GET", "/users//posts/x");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_NOT_FOUND, match.status);
+    route("GET", "/users/42/posts");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_NOT_FOUND, match.status);
+}
+
+void test_http_router_match_Wildcard(void) {
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/static/*file", handler_a, NULL));
+
+    const char *path = "/static/css/site.css";
+    route("GET", path);
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_FOUND, match.status);
+    TEST_ASSERT_EQUAL_size_t(1, match.param_count);
+    assert_param(0, path, "file", "css/site.css");
+
+    TEST_ASSERT_NOT_NULL(http_router_add(router, "GET", "/files/*path/meta", handler_a, NULL));
+}
+
+void test_http_router_match_Priority(void) {
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/users/me", handler_a, NULL));
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/users/:id", handler_b, NULL));
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/users/:id/avatar", handler_a, NULL));
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/*rest", handler_b, NULL));
+
+    route("GET", "/users/me");
+    TEST_ASSERT_EQUAL_PTR(handler_a, match.handler);
+    TEST_ASSERT_EQUAL_size_t(0, match.param_count);
+
+    const char *path = "/users/mel";
+    route("GET", path);
+    TEST_ASSERT_EQUAL_PTR(handler_b, match.handler);
+    TEST_ASSERT_EQUAL_size_t(1, match.param_count);
+    assert_param(0, path, "id", "mel");
+
+    // Dead end below the parameter falls back to the wildcard
+    path = "/users/7/banner";
+    route("GET", path);
+    TEST_ASSERT_EQUAL_PTR(handler_b, match.handler);
+    TEST_ASSERT_EQUAL_size_t(1, match.param_count);
+    assert_param(0, path, "rest", "users/7/banner");
+}
+
+void test_http_router_match_MethodNotAllowed(void) {
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/items/:id", handler_a, NULL));
+    TEST_ASSERT_NULL(http_router_add(router, "PUT", "/items/:id", handler_b, NULL));
+
+    route("PUT", "/items/3");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_FOUND, match.status);
+    TEST_ASSERT_EQUAL_PTR(handler_b, match.handler);
+
+    route("DELETE", "/items/3");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_METHOD_NOT_ALLOWED, match.status);
+    TEST_ASSERT_EQUAL_STRING("GET, PUT", match.allow);
+    TEST_ASSERT_NULL(match.handler);
+}
+
+void test_http_router_match_Streaming(void) {
+    TEST_ASSERT_NULL(http_router_addStreaming(router, "PUT", "/files/*name", on_body,
+                                              handler_a, NULL));
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/files/*name", handler_b, NULL));
+
+    route("PUT", "/files/a.bin");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_FOUND, match.status);
+    TEST_ASSERT_EQUAL_PTR(handler_a, match.handler);
+    TEST_ASSERT_EQUAL_PTR(on_body, match.on_body);
+
+    route("GET", "/files/a.bin");
+    TEST_ASSERT_EQUAL_PTR(handler_b, match.handler);
+    TEST_ASSERT_NULL(match.on_body);
+}
+
+void test_http_router_add_Errors(void) {
+    TEST_ASSERT_NULL(http_router_add(router, "GET", "/a/:id", handler_a, NULL));
+
+    TEST_ASSERT_NOT_NULL(http_router_add(router, "GET", "/a/:id", handler_b, NULL));
+    TEST_ASSERT_NOT_NULL(http_router_add(router, "GET", "/a/:name/b", handler_a, NULL));
+    TEST_ASSERT_NOT_NULL(http_router_add(router, "GET", "a", handler_a, NULL));
+    TEST_ASSERT_NOT_NULL(http_router_add(router, "GET", "/b/:", handler_a, NULL));
+    TEST_ASSERT_NOT_NULL(http_router_add(router, "GET", "/c", NULL, NULL));
+    TEST_ASSERT_NOT_NULL(
+        http_router_add(router, "GET", "/:a/:b/:c/:d/:e/:f/:g/:h/:i", handler_a, NULL));
+}
+
+void test_http_router_match_ManyRoutes(void) {
+    char pattern[64];
+    for (int i = 0; i < 500; i++) {
+        snprintf(pattern, sizeof(pattern), "/api/v1/resource%d/:id", i);
+        TEST_ASSERT_NULL(http_router_add(router, "GET", pattern, handler_a, NULL));
+    }
+
+    for (int i = 0; i < 500; i++) {
+        snprintf(pattern, sizeof(pattern), "/api/v1/resource%d/abc", i);
+        route("GET", pattern);
+        TEST_ASSERT_EQUAL(HTTP_ROUTE_FOUND, match.status);
+        assert_param(0, pattern, "id", "abc");
+    }
+
+    route("GET", "/api/v1/resource500/abc");
+    TEST_ASSERT_EQUAL(HTTP_ROUTE_NOT_FOUND, match.status);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_router_match_Static);
+    RUN_TEST(test_http_router_match_Params);
+    RUN_TEST(test_http_router_match_Wildcard);
+    RUN_TEST(test_http_router_match_Priority);
+    RUN_TEST(test_http_router_match_MethodNotAllowed);
+    RUN_TEST(test_http_router_match_Streaming);
+    RUN_TEST(test_http_router_add_Errors);
+    RUN_TEST(test_http_router_match_ManyRoutes);
+    return UNITY_END();
+}
@@ -0,0 +1,89 @@
+#include "scan/scan.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static size_t scan(const char *s, char delim, size_t *delim_pos) {
+    *delim_pos = SIZE_MAX;
+    return http_scan_line(s, 0, strlen(s), delim, delim_pos);
+}
+
+void test_http_scan_line_FindsCRAndDelim(void) {
+    size_t delim;
+    const char *line = "Content-Type: text/html; charset=utf-8\r\nHost: x\r\n";
+    TEST_ASSERT_EQUAL_size_t(38, scan(line, ':', &delim));
+    TEST_ASSERT_EQUAL_size_t(12, delim);
+
+    // Delimiters after the stop belong to the next line
+    TEST_ASSERT_EQUAL_size_t(5, scan("Host \r\nX: y", ':', &delim));
+    TEST_ASSERT_EQUAL_size_t(SIZE_MAX, delim);
+
+    TEST_ASSERT_EQUAL_size_t(14, scan("GET / HTTP/1.1", ' ', &delim));
+    TEST_ASSERT_EQUAL_size_t(3, delim);
+}
+
+void test_http_scan_line_StopsAtControl(void) {
+    size_t delim;
+    TEST_ASSERT_EQUAL_size_t(5, scan("value\x01 more", ':', &delim));
+    TEST_ASSERT_EQUAL_size_t(2, scan("ab\x7f", ':', &delim));
+    TEST_ASSERT_EQUAL_size_t(3, scan("a\tb\n", ':', &delim));
+    TEST_ASSERT_EQUAL_size_t(4, scan("\xc3\xa9\xff\x80", ':', &delim));
+}
+
+void test_http_scan_line_Resumes(void) {
+    const char *line = "X-Forwarded-For: 10.0.0.1, 10.0.0.2, 10.0.0.3\r\n";
+    size_t delim = SIZE_MAX;
+    TEST_ASSERT_EQUAL_size_t(10, http_scan_line(line, 0, 10, ':', &delim));
+    TEST_ASSERT_EQUAL_size_t(SIZE_MAX, delim);
+    TEST_ASSERT_EQUAL_size_t(45, http_scan_line(line, 10, strlen(line), ':', &delim));
+    TEST_ASSERT_EQUAL_size_t(15, delim);
+}
+
+void test_http_scan_line_MatchesScalar(void) {
+    // Every stop and delimiter position against every vector alignment
+    char buf[160];
+    for (size_t len = 0; len < 100; len++) {
+        for (size_t pos = 0; pos <= len; pos++) {
+            memset(buf, 'a', sizeof(buf));
+            buf[pos] = ':';
+            if (pos + 7 < len)
+                buf[pos + 7] = (pos & 1) ? '\r' : '\x1f';
+
+            for (size_t from = 0; from < 3 && from <= len; from++) {
+                size_t fast_delim = SIZE_MAX, slow_delim = SIZE_MAX;
+                size_t fast = http_scan_line(buf, from, len, ':', &fast_delim);
+                size_t slow = http_scan_lineScalar(buf, from, len, ':', &slow_delim);
+                TEST_ASSERT_EQUAL_size_t(slow, fast);
+                TEST_ASSERT_EQUAL_size_t(slow_delim, fast_delim);
+            }
+        }
+    }
+
+    srand(97);
+    for (int round = 0; round < 2000; round++) {
+        size_t len = rand() % sizeof(buf);
+        for (size_t i = 0; i < len; i++)
+            buf[i] = (rand() % 64 == 0) ? rand() % 256 : 'a' + rand() % 26;
+        size_t fast_delim = SIZE_MAX, slow_delim = SIZE_MAX;
+        size_t fast = http_scan_line(buf, 0, len, 'q', &fast_delim);
+        size_t slow = http_scan_lineScalar(buf, 0, len, 'q', &slow_delim);
+        TEST_ASSERT_EQUAL_size_t(slow, fast);
+        TEST_ASSERT_EQUAL_size_t(slow_delim, fast_delim);
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_scan_line_FindsCRAndDelim);
+    RUN_TEST(test_http_scan_line_StopsAtControl);
+    RUN_TEST(test_http_scan_line_Resumes);
+    RUN_TEST(test_http_scan_line_MatchesScalar);
+    return UNITY_END();
+}
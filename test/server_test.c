@@ -0,0 +1,538 @@
+#include "http/request.h"
+#include "http/response.h"
+#include "http/server.h"
+#include "server_internal.h"
+
+#include "http/results.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+#define BIG_BODY (200 * 1024)
+// Most a client tries to send before giving up on being stalled
+#define UPLOAD_LIMIT (16 * 1024 * 1024)
+
+// Body sent to the slow streaming route
+#define SLOW_BODY (16 * 1024 * 1024)
+
+http_server *server = NULL;
+http_worker worker;
+int client_fd = -1;
+pthread_t listen_thread;
+bool listening = false;
+ErrorMessage listen_err = NULL;
+atomic_bool body_held;
+atomic_size_t body_received;
+atomic_int producers_released;
+
+static void echo_handler(http_request *req, http_response *res, void *ctx) {
+    const char *uri = http_request_Uri(req).Value;
+    http_response_SetBody(res, (void *)uri, strlen(uri));
+}
+
+static void big_handler(http_request *req, http_response *res, void *ctx) {
+    static char body[BIG_BODY];
+    http_response_SetBody(res, body, sizeof(body));
+}
+
+static void no_content_handler(http_request *req, http_response *res, void *ctx) {
+    http_response_SetStatusCode(res, 204);
+    http_response_SetBody(res, "gone", 4);
+}
+
+/**
+ * Streams "x" for as long as it is asked to
+ */
+static ssize_t endless_producer(void *buf, size_t cap, void *ctx) {
+    memset(buf, 'x', cap);
+    return cap;
+}
+
+static void count_release(void *ctx) {
+    atomic_fetch_add(&producers_released, 1);
+}
+
+static void stream_handler(http_request *req, http_response *res, void *ctx) {
+    http_response_SetBodyProducer(res, endless_producer, NULL, count_release);
+}
+
+static void not_modified_handler(http_request *req, http_response *res, void *ctx) {
+    http_response_SetStatusCode(res, 304);
+    stream_handler(req, res, ctx);
+}
+
+/**
+ * Takes body pieces no faster than the test lets it
+ */
+static bool slow_on_body(http_request *req, const void *data, size_t len, void *ctx) {
+    atomic_fetch_add(&body_received, len);
+    for (int i = 0; i < 10000 && atomic_load(&body_held); i++)
+        usleep(1000);
+    return true;
+}
+
+static void slow_handler(http_request *req, http_response *res, void *ctx) {
+    http_response_SetBody(res, "done", 4);
+}
+
+/**
+ * Hands the worker a new connection whose peer is client_fd
+ */
+static http_connection *connect_client(void) {
+    if (client_fd >= 0)
+        close(client_fd);
+
+    int fds[2];
+    TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                        0, fds));
+    client_fd = fds[0];
+    http_connection *conn = http_worker_addConnection(&worker, fds[1]);
+    TEST_ASSERT_NOT_NULL(conn);
+    return conn;
+}
+
+static void send_request(const char *data) {
+    TEST_ASSERT_EQUAL_INT(strlen(data), write(client_fd, data, strlen(data)));
+}
+
+/**
+ * Appends what the server wrote so far to received
+ */
+static sds receive(sds received) {
+    char tmp[16 * 1024];
+    ssize_t n;
+    while ((n = read(client_fd, tmp, sizeof(tmp))) > 0)
+        received = sdscatlen(received, tmp, n);
+    return received;
+}
+
+/**
+ * Occurrences of needle in received, bodies may hold NULs
+ */
+static size_t count(sds received, const char *needle) {
+    size_t n = 0;
+    const char *end = received + sdslen(received);
+    for (const char *at = received;
+         (at = memmem(at, end - at, needle, strlen(needle))) != NULL; at++)
+        n++;
+    return n;
+}
+
+static size_t unread(http_connection *conn) {
+    int bytes = 0;
+    TEST_ASSERT_EQUAL_INT(0, ioctl(conn->fd, FIONREAD, &bytes));
+    return bytes;
+}
+
+static void *listen_run(void *arg) {
+    listen_err = http_server_listen(server, 0);
+    return NULL;
+}
+
+/**
+ * Runs server on an ephemeral port with one worker using backend
+ *
+ * @returns Port
+ */
+static uint16_t start_server(http_backend backend) {
+    TEST_ASSERT_NULL(http_server_SetWorkers(server, 1));
+    TEST_ASSERT_NULL(http_server_SetBackend(server, backend));
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&listen_thread, NULL, listen_run, NULL));
+    listening = true;
+
+    // Bound before the worker starts, connections wait in the backlog
+    uint16_t port = 0;
+    for (int i = 0; i < 5000 && port == 0; i++) {
+        usleep(1000);
+        port = http_server_Port(server).Value;
+    }
+    TEST_ASSERT_TRUE(port != 0);
+    return port;
+}
+
+static void stop_server(void) {
+    http_server_stop(server);
+    pthread_join(listen_thread, NULL);
+    listening = false;
+    TEST_ASSERT_NULL(listen_err);
+}
+
+/**
+ * @param rcvbuf    Receive buffer of the client, 0 for the default
+ */
+static int connect_tcp(uint16_t port, int rcvbuf) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    TEST_ASSERT_TRUE(fd >= 0);
+    if (rcvbuf > 0)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in address = { .sin_family = AF_INET,
+                                   .sin_port = htons(port),
+                                   .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    TEST_ASSERT_EQUAL_INT(0, connect(fd, (struct sockaddr *)&address, sizeof(address)));
+    return fd;
+}
+
+/**
+ * Writes data to fd over and over, pausing a little in between like a
+ * client on a real network, until UPLOAD_LIMIT bytes went out or the
+ * peer stopped taking them
+ *
+ * @returns Bytes written
+ */
+static size_t upload(int fd, const char *data, size_t len) {
+    TEST_ASSERT_EQUAL_INT(0, ioctl(fd, FIONBIO, &(int){ 1 }));
+    size_t sent = 0;
+    while (sent < UPLOAD_LIMIT) {
+        ssize_t n = write(fd, data, len);
+        if (n > 0) {
+            sent += n;
+            usleep(200);
+            continue;
+        }
+        TEST_ASSERT_TRUE(errno == EAGAIN || errno == EWOULDBLOCK);
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        if (poll(&pfd, 1, 300) == 0)
+            break;
+    }
+    TEST_ASSERT_EQUAL_INT(0, ioctl(fd, FIONBIO, &(int){ 0 }));
+    return sent;
+}
+
+/**
+ * Bytes read from clients by the server so far, taken from its metrics
+ * route
+ */
+static uint64_t server_bytes_in(uint16_t port) {
+    int fd = connect_tcp(port, 0);
+    const char *request = "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n";
+    TEST_ASSERT_EQUAL_INT(strlen(request), write(fd, request, strlen(request)));
+
+    sds text = sdsempty();
+    char tmp[4096];
+    ssize_t n;
+    while ((n = read(fd, tmp, sizeof(tmp))) > 0)
+        text = sdscatlen(text, tmp, n);
+    close(fd);
+
+    const char *name = "\nhttp_received_bytes_total ";
+    char *at = strstr(text, name);
+    TEST_ASSERT_NOT_NULL(at);
+    uint64_t bytes = strtoull(at + strlen(name), NULL, 10);
+    sdsfree(text);
+    return bytes;
+}
+
+/**
+ * A client pipelining requests for large responses without reading
+ * them must stall once the server stops reading
+ */
+static void assert_slowReaderStalls(http_backend backend) {
+    TEST_ASSERT_NULL(http_server_EnableMetrics(server, "/metrics"));
+    uint16_t port = start_server(backend);
+
+    char requests[64 * 1024];
+    const char *request = "GET /big HTTP/1.1\r\n\r\n";
+    size_t request_len = strlen(request);
+    size_t len = 0;
+    for (; len + request_len <= sizeof(requests); len += request_len)
+        memcpy(requests + len, request, request_len);
+
+    int fd = connect_tcp(port, 4096);
+    size_t sent = upload(fd, requests, len);
+    uint64_t bytes_in = server_bytes_in(port);
+    close(fd);
+    stop_server();
+
+    TEST_ASSERT_TRUE(sent < UPLOAD_LIMIT);
+    // The rest waits in socket buffers. Each time io_uring resumes
+    // reading it may take what the socket holds before the recv is
+    // cancelled again, so this is no tighter.
+    TEST_ASSERT_TRUE(bytes_in < sent / 2);
+}
+
+/**
+ * A client uploading to a streaming route whose on_body is stuck must
+ * stall instead of having its body read into the server
+ */
+static void assert_slowBodyStalls(http_backend backend) {
+    TEST_ASSERT_NULL(http_server_AddStreamingRoute(server, "POST", "/slow", slow_on_body,
+                                                   slow_handler, NULL));
+    uint16_t port = start_server(backend);
+    atomic_store(&body_held, true);
+    atomic_store(&body_received, 0);
+
+    int fd = connect_tcp(port, 0);
+    int sndbuf = 16 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    char head[128];
+    int head_len = snprintf(head, sizeof(head),
+                            "POST /slow HTTP/1.1\r\nContent-Length: %d\r\n\r\n", SLOW_BODY);
+    TEST_ASSERT_EQUAL_INT(head_len, write(fd, head, head_len));
+    // Routed before the body comes, a body sent along with its head may
+    // be read a little further ahead
+    usleep(100 * 1000);
+
+    static char body[64 * 1024];
+    size_t sent = upload(fd, body, sizeof(body));
+    TEST_ASSERT_TRUE(sent < SLOW_BODY);
+    // What the socket buffers hold plus a piece or two read ahead
+    TEST_ASSERT_TRUE(sent < 2 * 1024 * 1024);
+
+    atomic_store(&body_held, false);
+    for (size_t left = SLOW_BODY - sent; left > 0;) {
+        ssize_t n = write(fd, body, left < sizeof(body) ? left : sizeof(body));
+        TEST_ASSERT_TRUE(n > 0);
+        left -= n;
+    }
+    sds received = sdsempty();
+    char tmp[4096];
+    ssize_t n;
+    while (!strstr(received, "done") && (n = read(fd, tmp, sizeof(tmp))) > 0)
+        received = sdscatlen(received, tmp, n);
+    close(fd);
+    stop_server();
+
+    TEST_ASSERT_NOT_NULL(strstr(received, "HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_EQUAL_size_t(SLOW_BODY, atomic_load(&body_received));
+    sdsfree(received);
+}
+
+void setUp(void) {
+    server = http_server_new().Value;
+    TEST_ASSERT_NOT_NULL(server);
+    TEST_ASSERT_NULL(http_server_AddRoute(server, "GET", "/a", echo_handler, NULL));
+    TEST_ASSERT_NULL(http_server_AddRoute(server, "GET", "/b", echo_handler, NULL));
+    TEST_ASSERT_NULL(http_server_AddRoute(server, "GET", "/c", echo_handler, NULL));
+    TEST_ASSERT_NULL(http_server_AddRoute(server, "POST", "/upload", echo_handler, NULL));
+    TEST_ASSERT_NULL(http_server_AddRoute(server, "GET", "/big", big_handler, NULL));
+    TEST_ASSERT_NULL(http_server_AddRoute(server, "GET", "/empty", no_content_handler, NULL));
+    TEST_ASSERT_NULL(http_server_AddRoute(server, "GET", "/stale", not_modified_handler, NULL));
+    TEST_ASSERT_NULL(http_server_AddRoute(server, "HEAD", "/a", echo_handler, NULL));
+    TEST_ASSERT_NULL(http_server_AddRoute(server, "HEAD", "/stream", stream_handler, NULL));
+    atomic_store(&producers_released, 0);
+    worker = (http_worker){ .server = server, .epoll_fd = -1 };
+}
+
+void tearDown(void) {
+    atomic_store(&body_held, false);
+    if (listening) {
+        http_server_stop(server);
+        pthread_join(listen_thread, NULL);
+        listening = false;
+    }
+    while (worker.connections)
+        http_connection_close(worker.connections);
+    while (worker.pool) {
+        http_connection *next = worker.pool->next;
+        http_connection_delete(worker.pool);
+        worker.pool = next;
+    }
+    if (client_fd >= 0)
+        close(client_fd);
+    client_fd = -1;
+    http_server_delete(server);
+}
+
+void test_http_connection_onEvent_Pipelined_InOrder(void) {
+    http_connection *conn = connect_client();
+    send_request("GET /a HTTP/1.1\r\n\r\n"
+                 "GET /b HTTP/1.1\r\n\r\n"
+                 "GET /c HTTP/1.1\r\n\r\n");
+
+    TEST_ASSERT_TRUE(http_connection_onEvent(conn));
+
+    sds received = receive(sdsempty());
+    TEST_ASSERT_EQUAL_size_t(3, count(received, "HTTP/1.1 200 OK\r\n"));
+    char *a = strstr(received, "\r\n\r\n/a");
+    char *b = strstr(received, "\r\n\r\n/b");
+    char *c = strstr(received, "\r\n\r\n/c");
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_TRUE(a < b);
+    TEST_ASSERT_TRUE(b < c);
+    TEST_ASSERT_EQUAL_size_t(0, sdslen(conn->buffer));
+    sdsfree(received);
+}
+
+void test_http_connection_onEvent_ConnectionClose_Closes(void) {
+    http_connection *conn = connect_client();
+    send_request("GET /a HTTP/1.1\r\nConnection: close\r\n\r\n"
+                 "GET /b HTTP/1.1\r\n\r\n");
+
+    TEST_ASSERT_FALSE(http_connection_onEvent(conn));
+
+    sds received = receive(sdsempty());
+    TEST_ASSERT_EQUAL_size_t(1, count(received, "HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(received, "Connection: close\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(received, "\r\n\r\n/a"));
+    TEST_ASSERT_NULL(strstr(received, "\r\n\r\n/b"));
+    sdsfree(received);
+}
+
+/**
+ * Whether received ends with suffix, so nothing was sent after it
+ */
+static bool ends_with(sds received, const char *suffix) {
+    size_t len = strlen(suffix);
+    return sdslen(received) >= len &&
+           memcmp(received + sdslen(received) - len, suffix, len) == 0;
+}
+
+void test_http_connection_onEvent_BodilessStatus_DropsBody(void) {
+    http_connection *conn = connect_client();
+    send_request("GET /empty HTTP/1.1\r\n\r\n"
+                 "GET /stale HTTP/1.1\r\n\r\n"
+                 "GET /a HTTP/1.1\r\n\r\n");
+
+    TEST_ASSERT_TRUE(http_connection_onEvent(conn));
+
+    sds received = receive(sdsempty());
+    char *no_content = strstr(received, "HTTP/1.1 204 No Content\r\n");
+    char *not_modified = strstr(received, "\r\n\r\nHTTP/1.1 304 Not Modified\r\n");
+    char *ok = strstr(received, "\r\n\r\nHTTP/1.1 200 OK\r\n");
+    TEST_ASSERT_TRUE(no_content == received);
+    TEST_ASSERT_TRUE(no_content < not_modified);
+    TEST_ASSERT_TRUE(not_modified < ok);
+    TEST_ASSERT_NULL(strstr(received, "gone"));
+    TEST_ASSERT_NULL(strstr(received, "Transfer-Encoding"));
+    TEST_ASSERT_TRUE(ends_with(received, "\r\n\r\n/a"));
+    TEST_ASSERT_NULL(conn->stream);
+    TEST_ASSERT_EQUAL_INT(1, atomic_load(&producers_released));
+    sdsfree(received);
+}
+
+void test_http_connection_onEvent_Head_DropsBody(void) {
+    http_connection *conn = connect_client();
+    send_request("HEAD /a HTTP/1.1\r\n\r\n"
+                 "HEAD /stream HTTP/1.1\r\n\r\n"
+                 "GET /b HTTP/1.1\r\n\r\n");
+
+    TEST_ASSERT_TRUE(http_connection_onEvent(conn));
+
+    sds received = receive(sdsempty());
+    TEST_ASSERT_EQUAL_size_t(3, count(received, "HTTP/1.1 200 OK\r\n"));
+    // HEAD /a has the length GET /a would send, HEAD /stream has none
+    TEST_ASSERT_EQUAL_size_t(2, count(received, "Content-Length: 2\r\n"));
+    TEST_ASSERT_EQUAL_size_t(2, count(received, "Content-Length"));
+    TEST_ASSERT_NULL(strstr(received, "/a"));
+    TEST_ASSERT_NULL(strstr(received, "Transfer-Encoding"));
+    TEST_ASSERT_TRUE(ends_with(received, "\r\n\r\n/b"));
+    TEST_ASSERT_NULL(conn->stream);
+    TEST_ASSERT_EQUAL_INT(1, atomic_load(&producers_released));
+    sdsfree(received);
+}
+
+void test_http_connection_onEvent_PendingOutput_StopsReading(void) {
+    const char *request = "GET /big HTTP/1.1\r\n\r\n";
+    size_t request_len = strlen(request);
+    http_connection *conn = connect_client();
+    // Keeps the output from draining into the socket
+    int sndbuf = 4096;
+    TEST_ASSERT_EQUAL_INT(0, setsockopt(conn->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf,
+                                        sizeof(sndbuf)));
+
+    for (int i = 0; i < 4; i++)
+        send_request(request);
+    TEST_ASSERT_TRUE(http_connection_onEvent(conn));
+
+    // Two responses pass the cap, the other requests wait in the buffer
+    TEST_ASSERT_TRUE(conn->out.pending >= HTTP_MAX_PENDING_OUTPUT);
+    TEST_ASSERT_EQUAL_size_t(2 * request_len, sdslen(conn->buffer));
+
+    // Nothing more is read while the client does not read
+    send_request(request);
+    TEST_ASSERT_TRUE(http_connection_onEvent(conn));
+    TEST_ASSERT_EQUAL_size_t(2 * request_len, sdslen(conn->buffer));
+    TEST_ASSERT_EQUAL_size_t(request_len, unread(conn));
+
+    sds received = sdsempty();
+    for (int i = 0; i < 10000 && (conn->out.pending > 0 || unread(conn) > 0); i++) {
+        received = receive(received);
+        TEST_ASSERT_TRUE(http_connection_onEvent(conn));
+    }
+    received = receive(received);
+    TEST_ASSERT_EQUAL_size_t(5, count(received, "HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_EQUAL_size_t(0, unread(conn));
+    TEST_ASSERT_EQUAL_size_t(0, conn->out.pending);
+    sdsfree(received);
+}
+
+void test_http_worker_addConnection_Recycled_Clean(void) {
+    TEST_ASSERT_NULL(http_server_SetBodySpillThreshold(server, 4));
+    http_connection *conn = connect_client();
+    send_request("POST /upload HTTP/1.1\r\nContent-Length: 10\r\n\r\nabcdef");
+
+    // Left mid-body, spilled to a file
+    TEST_ASSERT_TRUE(http_connection_onEvent(conn));
+    TEST_ASSERT_NOT_NULL(conn->request);
+    TEST_ASSERT_TRUE(conn->spilling);
+    TEST_ASSERT_TRUE(conn->spill.fd >= 0);
+
+    http_connection_close(conn);
+    TEST_ASSERT_EQUAL_PTR(conn, worker.pool);
+
+    TEST_ASSERT_EQUAL_PTR(conn, connect_client());
+    TEST_ASSERT_NULL(worker.pool);
+    TEST_ASSERT_NULL(conn->request);
+    TEST_ASSERT_NULL(conn->stream);
+    TEST_ASSERT_FALSE(conn->spilling);
+    TEST_ASSERT_FALSE(conn->routed);
+    TEST_ASSERT_EQUAL_INT(-1, conn->spill.fd);
+    TEST_ASSERT_EQUAL_size_t(0, conn->spill.length);
+    TEST_ASSERT_EQUAL_size_t(0, sdslen(conn->buffer));
+    TEST_ASSERT_EQUAL_size_t(0, conn->out.pending);
+    TEST_ASSERT_EQUAL_INT(HTTP_PARSER_REQUEST_LINE, conn->parser.state);
+    TEST_ASSERT_FALSE(conn->parser.stream_body);
+    TEST_ASSERT_EQUAL_size_t(0, conn->parser.content_length);
+    TEST_ASSERT_EQUAL_size_t(0, conn->parser.consumed);
+    TEST_ASSERT_TRUE(conn->keep_alive);
+    TEST_ASSERT_FALSE(conn->eof);
+
+    send_request("GET /a HTTP/1.1\r\n\r\n");
+    TEST_ASSERT_TRUE(http_connection_onEvent(conn));
+    sds received = receive(sdsempty());
+    TEST_ASSERT_EQUAL_size_t(1, count(received, "HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(received, "\r\n\r\n/a"));
+    sdsfree(received);
+}
+
+void test_http_server_listen_SlowReaderEpoll_Stalls(void) {
+    assert_slowReaderStalls(HTTP_BACKEND_EPOLL);
+}
+
+void test_http_server_listen_SlowReaderIoUring_Stalls(void) {
+    assert_slowReaderStalls(HTTP_BACKEND_IO_URING);
+}
+
+void test_http_server_listen_SlowBodyEpoll_Stalls(void) {
+    assert_slowBodyStalls(HTTP_BACKEND_EPOLL);
+}
+
+void test_http_server_listen_SlowBodyIoUring_Stalls(void) {
+    assert_slowBodyStalls(HTTP_BACKEND_IO_URING);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_connection_onEvent_Pipelined_InOrder);
+    RUN_TEST(test_http_connection_onEvent_ConnectionClose_Closes);
+    RUN_TEST(test_http_connection_onEvent_BodilessStatus_DropsBody);
+    RUN_TEST(test_http_connection_onEvent_Head_DropsBody);
+    RUN_TEST(test_http_connection_onEvent_PendingOutput_StopsReading);
+    RUN_TEST(test_http_worker_addConnection_Recycled_Clean);
+    RUN_TEST(test_http_server_listen_SlowReaderEpoll_Stalls);
+    RUN_TEST(test_http_server_listen_SlowReaderIoUring_Stalls);
+    RUN_TEST(test_http_server_listen_SlowBodyEpoll_Stalls);
+    RUN_TEST(test_http_server_listen_SlowBodyIoUring_Stalls);
+    return UNITY_END();
+}
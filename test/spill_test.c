@@ -0,0 +1,71 @@
+#include "request/spill.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unity.h>
+#include <unity_internals.h>
+
+http_spill spill;
+
+void setUp(void) { http_spill_init(&spill, 8); }
+
+void tearDown(void) { http_spill_deinit(&spill); }
+
+void test_http_spill_write_BelowThreshold_InMemory(void) {
+    TEST_ASSERT_NULL(http_spill_write(&spill, "abc", 3));
+    TEST_ASSERT_NULL(http_spill_write(&spill, "defgh", 5));
+    TEST_ASSERT_EQUAL_INT(-1, spill.fd);
+    TEST_ASSERT_EQUAL_size_t(8, spill.length);
+
+    void *data;
+    TEST_ASSERT_NULL(http_spill_view(&spill, &data));
+    TEST_ASSERT_EQUAL_MEMORY("abcdefgh", data, 8);
+}
+
+void test_http_spill_write_AboveThreshold_MovesToFile(void) {
+    TEST_ASSERT_NULL(http_spill_write(&spill, "abcdef", 6));
+    TEST_ASSERT_NULL(http_spill_write(&spill, "ghijkl", 6));
+    TEST_ASSERT_TRUE(spill.fd >= 0);
+    TEST_ASSERT_EQUAL_size_t(0, sdslen(spill.memory));
+
+    struct stat st;
+    TEST_ASSERT_EQUAL_INT(0, fstat(spill.fd, &st));
+    TEST_ASSERT_EQUAL_INT(12, st.st_size);
+
+    void *data;
+    TEST_ASSERT_NULL(http_spill_view(&spill, &data));
+    TEST_ASSERT_EQUAL_MEMORY("abcdefghijkl", data, 12);
+
+    // The view is private, the file keeps the received bytes
+    ((char *)data)[0] = 'X';
+    char first;
+    TEST_ASSERT_EQUAL_INT(1, pread(spill.fd, &first, 1, 0));
+    TEST_ASSERT_EQUAL_INT('a', first);
+}
+
+void test_http_spill_reset_Reusable(void) {
+    TEST_ASSERT_NULL(http_spill_write(&spill, "0123456789", 10));
+    TEST_ASSERT_TRUE(spill.fd >= 0);
+    http_spill_reset(&spill);
+    TEST_ASSERT_EQUAL_INT(-1, spill.fd);
+    TEST_ASSERT_EQUAL_size_t(0, spill.length);
+
+    void *data;
+    TEST_ASSERT_NULL(http_spill_view(&spill, &data));
+    TEST_ASSERT_NULL(data);
+
+    TEST_ASSERT_NULL(http_spill_write(&spill, "xy", 2));
+    TEST_ASSERT_EQUAL_INT(-1, spill.fd);
+    TEST_ASSERT_NULL(http_spill_view(&spill, &data));
+    TEST_ASSERT_EQUAL_MEMORY("xy", data, 2);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_http_spill_write_BelowThreshold_InMemory);
+    RUN_TEST(test_http_spill_write_AboveThreshold_MovesToFile);
+    RUN_TEST(test_http_spill_reset_Reusable);
+    return UNITY_END();
+}